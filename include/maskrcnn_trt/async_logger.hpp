@@ -0,0 +1,93 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __ASYNC_LOGGER_HPP
+#define __ASYNC_LOGGER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <NvInferRuntimeCommon.h>
+
+namespace mr {
+    struct LogRing;
+
+    /** Writes log messages to standard output and error from a background
+     * thread. Each thread logging messages gets its own lock-free ring buffer,
+     * allocated the first time it logs, so logging from several threads
+     * neither locks nor blocks on I/O. Messages are dropped if a ring buffer
+     * is full and the number of dropped messages is reported. Messages of
+     * severity kINFO and kVERBOSE are written to standard output and the rest
+     * to standard error, prefixed by their timestamp and severity.
+     */
+    class AsyncLogWriter {
+        public:
+            using Severity = nvinfer1::ILogger::Severity;
+
+            /** The process-wide writer. Its thread is started on the first
+             * call and stopped at exit after writing all pending messages.
+             */
+            static AsyncLogWriter& instance();
+
+            /** Queue the concatenation of prefix and text as a single message.
+             * A newline is appended if text doesn't end with one. Messages
+             * written after shutdown() are written synchronously.
+             */
+            void write(Severity severity, std::string_view prefix, std::string_view text);
+
+            /** Block until all messages queued before the call have been
+             * written.
+             */
+            void flush();
+
+            /** Write all pending messages and stop the writer thread.
+             */
+            void shutdown();
+
+            /** The number of messages dropped because a ring buffer was full.
+             */
+            uint64_t dropped() const;
+
+            AsyncLogWriter(const AsyncLogWriter&) = delete;
+            AsyncLogWriter& operator=(const AsyncLogWriter&) = delete;
+
+        private:
+            AsyncLogWriter();
+
+            void run();
+
+            /** Write the messages of all ring buffers, return whether any
+             * messages were written.
+             */
+            bool drain();
+
+            LogRing& localRing();
+
+            std::atomic<bool> running_ {true};
+            std::atomic<uint64_t> dropped_ {0};
+            uint64_t reported_dropped_ = 0;
+            std::atomic<uint64_t> flush_requests_ {0};
+            std::atomic<uint64_t> flushes_done_ {0};
+            std::mutex rings_mutex_;
+            std::vector<std::shared_ptr<LogRing>> rings_;
+            std::mutex wake_mutex_;
+            std::condition_variable wake_;
+            std::condition_variable flushed_;
+            std::mutex output_mutex_;
+            std::string stdout_buffer_;
+            std::string stderr_buffer_;
+            int64_t cached_second_ = -1;
+            std::string cached_timestamp_;
+            std::thread thread_;
+    };
+} // namespace mr
+
+#endif // __ASYNC_LOGGER_HPP
@@ -0,0 +1,272 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __BATCH_PROCESSING_HPP
+#define __BATCH_PROCESSING_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "detection.hpp"
+
+namespace mr {
+    class FrameSource;
+    class MaskRCNN;
+
+
+
+    /** Return the image filenames specified by input, which may be a
+     * directory, a glob pattern or a text file containing one filename per
+     * line. Only files with common image extensions are returned from a
+     * directory. Directory and glob results are sorted. An empty vector is
+     * returned on error.
+     */
+    std::vector<std::string> collect_image_filenames(const std::string& input);
+
+
+
+    /** An image decoded by ImagePrefetcher.
+     */
+    struct DecodedImage {
+        std::string filename;
+        /** Empty if decoding failed.
+         */
+        cv::Mat image;
+        /** The size of the image at full resolution, which may be larger
+         * than that of image, see read_image().
+         */
+        cv::Size original_size;
+    };
+
+    /** Decode images on a pool of threads ahead of their consumption. Images
+     * are returned in the order of their filenames and at most max_ahead
+     * decoded images are kept in memory.
+     */
+    class ImagePrefetcher {
+        public:
+            /** Decode a file into a BGR image, returning an empty image on
+             * error. The size of the image at full resolution is written to
+             * the second argument, like in read_image().
+             */
+            typedef std::function<cv::Mat(const std::string&, cv::Size&)> Decoder;
+
+            /** Start num_threads threads decoding filenames with decoder, or
+             * read_image() if decoder is empty.
+             */
+            ImagePrefetcher(std::vector<std::string> filenames,
+                            size_t                   num_threads,
+                            size_t                   max_ahead,
+                            Decoder                  decoder = Decoder());
+
+            /** Stop decoding and join the threads.
+             */
+            ~ImagePrefetcher();
+
+            ImagePrefetcher(const ImagePrefetcher&) = delete;
+            ImagePrefetcher& operator=(const ImagePrefetcher&) = delete;
+
+            /** Move the next image into image, blocking until it has been
+             * decoded. Return false once all images have been returned. Must
+             * be called from a single thread.
+             */
+            bool next(DecodedImage& image);
+
+        private:
+            std::vector<std::string> filenames_;
+            Decoder decoder_;
+            /** Image i is stored in element i % max_ahead.
+             */
+            std::vector<DecodedImage> slots_;
+            std::vector<bool> ready_;
+            size_t next_decode_ = 0;
+            size_t next_consume_ = 0;
+            bool stop_ = false;
+            std::mutex mutex_;
+            std::condition_variable decoder_cv_;
+            std::condition_variable consumer_cv_;
+            std::vector<std::thread> threads_;
+
+            void decode();
+    };
+
+
+
+    /** Write the detections of images to a single file, one JSON object per
+     * line, in the order they were added. Each line contains the index of the
+     * image in the order they were added as "frame" and the image filename,
+     * if any, as "image", followed by either its detections or an "error"
+     * string. Writing the visualizations of the detections and formatting
+     * happen on a pool of threads.
+     */
+    class ResultWriter {
+        public:
+            ResultWriter() = default;
+
+            /** Close the writer if it's open.
+             */
+            ~ResultWriter();
+
+            ResultWriter(const ResultWriter&) = delete;
+            ResultWriter& operator=(const ResultWriter&) = delete;
+
+            /** Create the output file and start num_threads writer threads.
+             * At most max_pending images are queued before add() blocks. If
+             * visualization_directory isn't empty the visualization of each
+             * image is saved there as a PNG named after its index followed by
+             * the image filename without its directory and extension, if any,
+             * e.g. 00000012_image.detections.png. The index keeps the names
+             * of images with the same filename in different directories
+             * apart. Return true on success.
+             */
+            bool open(const std::string& filename,
+                      size_t             num_threads,
+                      size_t             max_pending,
+                      const std::string& visualization_directory = "");
+
+            /** Queue the detections of an image, whose filename may be
+             * empty, for writing. image_size
+             * should be the size the detections were computed for, or empty if
+             * the image couldn't be decoded. The image is only needed for
+             * visualization and is resized to image_size if needed and
+             * rendered on in place. Must be called from a single thread.
+             */
+            void add(const std::string&     image_filename,
+                     cv::Size               image_size,
+                     std::vector<Detection> detections,
+                     cv::Mat                image = cv::Mat());
+
+            /** Queue an image, whose filename may be empty, for which no
+             * detections could be computed. Its line contains error as
+             * "error" instead of its detections. Must be called from the
+             * same thread as add().
+             */
+            void addError(const std::string& image_filename, const std::string& error);
+
+            /** Wait for all queued images to be written, then stop the threads
+             * and close the output file. Return false if any write failed.
+             */
+            bool close();
+
+        private:
+            struct Task {
+                uint64_t sequence;
+                std::string image_filename;
+                cv::Size image_size;
+                cv::Mat image;
+                std::vector<Detection> detections;
+                std::string error;
+            };
+
+            void push(Task task);
+
+            std::ofstream file_;
+            std::string visualization_directory_;
+            size_t max_pending_ = 0;
+            std::deque<Task> tasks_;
+            /** Formatted lines waiting for the lines before them.
+             */
+            std::map<uint64_t, std::string> lines_;
+            uint64_t next_sequence_ = 0;
+            uint64_t next_line_ = 0;
+            bool failed_ = false;
+            bool stop_ = false;
+            std::mutex mutex_;
+            std::condition_variable task_cv_;
+            std::condition_variable space_cv_;
+            std::vector<std::thread> threads_;
+
+            void write();
+    };
+
+
+
+    /** The options of process_batch().
+     */
+    struct BatchOptions {
+        /** The file the detections are written to by ResultWriter.
+         */
+        std::string output_filename;
+        /** The directory visualizations are saved in. No visualizations are
+         * saved if empty.
+         */
+        std::string visualization_directory;
+        size_t num_decoders = 2;
+        size_t num_writers = 2;
+        /** The number of decoded images kept ahead of inference.
+         */
+        size_t max_prefetch = 16;
+        /** Used instead of read_image() if not empty.
+         */
+        ImagePrefetcher::Decoder decoder;
+        /** The KeyframeConfig::stride and KeyframeConfig::adaptive of
+         * process_stream(). The default stride of 1 runs inference on every
+         * frame.
+         */
+        int keyframe_stride = 1;
+        bool adaptive_keyframes = false;
+        /** The MotionGateConfig::threshold of process_stream(). The motion
+         * gate is disabled if 0.
+         */
+        float motion_threshold = 0.0f;
+        /** The KeyframeConfig::optical_flow of process_stream().
+         */
+        bool optical_flow = false;
+    };
+
+    /** The outcome of process_batch().
+     */
+    struct BatchSummary {
+        size_t images = 0;
+        /** The number of images that couldn't be decoded.
+         */
+        size_t failed = 0;
+        /** The number of images or frames inference failed on. They are
+         * written with an error instead of detections.
+         */
+        size_t failed_inference = 0;
+        /** The number of frames of process_stream() the motion gate skipped
+         * inference on.
+         */
+        size_t skipped = 0;
+        double seconds = 0.0;
+        /** Whether writing the results succeeded.
+         */
+        bool written = false;
+        /** Whether process_stream() stopped because reading from the frame
+         * source failed rather than at the end of the stream.
+         */
+        bool source_failed = false;
+    };
+
+    /** Run inference on all images in filenames, decoding them ahead with an
+     * ImagePrefetcher and writing the results with a ResultWriter, so that
+     * neither decoding nor writing stalls inference.
+     */
+    BatchSummary process_batch(MaskRCNN&                       network,
+                               const std::vector<std::string>& filenames,
+                               const BatchOptions&             options);
+
+    /** Run inference on all frames of source, writing the results with a
+     * ResultWriter indexed by frame number. If options.keyframe_stride is
+     * greater than 1 inference only runs on keyframes and the detections of
+     * the other frames are predicted by a TemporalMaskRCNN. If
+     * options.motion_threshold is positive, frames that hardly changed reuse
+     * the previous detections. The decoding
+     * options of options are ignored.
+     */
+    BatchSummary process_stream(MaskRCNN&           network,
+                                FrameSource&        source,
+                                const BatchOptions& options);
+} // namespace mr
+
+#endif // __BATCH_PROCESSING_HPP
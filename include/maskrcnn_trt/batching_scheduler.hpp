@@ -0,0 +1,130 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __BATCHING_SCHEDULER_HPP
+#define __BATCHING_SCHEDULER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "detection.hpp"
+
+namespace mr {
+    class MaskRCNN;
+
+    /** Groups images submitted from several threads into batches and runs
+     * inference on each batch with a single network execution. A batch is
+     * dispatched as soon as it contains max_batch_size images or when the
+     * oldest image in it has been waiting for max_delay.
+     */
+    class BatchingScheduler {
+        public:
+            /** A function that runs inference on a batch of images and returns
+             * the detections of each image, like
+             * MaskRCNN::infer(const std::vector<cv::Mat>&, bool). Returning a
+             * vector of the wrong size is treated as an inference error.
+             */
+            typedef std::function<std::vector<std::vector<Detection>>(
+                    const std::vector<cv::Mat>&)> InferenceFunction;
+
+            /** Statistics of the batches dispatched so far.
+             */
+            struct Stats {
+                /** The number of images currently waiting to be dispatched.
+                 */
+                size_t queue_depth = 0;
+                /** Element i contains the number of times a batch was
+                 * dispatched while i images were waiting. The last element
+                 * also counts all larger queue depths.
+                 */
+                std::vector<uint64_t> queue_depth_histogram;
+                /** Element i contains the number of dispatched batches
+                 * containing i images.
+                 */
+                std::vector<uint64_t> batch_size_histogram;
+            };
+
+            /** Create a scheduler dispatching batches to network. The batch
+             * size is limited by MaskRCNNConfig::max_batch_size of network.
+             * The network must have been built and must outlive the scheduler.
+             */
+            BatchingScheduler(MaskRCNN&                 network,
+                              int                       max_batch_size,
+                              std::chrono::microseconds max_delay,
+                              bool                      in_bgr_order = true);
+
+            /** Create a scheduler dispatching batches to an arbitrary inference
+             * function, e.g. a mock backend.
+             */
+            BatchingScheduler(InferenceFunction         infer,
+                              int                       max_batch_size,
+                              std::chrono::microseconds max_delay);
+
+            /** Calls shutdown().
+             */
+            ~BatchingScheduler();
+
+            BatchingScheduler(const BatchingScheduler&) = delete;
+            BatchingScheduler& operator=(const BatchingScheduler&) = delete;
+
+            /** Queue an image for inference and return a future that will
+             * contain its detections. The image data is not copied so it must
+             * not be modified until the future is ready. The detections are
+             * empty if inference failed. If the inference function throws,
+             * the future of each image in the batch rethrows the exception.
+             * After shutdown() the future throws std::runtime_error.
+             */
+            std::future<std::vector<Detection>> submit(const cv::Mat& image);
+
+            /** Dispatch any remaining images and stop the dispatcher thread.
+             * Blocks until the futures of all images submitted before the
+             * call are ready.
+             */
+            void shutdown();
+
+            /** Return the number of images currently waiting to be dispatched.
+             */
+            size_t queueDepth() const;
+
+            /** Return a snapshot of the dispatch statistics.
+             */
+            Stats stats() const;
+
+        private:
+            typedef std::chrono::steady_clock Clock;
+
+            struct Request {
+                cv::Mat image;
+                Clock::time_point deadline;
+                std::promise<std::vector<Detection>> promise;
+            };
+
+            InferenceFunction infer_;
+            const size_t max_batch_size_;
+            const std::chrono::microseconds max_delay_;
+            mutable std::mutex mutex_;
+            std::condition_variable cv_;
+            std::deque<Request> queue_;
+            std::vector<uint64_t> queue_depth_histogram_;
+            std::vector<uint64_t> batch_size_histogram_;
+            bool stop_ = false;
+            std::thread dispatcher_;
+
+            /** Form batches from the queued images and run inference on them
+             * until the scheduler is destroyed.
+             */
+            void dispatch();
+    };
+} // namespace mr
+
+#endif // __BATCHING_SCHEDULER_HPP
@@ -9,6 +9,7 @@
 
 #include "common.hpp"
 #include "half.hpp"
+#include "host_allocation.hpp"
 
 
 using namespace std;
@@ -50,9 +51,19 @@ public:
     //! \brief Construct a buffer with the specified allocation size in bytes.
     //!
     GenericBuffer(size_t size, nvinfer1::DataType type)
+        : GenericBuffer(size, type, AllocFunc(), FreeFunc())
+    {
+    }
+
+    //!
+    //! \brief Construct a buffer with the specified allocation size in bytes using stateful allocation functors.
+    //!
+    GenericBuffer(size_t size, nvinfer1::DataType type, AllocFunc alloc, FreeFunc free)
         : mSize(size)
         , mCapacity(size)
         , mType(type)
+        , allocFn(alloc)
+        , freeFn(free)
     {
         if (!allocFn(&mBuffer, this->nbBytes()))
         {
@@ -65,6 +76,8 @@ public:
         , mCapacity(buf.mCapacity)
         , mType(buf.mType)
         , mBuffer(buf.mBuffer)
+        , allocFn(buf.allocFn)
+        , freeFn(buf.freeFn)
     {
         buf.mSize = 0;
         buf.mCapacity = 0;
@@ -81,6 +94,8 @@ public:
             mCapacity = buf.mCapacity;
             mType = buf.mType;
             mBuffer = buf.mBuffer;
+            allocFn = buf.allocFn;
+            freeFn = buf.freeFn;
             // Reset buf.
             buf.mSize = 0;
             buf.mCapacity = 0;
@@ -177,23 +192,45 @@ public:
     }
 };
 
+//!
+//! \brief Allocates host memory with a policy that must have been resolved with mr::resolve_host_allocation().
+//!
 class HostAllocator
 {
 public:
+    HostAllocator(mr::HostAllocation allocation = mr::HostAllocation::pageable)
+        : mAllocation(allocation)
+    {
+    }
+
     bool operator()(void** ptr, size_t size) const
     {
-        *ptr = malloc(size);
+        *ptr = mr::allocate_host(size, mAllocation);
         return *ptr != nullptr;
     }
+
+private:
+    mr::HostAllocation mAllocation;
 };
 
+//!
+//! \brief Frees host memory allocated by a HostAllocator with the same policy.
+//!
 class HostFree
 {
 public:
+    HostFree(mr::HostAllocation allocation = mr::HostAllocation::pageable)
+        : mAllocation(allocation)
+    {
+    }
+
     void operator()(void* ptr) const
     {
-        free(ptr);
+        mr::free_host(ptr, mAllocation);
     }
+
+private:
+    mr::HostAllocation mAllocation;
 };
 
 using DeviceBuffer = GenericBuffer<DeviceAllocator, DeviceFree>;
@@ -224,11 +261,15 @@ public:
 
     //!
     //! \brief Create a BufferManager for handling buffer interactions with engine.
+    //!        The host buffers are allocated with hostAllocation, or aligned memory if pinned memory was requested
+    //!        but no CUDA device is present.
     //!
     BufferManager(std::shared_ptr<nvinfer1::ICudaEngine> engine, const int& batchSize,
-        const nvinfer1::IExecutionContext* context = nullptr)
+        const nvinfer1::IExecutionContext* context = nullptr,
+        mr::HostAllocation hostAllocation = mr::HostAllocation::pageable)
         : mEngine(engine)
         , mBatchSize(batchSize)
+        , mHostAllocation(mr::resolve_host_allocation(hostAllocation))
     {
         // Create host and device buffers
         for (int i = 0; i < mEngine->getNbBindings(); i++)
@@ -246,7 +287,7 @@ public:
             vol *= samplesCommon::volume(dims);
             std::unique_ptr<ManagedBuffer> manBuf{new ManagedBuffer()};
             manBuf->deviceBuffer = DeviceBuffer(vol, type);
-            manBuf->hostBuffer = HostBuffer(vol, type);
+            manBuf->hostBuffer = HostBuffer(vol, type, HostAllocator(mHostAllocation), HostFree(mHostAllocation));
             mDeviceBindings.emplace_back(manBuf->deviceBuffer.data());
             mManagedBuffers.emplace_back(std::move(manBuf));
         }
@@ -362,33 +403,112 @@ public:
     //!
     //! \brief Copy the contents of input host buffers to input device buffers synchronously.
     //!
-    void copyInputToDevice()
+    bool copyInputToDevice()
+    {
+        return memcpyBuffers(true, false, false);
+    }
+
+    //!
+    //! \brief Copy the first batchSize items of input host buffers to input device buffers synchronously.
+    //!
+    bool copyInputToDevice(int batchSize)
     {
-        memcpyBuffers(true, false, false);
+        return memcpyBuffers(true, false, false, 0, batchSize);
     }
 
     //!
     //! \brief Copy the contents of output device buffers to output host buffers synchronously.
     //!
-    void copyOutputToHost()
+    bool copyOutputToHost()
+    {
+        return memcpyBuffers(false, true, false);
+    }
+
+    //!
+    //! \brief Copy the first batchSize items of output device buffers to output host buffers synchronously.
+    //!
+    bool copyOutputToHost(int batchSize)
     {
-        memcpyBuffers(false, true, false);
+        return memcpyBuffers(false, true, false, 0, batchSize);
     }
 
     //!
     //! \brief Copy the contents of input host buffers to input device buffers asynchronously.
     //!
-    void copyInputToDeviceAsync(const cudaStream_t& stream = 0)
+    bool copyInputToDeviceAsync(const cudaStream_t& stream = 0)
+    {
+        return memcpyBuffers(true, false, true, stream);
+    }
+
+    //!
+    //! \brief Copy the first batchSize items of input host buffers to input device buffers asynchronously.
+    //!
+    bool copyInputToDeviceAsync(const cudaStream_t& stream, int batchSize)
     {
-        memcpyBuffers(true, false, true, stream);
+        return memcpyBuffers(true, false, true, stream, batchSize);
     }
 
     //!
     //! \brief Copy the contents of output device buffers to output host buffers asynchronously.
     //!
-    void copyOutputToHostAsync(const cudaStream_t& stream = 0)
+    bool copyOutputToHostAsync(const cudaStream_t& stream = 0)
     {
-        memcpyBuffers(false, true, true, stream);
+        return memcpyBuffers(false, true, true, stream);
+    }
+
+    //!
+    //! \brief Copy the first batchSize items of output device buffers to output host buffers asynchronously.
+    //!
+    bool copyOutputToHostAsync(const cudaStream_t& stream, int batchSize)
+    {
+        return memcpyBuffers(false, true, true, stream, batchSize);
+    }
+
+    //!
+    //! \brief Returns the number of bytes allocated for the host buffer of the binding at index, which may be
+    //!        more than its size depending on the host allocation policy.
+    //!
+    size_t hostBytes(int index) const
+    {
+        return mr::host_allocation_size(mManagedBuffers[index]->hostBuffer.nbBytes(), mHostAllocation);
+    }
+
+    //!
+    //! \brief Returns the number of bytes of the device buffer of the binding at index.
+    //!
+    size_t deviceBytes(int index) const
+    {
+        return mManagedBuffers[index]->deviceBuffer.nbBytes();
+    }
+
+    //!
+    //! \brief Returns the total number of bytes allocated for all host buffers, see hostBytes().
+    //!
+    size_t totalHostBytes() const
+    {
+        size_t bytes = 0;
+        for (int i = 0; i < static_cast<int>(mManagedBuffers.size()); i++)
+            bytes += hostBytes(i);
+        return bytes;
+    }
+
+    //!
+    //! \brief Returns the total number of bytes of all device buffers.
+    //!
+    size_t totalDeviceBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& buffer : mManagedBuffers)
+            bytes += buffer->deviceBuffer.nbBytes();
+        return bytes;
+    }
+
+    //!
+    //! \brief Returns the policy the host buffers were allocated with.
+    //!
+    mr::HostAllocation hostAllocation() const
+    {
+        return mHostAllocation;
     }
 
     ~BufferManager() = default;
@@ -402,7 +522,11 @@ private:
         return (isHost ? mManagedBuffers[index]->hostBuffer.data() : mManagedBuffers[index]->deviceBuffer.data());
     }
 
-    void memcpyBuffers(const bool copyInput, const bool deviceToHost, const bool async, const cudaStream_t& stream = 0)
+    //!
+    //! \brief Copy the input or output buffers. Returns false and stops at the first failed copy.
+    //!
+    bool memcpyBuffers(const bool copyInput, const bool deviceToHost, const bool async, const cudaStream_t& stream = 0,
+        const int batchSize = -1)
     {
         for (int i = 0; i < mEngine->getNbBindings(); i++)
         {
@@ -410,22 +534,30 @@ private:
                 = deviceToHost ? mManagedBuffers[i]->hostBuffer.data() : mManagedBuffers[i]->deviceBuffer.data();
             const void* srcPtr
                 = deviceToHost ? mManagedBuffers[i]->deviceBuffer.data() : mManagedBuffers[i]->hostBuffer.data();
-            const size_t byteSize = mManagedBuffers[i]->hostBuffer.nbBytes();
+            size_t byteSize = mManagedBuffers[i]->hostBuffer.nbBytes();
+            // Only copy the leading batch items when a partial batch was requested.
+            if (batchSize > 0 && batchSize < mBatchSize)
+                byteSize = byteSize / mBatchSize * batchSize;
             const cudaMemcpyKind memcpyType = deviceToHost ? cudaMemcpyDeviceToHost : cudaMemcpyHostToDevice;
             if ((copyInput && mEngine->bindingIsInput(i)) || (!copyInput && !mEngine->bindingIsInput(i)))
             {
-                if (async)
-                    CHECK(cudaMemcpyAsync(dstPtr, srcPtr, byteSize, memcpyType, stream));
-                else
-                    CHECK(cudaMemcpy(dstPtr, srcPtr, byteSize, memcpyType));
+                const cudaError_t status = async ? cudaMemcpyAsync(dstPtr, srcPtr, byteSize, memcpyType, stream)
+                                                 : cudaMemcpy(dstPtr, srcPtr, byteSize, memcpyType);
+                if (status != cudaSuccess)
+                {
+                    std::cerr << "Cuda failure: " << cudaGetErrorString(status) << std::endl;
+                    return false;
+                }
             }
         }
+        return true;
     }
 
     std::shared_ptr<nvinfer1::ICudaEngine> mEngine;              //!< The pointer to the engine
     int mBatchSize;                                              //!< The batch size
     std::vector<std::unique_ptr<ManagedBuffer>> mManagedBuffers; //!< The vector of pointers to managed buffers
     std::vector<void*> mDeviceBindings; //!< The vector of device buffers needed for engine execution
+    mr::HostAllocation mHostAllocation;  //!< The policy used to allocate the host buffers
 };
 
 } // namespace samplesCommon
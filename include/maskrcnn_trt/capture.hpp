@@ -0,0 +1,142 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __CAPTURE_HPP
+#define __CAPTURE_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+namespace mr {
+    /** The metadata of a captured frame as stored in the capture index file.
+     */
+    struct CaptureIndexEntry {
+        /** The number of frames processed by the network before this one.
+         */
+        uint64_t frame_id = 0;
+        /** The capture time in nanoseconds since the UNIX epoch.
+         */
+        int64_t timestamp_ns = 0;
+        /** The offset of the record in the capture data file in bytes.
+         */
+        uint64_t offset = 0;
+        /** The dimensions of the input image before preprocessing.
+         */
+        int32_t image_width = 0;
+        int32_t image_height = 0;
+        /** Whether the capture was requested with MaskRCNN::triggerCapture()
+         * rather than taken periodically.
+         */
+        uint32_t triggered = 0;
+        uint32_t reserved = 0;
+    };
+
+
+
+    /** A captured frame. The buffers point directly into the memory-mapped
+     * capture file and contain MaskRCNNConfig::model_detection_volume and
+     * MaskRCNNConfig::model_mask_volume floats respectively, in the format
+     * expected by get_detections().
+     */
+    struct CaptureRecord {
+        CaptureIndexEntry metadata;
+        const float* detection_buffer = nullptr;
+        const float* mask_buffer = nullptr;
+    };
+
+
+
+    /** Append raw network output buffers to a capture. A capture consists of a
+     * data file containing the output buffers and an index file, with the
+     * suffix .idx, containing a CaptureIndexEntry for each record. Records are
+     * only added to the index once their data has been written. Writing is
+     * thread-safe.
+     */
+    class CaptureWriter {
+        public:
+            CaptureWriter() = default;
+
+            ~CaptureWriter();
+
+            CaptureWriter(const CaptureWriter&) = delete;
+            CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+            /** Open a capture for appending, creating it if it doesn't exist.
+             * A previously opened capture is closed first. Return true on
+             * success.
+             */
+            bool open(const std::string& filename);
+
+            /** Append the output buffers of a frame to the capture. Return true
+             * on success.
+             */
+            bool write(uint64_t     frame_id,
+                       cv::Size     image_size,
+                       bool         triggered,
+                       const float* detection_buffer,
+                       const float* mask_buffer);
+
+            /** Close the capture files.
+             */
+            void close();
+
+        private:
+            /** Close the capture files, mutex_ must be held.
+             */
+            void closeFiles();
+
+            std::mutex mutex_;
+            int data_fd_ = -1;
+            int index_fd_ = -1;
+            uint64_t data_size_ = 0;
+    };
+
+
+
+    /** Read a capture written by CaptureWriter without copying. The files are
+     * memory-mapped so records are only loaded from the disk when accessed.
+     */
+    class CaptureReader {
+        public:
+            CaptureReader() = default;
+
+            ~CaptureReader();
+
+            CaptureReader(const CaptureReader&) = delete;
+            CaptureReader& operator=(const CaptureReader&) = delete;
+
+            /** Map a capture into memory. Records appended afterwards are not
+             * visible until the capture is opened again. Trailing records
+             * whose data is incomplete are ignored. Return false if the
+             * capture can't be mapped or an index entry points outside the
+             * data file or to an unaligned offset.
+             */
+            bool open(const std::string& filename);
+
+            /** Return the number of records in the capture.
+             */
+            size_t size() const;
+
+            /** Return the record at index, which must be smaller than size().
+             * The pointers remain valid while the reader is open.
+             */
+            CaptureRecord record(size_t index) const;
+
+            /** Unmap the capture.
+             */
+            void close();
+
+        private:
+            const uint8_t* data_ = nullptr;
+            size_t data_size_ = 0;
+            const uint8_t* index_ = nullptr;
+            size_t index_size_ = 0;
+            size_t num_records_ = 0;
+    };
+} // namespace mr
+
+#endif // __CAPTURE_HPP
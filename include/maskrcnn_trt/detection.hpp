@@ -34,9 +34,19 @@ namespace mr {
          */
         float y_end      = 0.0f;
         /** The mask of the detection. Its type is CV_8UC1. In the range [0-255]
-         * inclusive.
+         * inclusive. It has the same dimensions as the input image unless
+         * box_local_mask is true. It may be empty if a mask byte limit was
+         * exceeded, see MaskRCNNConfig::max_mask_bytes.
          */
         cv::Mat mask;
+        /** Whether the mask only covers the bounding box. Its top left corner
+         * then corresponds to the pixel (x_start, y_start).
+         */
+        bool box_local_mask = false;
+        /** The ID of the track the detection belongs to, assigned by
+         * IoUTracker. -1 if the detection isn't tracked.
+         */
+        int track_id = -1;
     };
 
     std::ostream& operator<<(std::ostream& os, const Detection& d);
@@ -56,7 +66,51 @@ namespace mr {
                                           const void* detection_buffer,
                                           const void* mask_buffer);
 
-    /** Render the detections on the image and return the render.
+    /** The first part of get_detections(). Get the detections from the host
+     * detection buffer without computing their masks. The index of each
+     * detection in the detection buffer is written to the respective element
+     * of raw_indices.
+     */
+    std::vector<Detection> get_detection_boxes(int               input_width,
+                                               int               input_height,
+                                               const void*       detection_buffer,
+                                               std::vector<int>& raw_indices);
+
+    /** The second part of get_detections(). Compute the masks of detections
+     * returned by get_detection_boxes() from the host mask buffer. If the
+     * full-image masks would take up more than max_mask_bytes bytes, box-local
+     * masks are computed instead. Any detections whose box-local masks would
+     * exceed the limit are left with an empty mask. A max_mask_bytes of 0
+     * means no limit. Return the number of bytes of the computed masks.
+     */
+    size_t get_detection_masks(std::vector<Detection>& detections,
+                               const std::vector<int>& raw_indices,
+                               int                     input_width,
+                               int                     input_height,
+                               const void*             mask_buffer,
+                               size_t                  max_mask_bytes = 0);
+
+    /** Get the detections of each image in a batch from the host buffers.
+     * Element i of input_sizes should be the size of image i of the batch,
+     * before preprocessing, and the buffers should point to the start of the
+     * batch. Element i of the returned vector contains the detections of image
+     * i.
+     */
+    std::vector<std::vector<Detection>> get_batch_detections(
+            const std::vector<cv::Size>& input_sizes,
+            const void*                  detection_buffer,
+            const void*                  mask_buffer);
+
+    /** Render the detections in place on render, which must be of type
+     * CV_8UC3. Only the pixels inside the bounding box of each detection are
+     * visited when blending its mask. Return false if render has the wrong
+     * type.
+     */
+    bool render_detections(const std::vector<Detection>& detections,
+                           cv::Mat&                      render);
+
+    /** Render the detections on a copy of the image and return the render.
+     * See render_detections().
      */
     cv::Mat visualize_detections(const std::vector<Detection>& detections,
                                  const cv::Mat&                image);
@@ -0,0 +1,167 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __DETECTION_STREAM_HPP
+#define __DETECTION_STREAM_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "detection.hpp"
+
+namespace mr {
+    /** How the masks of a detection stream are stored. All masks are stored
+     * box-local.
+     */
+    enum class MaskEncoding : uint32_t {
+        /** The detection has no mask.
+         */
+        none = 0,
+        /** The mask values, one byte per pixel in row-major order. Keeps the
+         * soft mask values and can be read without copying.
+         */
+        raw = 1,
+        /** The mask thresholded at 128 and stored as uint32_t run lengths of
+         * alternating background and foreground pixels in row-major order,
+         * starting with background.
+         */
+        rle = 2,
+    };
+
+    /** The location of a mask in a detection stream record.
+     */
+    struct DetectionMaskEntry {
+        MaskEncoding encoding = MaskEncoding::none;
+        int32_t width = 0;
+        int32_t height = 0;
+        uint32_t reserved = 0;
+        /** The offset of the mask data from the start of the record in bytes.
+         */
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+
+
+    /** The detections of a frame in a memory-mapped detection stream. The
+     * arrays point directly into the mapping and contain size elements, or
+     * 4 * size for boxes. They remain valid while the reader is open.
+     */
+    struct DetectionFrameView {
+        uint64_t frame = 0;
+        cv::Size image_size;
+        size_t size = 0;
+        /** x_start, y_start, x_end and y_end of each detection.
+         */
+        const float* boxes = nullptr;
+        const float* confidences = nullptr;
+        const int32_t* class_ids = nullptr;
+        const int32_t* track_ids = nullptr;
+        const DetectionMaskEntry* masks = nullptr;
+        const uint8_t* record = nullptr;
+
+        /** Return the box-local mask of detection i. Raw masks point into the
+         * mapping and must not be modified, RLE masks are decoded into a new
+         * image. Empty if the detection has no mask.
+         */
+        cv::Mat mask(size_t i) const;
+
+        /** Return detection i with a box-local mask as returned by mask().
+         */
+        Detection detection(size_t i) const;
+    };
+
+
+
+    /** Write the detections of a sequence of frames to a compact binary
+     * file. The file starts with a 64-byte header, followed by a 64-byte
+     * aligned record per frame containing a 64-byte frame header and the
+     * mask entries, boxes, confidences, class IDs, track IDs and mask data of
+     * its detections as separate arrays. Each record is assembled in memory
+     * and written at once. Writing isn't thread-safe.
+     */
+    class DetectionStreamWriter {
+        public:
+            DetectionStreamWriter() = default;
+
+            ~DetectionStreamWriter();
+
+            DetectionStreamWriter(const DetectionStreamWriter&) = delete;
+            DetectionStreamWriter& operator=(const DetectionStreamWriter&) = delete;
+
+            /** Create the file, truncating it if it exists. Masks are stored
+             * with encoding. Return true on success.
+             */
+            bool open(const std::string& filename, MaskEncoding encoding = MaskEncoding::rle);
+
+            /** Append the detections of a frame of size image_size. Full-image
+             * masks are cropped to their bounding box. Return true on
+             * success. On failure any partially written record is removed
+             * from the file.
+             */
+            bool write(uint64_t                      frame,
+                       cv::Size                      image_size,
+                       const std::vector<Detection>& detections);
+
+            /** Return the number of bytes written so far, including the file
+             * header.
+             */
+            uint64_t bytesWritten() const;
+
+            void close();
+
+        private:
+            int fd_ = -1;
+            MaskEncoding encoding_ = MaskEncoding::rle;
+            uint64_t size_ = 0;
+            std::vector<uint8_t> record_;
+            std::vector<uint32_t> runs_;
+    };
+
+
+
+    /** Read a detection stream written by DetectionStreamWriter without
+     * copying. The file is memory-mapped so frames are only loaded from the
+     * disk when accessed.
+     */
+    class DetectionStreamReader {
+        public:
+            DetectionStreamReader() = default;
+
+            ~DetectionStreamReader();
+
+            DetectionStreamReader(const DetectionStreamReader&) = delete;
+            DetectionStreamReader& operator=(const DetectionStreamReader&) = delete;
+
+            /** Map a detection stream into memory. Frames appended afterwards
+             * are not visible until the stream is opened again. A trailing
+             * incomplete frame is ignored. Return false if the stream can't be
+             * mapped or a mask entry lies outside its record or doesn't match
+             * its dimensions.
+             */
+            bool open(const std::string& filename);
+
+            /** Return the number of frames in the stream.
+             */
+            size_t size() const;
+
+            /** Return the frame at index, which must be smaller than size().
+             */
+            DetectionFrameView frame(size_t index) const;
+
+            /** Unmap the stream.
+             */
+            void close();
+
+        private:
+            const uint8_t* data_ = nullptr;
+            size_t data_size_ = 0;
+            std::vector<uint64_t> offsets_;
+    };
+} // namespace mr
+
+#endif // __DETECTION_STREAM_HPP
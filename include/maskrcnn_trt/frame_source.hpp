@@ -0,0 +1,128 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __FRAME_SOURCE_HPP
+#define __FRAME_SOURCE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+namespace mr {
+    /** A sequential source of frames of type CV_8UC3.
+     */
+    class FrameSource {
+        public:
+            virtual ~FrameSource() = default;
+
+            /** Read the next frame into frame. Each frame is newly allocated
+             * so previous frames may still be in use. Return false at the end
+             * of the stream or on error.
+             */
+            virtual bool read(cv::Mat& frame) = 0;
+
+            /** Return whether read() returned false because of an error
+             * rather than the end of the stream.
+             */
+            virtual bool failed() const
+            {
+                return false;
+            }
+
+            /** Return whether the frames are in BGR rather than RGB order.
+             */
+            virtual bool bgrOrder() const
+            {
+                return true;
+            }
+    };
+
+
+
+    /** Read raw frames of a fixed size from a file descriptor, e.g. standard
+     * input with frames piped from ffmpeg or GStreamer. Frames are read
+     * directly into the image without any decoding.
+     */
+    class RawFrameSource : public FrameSource {
+        public:
+            enum class PixelFormat {
+                bgr24,
+                rgb24,
+            };
+
+            /** The file descriptor must remain open while the source is in
+             * use and isn't closed by the source.
+             */
+            RawFrameSource(int fd, cv::Size size, PixelFormat format = PixelFormat::bgr24);
+
+            /** Return false on a partial frame at the end of the stream.
+             */
+            bool read(cv::Mat& frame) override;
+
+            /** Return whether reading from the file descriptor failed, e.g.
+             * with EIO. A partial frame at the end of the stream isn't a
+             * failure.
+             */
+            bool failed() const override;
+
+            bool bgrOrder() const override;
+
+        private:
+            int fd_;
+            cv::Size size_;
+            PixelFormat format_;
+            bool failed_ = false;
+    };
+
+    /** Parse a raw frame specification of the form WIDTHxHEIGHT or
+     * WIDTHxHEIGHT:FORMAT where FORMAT is bgr24 (the default) or rgb24.
+     * Return false if spec is invalid.
+     */
+    bool parse_raw_frame_spec(const std::string&           spec,
+                              cv::Size&                    size,
+                              RawFrameSource::PixelFormat& format);
+
+
+
+    /** Decode a video file with cv::VideoCapture on a dedicated thread, at
+     * most max_ahead frames ahead of read(). No frames are dropped.
+     */
+    class VideoFrameSource : public FrameSource {
+        public:
+            explicit VideoFrameSource(const std::string& filename, size_t max_ahead = 8);
+
+            /** Stop decoding and join the decoding thread.
+             */
+            ~VideoFrameSource();
+
+            VideoFrameSource(const VideoFrameSource&) = delete;
+            VideoFrameSource& operator=(const VideoFrameSource&) = delete;
+
+            /** Return whether the video was opened successfully.
+             */
+            bool isOpened() const;
+
+            bool read(cv::Mat& frame) override;
+
+        private:
+            cv::VideoCapture capture_;
+            size_t max_ahead_;
+            std::deque<cv::Mat> frames_;
+            bool done_ = false;
+            bool stop_ = false;
+            std::mutex mutex_;
+            std::condition_variable decoder_cv_;
+            std::condition_variable reader_cv_;
+            std::thread thread_;
+
+            void decode();
+    };
+} // namespace mr
+
+#endif // __FRAME_SOURCE_HPP
@@ -0,0 +1,58 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __HOST_ALLOCATION_HPP
+#define __HOST_ALLOCATION_HPP
+
+#include <cstddef>
+
+namespace mr {
+    /** How the host buffers of the network bindings are allocated.
+     */
+    enum class HostAllocation {
+        /** Plain malloc().
+         */
+        pageable,
+        /** Aligned to 64 bytes, the cache line size.
+         */
+        aligned,
+        /** Aligned to 2 MiB and backed by transparent huge pages if the
+         * kernel allows it, reducing TLB misses when traversing the buffers.
+         */
+        huge_pages,
+        /** Page-locked memory allocated by CUDA, allowing faster and
+         * asynchronous copies to and from the device. Falls back to aligned if
+         * no CUDA device is present.
+         */
+        pinned,
+    };
+
+    /** Return the name of a host allocation policy.
+     */
+    const char* host_allocation_name(HostAllocation allocation);
+
+    /** Return the policy that will actually be used for allocation, that is
+     * HostAllocation::aligned instead of HostAllocation::pinned if no CUDA
+     * device is present.
+     */
+    HostAllocation resolve_host_allocation(HostAllocation allocation);
+
+    /** Return the number of bytes actually allocated by allocate_host() for
+     * a request of bytes with a resolved policy, e.g. rounded up to a whole
+     * number of huge pages for HostAllocation::huge_pages.
+     */
+    size_t host_allocation_size(size_t bytes, HostAllocation allocation);
+
+    /** Allocate bytes of host memory with a resolved policy, see
+     * resolve_host_allocation(). Return nullptr on failure.
+     */
+    void* allocate_host(size_t bytes, HostAllocation allocation);
+
+    /** Free memory returned by allocate_host() with the same policy. ptr may
+     * be nullptr.
+     */
+    void free_host(void* ptr, HostAllocation allocation);
+} // namespace mr
+
+#endif // __HOST_ALLOCATION_HPP
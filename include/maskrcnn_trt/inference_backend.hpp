@@ -0,0 +1,92 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __INFERENCE_BACKEND_HPP
+#define __INFERENCE_BACKEND_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "memory_report.hpp"
+
+namespace mr {
+    /** The interface between MaskRCNN and the engine running the network.
+     * Tensors are identified by their binding names, see
+     * MaskRCNNConfig::model_input and MaskRCNNConfig::model_outputs. All
+     * buffers have space for maxBatchSize() items and contain 32-bit floats.
+     */
+    class InferenceBackend {
+        public:
+            virtual ~InferenceBackend() = default;
+
+            /** Return the maximum number of items in a batch.
+             */
+            virtual int maxBatchSize() const = 0;
+
+            /** Return the number of input and output bindings.
+             */
+            virtual int numBindings() const = 0;
+
+            /** Return the name of the tensor bound at index.
+             */
+            virtual std::string bindingName(int index) const = 0;
+
+            /** Return whether the tensor bound at index is an input.
+             */
+            virtual bool bindingIsInput(int index) const = 0;
+
+            /** Return the shape of a single batch item of the tensor bound at
+             * index.
+             */
+            virtual std::vector<int> bindingShape(int index) const = 0;
+
+            /** Return the host buffer of a tensor or nullptr if there is no
+             * such tensor.
+             */
+            virtual void* hostBuffer(const std::string& tensor_name) const = 0;
+
+            /** Return the device buffer of a tensor or nullptr if there is no
+             * such tensor or the backend has no device buffers.
+             */
+            virtual void* deviceBuffer(const std::string& tensor_name) const = 0;
+
+            /** Copy the first batch_size items of the input host buffers to
+             * the device synchronously.
+             */
+            virtual bool copyInputToDevice(int batch_size) = 0;
+
+            /** Run the network on the first batch_size items of the input
+             * device buffers synchronously.
+             */
+            virtual bool execute(int batch_size) = 0;
+
+            /** Copy the first batch_size items of the output device buffers to
+             * the host synchronously.
+             */
+            virtual bool copyOutputToHost(int batch_size) = 0;
+
+            /** Queue the input copy, network execution and output copy of
+             * batch_size items without waiting for them to finish. Call
+             * synchronize() before reading the output host buffers.
+             */
+            virtual bool enqueue(int batch_size) = 0;
+
+            /** Wait for the work queued by enqueue() to finish.
+             */
+            virtual bool synchronize() = 0;
+
+            /** Return the memory held by the buffers of each binding.
+             */
+            virtual std::vector<BindingMemory> memoryUsage() const = 0;
+
+            /** Create a backend for the same network with its own buffers and
+             * execution state, sharing any read-only data such as the engine.
+             * Return nullptr on failure.
+             */
+            virtual std::unique_ptr<InferenceBackend> clone() const = 0;
+    };
+} // namespace mr
+
+#endif // __INFERENCE_BACKEND_HPP
@@ -6,14 +6,87 @@
 
 #include "logging.hpp"
 
+//!
+//! \class LogStream
+//! \brief A global log stream which can be used concurrently from several threads.
+//!  Each thread writes to its own LogStreamConsumer. The severity is compared with the one reported by gLogger before
+//!  the first operand of each statement, so the operands of filtered-out statements are not formatted.
+//!
+class LogStream
+{
+public:
+    explicit LogStream(Severity severity)
+        : mSeverity(severity)
+    {
+    }
+
+    template <typename T>
+    std::ostream& operator<<(const T& value) const
+    {
+        return stream() << value;
+    }
+
+    std::ostream& operator<<(std::ostream& (*manipulator)(std::ostream&)) const
+    {
+        return stream() << manipulator;
+    }
+
+private:
+    //! \brief Returns the LogStreamConsumer of the calling thread for this severity.
+    LogStreamConsumer& stream() const;
+
+    Severity mSeverity;
+};
+
 extern Logger gLogger;
-extern LogStreamConsumer gLogVerbose;
-extern LogStreamConsumer gLogInfo;
-extern LogStreamConsumer gLogWarning;
-extern LogStreamConsumer gLogError;
-extern LogStreamConsumer gLogFatal;
+extern LogStream gLogVerbose;
+extern LogStream gLogInfo;
+extern LogStream gLogWarning;
+extern LogStream gLogError;
+extern LogStream gLogFatal;
 
 void setReportableSeverity(Logger::Severity severity);
 
+//!
+//! \brief Returns whether messages of the given severity are reported at runtime.
+//!
+inline bool isReportable(Severity severity)
+{
+    return severity <= gLogger.getReportableSeverity();
+}
+
+//!
+//! \brief The least severe level whose messages are compiled in, as an int (0 for kINTERNAL_ERROR to 4 for kVERBOSE).
+//!  Release builds keep warnings and errors by default, debug builds keep everything.
+//!
+#ifndef MR_LOG_COMPILED_SEVERITY
+#ifdef NDEBUG
+#define MR_LOG_COMPILED_SEVERITY 2
+#else
+#define MR_LOG_COMPILED_SEVERITY 4
+#endif
+#endif
+
+//!
+//! \brief Logs to stream only if severity is compiled in and reportable at runtime. Used as
+//!
+//!     MR_LOG_INFO << "hello " << expensive() << std::endl;
+//!
+//!  the operands aren't evaluated unless the message is logged. Statements below MR_LOG_COMPILED_SEVERITY are
+//!  removed by the compiler, the rest cost a single branch when filtered out at runtime.
+//!
+#define MR_LOG_IF_REPORTABLE(severity, stream)                                                                        \
+    if (static_cast<int>(severity) > MR_LOG_COMPILED_SEVERITY || !isReportable(severity))                           \
+    {                                                                                                                  \
+    }                                                                                                                  \
+    else                                                                                                               \
+        stream
+
+#define MR_LOG_VERBOSE MR_LOG_IF_REPORTABLE(Severity::kVERBOSE, gLogVerbose)
+#define MR_LOG_INFO MR_LOG_IF_REPORTABLE(Severity::kINFO, gLogInfo)
+#define MR_LOG_WARNING MR_LOG_IF_REPORTABLE(Severity::kWARNING, gLogWarning)
+#define MR_LOG_ERROR MR_LOG_IF_REPORTABLE(Severity::kERROR, gLogError)
+#define MR_LOG_FATAL MR_LOG_IF_REPORTABLE(Severity::kINTERNAL_ERROR, gLogFatal)
+
 #endif // LOGGER_H
 
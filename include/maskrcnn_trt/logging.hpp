@@ -4,30 +4,36 @@
 #ifndef TENSORRT_LOGGING_H
 #define TENSORRT_LOGGING_H
 
+#include <atomic>
 #include <cassert>
-#include <ctime>
-#include <iomanip>
 #include <iostream>
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 #include <NvInferRuntimeCommon.h>
 
+#include "async_logger.hpp"
+
 using Severity = nvinfer1::ILogger::Severity;
 
+//!
+//! \class LogStreamConsumerBuffer
+//! \brief Stream buffer which queues each complete message in the AsyncLogWriter instead of writing it directly.
+//!
 class LogStreamConsumerBuffer : public std::stringbuf
 {
 public:
-    LogStreamConsumerBuffer(std::ostream& stream, const std::string& prefix, bool shouldLog)
-        : mOutput(stream)
-        , mPrefix(prefix)
+    LogStreamConsumerBuffer(Severity severity, bool shouldLog)
+        : mSeverity(severity)
         , mShouldLog(shouldLog)
     {
     }
 
     LogStreamConsumerBuffer(LogStreamConsumerBuffer&& other)
-        : mOutput(other.mOutput)
+        : mSeverity(other.mSeverity)
+        , mShouldLog(other.mShouldLog)
     {
     }
 
@@ -44,8 +50,8 @@ public:
     }
 
     // synchronizes the stream buffer and returns 0 on success
-    // synchronizing the stream buffer consists of inserting the buffer contents into the stream,
-    // resetting the buffer and flushing the stream
+    // synchronizing the stream buffer consists of queueing the buffer contents in the AsyncLogWriter and
+    // resetting the buffer
     virtual int sync()
     {
         putOutput();
@@ -54,26 +60,14 @@ public:
 
     void putOutput()
     {
-        if (mShouldLog)
+        if (mShouldLog && pbase() != pptr())
         {
-            // prepend timestamp
-            std::time_t timestamp = std::time(nullptr);
-            tm* tm_local = std::localtime(&timestamp);
-            std::cout << "[";
-            std::cout << std::setw(2) << std::setfill('0') << 1 + tm_local->tm_mon << "/";
-            std::cout << std::setw(2) << std::setfill('0') << tm_local->tm_mday << "/";
-            std::cout << std::setw(4) << std::setfill('0') << 1900 + tm_local->tm_year << "-";
-            std::cout << std::setw(2) << std::setfill('0') << tm_local->tm_hour << ":";
-            std::cout << std::setw(2) << std::setfill('0') << tm_local->tm_min << ":";
-            std::cout << std::setw(2) << std::setfill('0') << tm_local->tm_sec << "] ";
-            // std::stringbuf::str() gets the string contents of the buffer
-            // insert the buffer contents pre-appended by the appropriate prefix into the stream
-            mOutput << mPrefix << str();
-            // set the buffer to empty
-            str("");
-            // flush the stream
-            mOutput.flush();
+            // The AsyncLogWriter prepends the timestamp and severity and copies the message, so the buffer can be
+            // reused immediately.
+            mr::AsyncLogWriter::instance().write(mSeverity, "", std::string_view(pbase(), pptr() - pbase()));
         }
+        // set the buffer to empty
+        str("");
     }
 
     void setShouldLog(bool shouldLog)
@@ -82,8 +76,7 @@ public:
     }
 
 private:
-    std::ostream& mOutput;
-    std::string mPrefix;
+    Severity mSeverity;
     bool mShouldLog;
 };
 
@@ -94,8 +87,8 @@ private:
 class LogStreamConsumerBase
 {
 public:
-    LogStreamConsumerBase(std::ostream& stream, const std::string& prefix, bool shouldLog)
-        : mBuffer(stream, prefix, shouldLog)
+    LogStreamConsumerBase(Severity severity, bool shouldLog)
+        : mBuffer(severity, shouldLog)
     {
     }
 
@@ -118,46 +111,33 @@ public:
     //! \brief Creates a LogStreamConsumer which logs messages with level severity.
     //!  Reportable severity determines if the messages are severe enough to be logged.
     LogStreamConsumer(Severity reportableSeverity, Severity severity)
-        : LogStreamConsumerBase(severityOstream(severity), severityPrefix(severity), severity <= reportableSeverity)
+        : LogStreamConsumerBase(severity, severity <= reportableSeverity)
         , std::ostream(&mBuffer) // links the stream buffer with the stream
         , mShouldLog(severity <= reportableSeverity)
         , mSeverity(severity)
     {
+        clear(mShouldLog ? std::ios_base::goodbit : std::ios_base::badbit);
     }
 
     LogStreamConsumer(LogStreamConsumer&& other)
-        : LogStreamConsumerBase(severityOstream(other.mSeverity), severityPrefix(other.mSeverity), other.mShouldLog)
+        : LogStreamConsumerBase(other.mSeverity, other.mShouldLog)
         , std::ostream(&mBuffer) // links the stream buffer with the stream
         , mShouldLog(other.mShouldLog)
         , mSeverity(other.mSeverity)
     {
+        clear(mShouldLog ? std::ios_base::goodbit : std::ios_base::badbit);
     }
 
+    //! \brief Sets whether messages will be logged. While they won't, the stream is put in a bad state so that
+    //!  operator<< returns immediately without formatting its operand.
     void setReportableSeverity(Severity reportableSeverity)
     {
         mShouldLog = mSeverity <= reportableSeverity;
         mBuffer.setShouldLog(mShouldLog);
+        clear(mShouldLog ? std::ios_base::goodbit : std::ios_base::badbit);
     }
 
 private:
-    static std::ostream& severityOstream(Severity severity)
-    {
-        return severity >= Severity::kINFO ? std::cout : std::cerr;
-    }
-
-    static std::string severityPrefix(Severity severity)
-    {
-        switch (severity)
-        {
-        case Severity::kINTERNAL_ERROR: return "[F] ";
-        case Severity::kERROR: return "[E] ";
-        case Severity::kWARNING: return "[W] ";
-        case Severity::kINFO: return "[I] ";
-        case Severity::kVERBOSE: return "[V] ";
-        default: assert(0); return "";
-        }
-    }
-
     bool mShouldLog;
     Severity mSeverity;
 };
@@ -226,7 +206,10 @@ public:
     //!
     void log(Severity severity, const char* msg) noexcept override
     {
-        LogStreamConsumer(mReportableSeverity, severity) << "[TRT] " << std::string(msg) << std::endl;
+        if (severity <= getReportableSeverity())
+        {
+            mr::AsyncLogWriter::instance().write(severity, "[TRT] ", msg);
+        }
     }
 
     //!
@@ -236,7 +219,7 @@ public:
     //!
     void setReportableSeverity(Severity severity)
     {
-        mReportableSeverity = severity;
+        mReportableSeverity.store(severity, std::memory_order_relaxed);
     }
 
     //!
@@ -352,7 +335,7 @@ public:
 
     Severity getReportableSeverity() const
     {
-        return mReportableSeverity;
+        return mReportableSeverity.load(std::memory_order_relaxed);
     }
 
 private:
@@ -419,7 +402,7 @@ private:
         return ss.str();
     }
 
-    Severity mReportableSeverity;
+    std::atomic<Severity> mReportableSeverity;
 };
 
 namespace
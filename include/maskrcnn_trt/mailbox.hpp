@@ -0,0 +1,131 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __MAILBOX_HPP
+#define __MAILBOX_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace mr {
+    /** A single-slot mailbox passing values from one producer thread to one
+     * consumer thread. Posting a value replaces any value not yet taken, so
+     * the consumer always gets the latest one. Posting and taking are
+     * lock-free, implemented as a triple buffer: the producer and consumer
+     * each own a buffer and swap it atomically with the shared middle buffer.
+     * Only a consumer blocked in waitTake() is woken up through a mutex.
+     */
+    template <typename T>
+    class Mailbox {
+        public:
+            Mailbox() = default;
+
+            Mailbox(const Mailbox&) = delete;
+            Mailbox& operator=(const Mailbox&) = delete;
+
+            /** Post a value, replacing the previous one if it hasn't been
+             * taken yet. Must only be called from the producer thread.
+             */
+            void post(T value)
+            {
+                buffers_[back_] = std::move(value);
+                const uint8_t previous = middle_.exchange(back_ | fresh_bit);
+                back_ = previous & index_mask;
+                if (previous & fresh_bit) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                }
+                // Both the exchange and the waiter flag use sequentially
+                // consistent operations so either a waiter sees the posted
+                // value or the waiter is seen here.
+                if (waiting_.load()) {
+                    std::lock_guard<std::mutex> lock (mutex_);
+                    cv_.notify_one();
+                }
+            }
+
+            /** Move the latest value into value without blocking. Return false
+             * if no value was posted since the last one taken. Must only be
+             * called from the consumer thread.
+             */
+            bool tryTake(T& value)
+            {
+                if (!(middle_.load() & fresh_bit)) {
+                    return false;
+                }
+                front_ = middle_.exchange(front_) & index_mask;
+                value = std::move(buffers_[front_]);
+                return true;
+            }
+
+            /** Move the latest value into value, waiting up to timeout for
+             * one to be posted. Return false on timeout or if the mailbox was
+             * closed. Must only be called from the consumer thread.
+             */
+            template <typename Rep, typename Period>
+            bool waitTake(T& value, std::chrono::duration<Rep, Period> timeout)
+            {
+                if (tryTake(value)) {
+                    return true;
+                }
+                std::unique_lock<std::mutex> lock (mutex_);
+                waiting_.store(true);
+                cv_.wait_for(lock, timeout, [this] {
+                        return (middle_.load() & fresh_bit) || closed_.load();
+                    });
+                waiting_.store(false);
+                lock.unlock();
+                return tryTake(value);
+            }
+
+            /** Wake up the consumer and make future calls of waitTake() return
+             * without waiting if no value is available. May be called from
+             * any thread.
+             */
+            void close()
+            {
+                closed_.store(true);
+                std::lock_guard<std::mutex> lock (mutex_);
+                cv_.notify_all();
+            }
+
+            bool closed() const
+            {
+                return closed_.load();
+            }
+
+            /** Return the number of values replaced before being taken.
+             */
+            uint64_t dropped() const
+            {
+                return dropped_.load(std::memory_order_relaxed);
+            }
+
+        private:
+            static constexpr uint8_t index_mask = 0x3;
+            static constexpr uint8_t fresh_bit = 0x4;
+
+            std::array<T, 3> buffers_;
+            /** The buffer written by the producer.
+             */
+            uint8_t back_ = 0;
+            /** The index of the shared buffer and whether it contains a value
+             * that hasn't been taken.
+             */
+            std::atomic<uint8_t> middle_ {1};
+            /** The buffer read by the consumer.
+             */
+            uint8_t front_ = 2;
+            std::atomic<uint64_t> dropped_ {0};
+            std::atomic<bool> closed_ {false};
+            std::atomic<bool> waiting_ {false};
+            std::mutex mutex_;
+            std::condition_variable cv_;
+    };
+} // namespace mr
+
+#endif // __MAILBOX_HPP
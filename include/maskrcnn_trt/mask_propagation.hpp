@@ -0,0 +1,112 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __MASK_PROPAGATION_HPP
+#define __MASK_PROPAGATION_HPP
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "detection.hpp"
+
+namespace mr {
+    /** The configuration of MaskPropagator.
+     */
+    struct MaskPropagationConfig {
+        /** The maximum number of features tracked inside each mask.
+         */
+        int max_points = 64;
+        /** The goodFeaturesToTrack() quality level and minimum distance in
+         * pixels of the features.
+         */
+        double quality_level = 0.01;
+        double min_distance = 4.0;
+        /** The Lucas-Kanade window size in pixels and the number of pyramid
+         * levels above the original image.
+         */
+        int window_size = 15;
+        int pyramid_levels = 2;
+        /** Features whose position after tracking forward and back differs
+         * from the original by more than this many pixels are rejected.
+         */
+        float max_forward_backward_error = 1.0f;
+        /** The minimum fraction of the features of each detection's keyframe
+         * that must still be tracked reliably.
+         */
+        float min_confidence = 0.5f;
+        /** Masks are warped by the feature displacements interpolated on a
+         * grid of grid_size x grid_size cells over their bounding box.
+         */
+        int grid_size = 4;
+    };
+
+
+
+    /** Propagate detection masks from a keyframe to the following frames
+     * with sparse Lucas-Kanade optical flow. Features are only detected and
+     * tracked inside the mask of each detection. The feature displacements
+     * are interpolated on a coarse grid over the bounding box and the mask is
+     * warped by the interpolated flow, so parts of articulated objects can
+     * move independently. Detections with too few features to track are
+     * carried forward unchanged.
+     *
+     * MaskPropagator isn't thread-safe.
+     */
+    class MaskPropagator {
+        public:
+            explicit MaskPropagator(const MaskPropagationConfig& config = MaskPropagationConfig());
+
+            /** Start propagating detections from gray_image, a keyframe of
+             * type CV_8UC1.
+             */
+            void setKeyframe(const cv::Mat& gray_image, const std::vector<Detection>& detections);
+
+            /** Propagate the detections to gray_image, the next frame after
+             * the last call of setKeyframe() or propagate(), and write them to
+             * detections. Return false without changing any state if the
+             * confidence of any detection dropped below
+             * MaskPropagationConfig::min_confidence, in which case a new
+             * keyframe is needed.
+             */
+            bool propagate(const cv::Mat& gray_image, std::vector<Detection>& detections);
+
+            /** Return the lowest confidence of any detection in the last call
+             * of propagate(), the fraction of its keyframe features still
+             * tracked reliably.
+             */
+            float lastConfidence() const;
+
+        private:
+            struct Object {
+                /** Always has a box-local mask.
+                 */
+                Detection detection;
+                /** Whether a full-image mask should be returned.
+                 */
+                bool full_mask;
+                std::vector<cv::Point2f> points;
+                size_t keyframe_points;
+            };
+
+            MaskPropagationConfig config_;
+            cv::Mat previous_image_;
+            std::vector<Object> objects_;
+            float last_confidence_ = 1.0f;
+
+            /** Warp the mask of object by the displacements of its reliably
+             * tracked points and move its bounding box accordingly.
+             */
+            void warpObject(Object&                         object,
+                            const std::vector<cv::Point2f>& from,
+                            const std::vector<cv::Point2f>& to) const;
+
+            /** Return the detection of object in the representation it was
+             * given in.
+             */
+            Detection outputDetection(const Object& object) const;
+    };
+} // namespace mr
+
+#endif // __MASK_PROPAGATION_HPP
@@ -5,11 +5,18 @@
 #ifndef __MASKRCNN_HPP
 #define __MASKRCNN_HPP
 
+#include <atomic>
+
 #include <NvUffParser.h>
 
 #include "buffers.hpp"
+#include "capture.hpp"
 #include "detection.hpp"
+#include "inference_backend.hpp"
 #include "maskrcnn_config.hpp"
+#include "memory_report.hpp"
+#include "metrics.hpp"
+#include "stats.hpp"
 
 namespace mr {
     class MaskRCNN {
@@ -20,8 +27,17 @@ namespace mr {
              */
             MaskRCNN(const MaskRCNNConfig& config);
 
-            /** Create a network instance based on the config. Return true on
-             * success.
+            /** Initialize a network instance that runs inference using
+             * backend instead of a TensorRT engine created from the config,
+             * e.g. a ReplayBackend on machines without a GPU.
+             * MaskRCNN::build() must still be called after the constructor.
+             */
+            MaskRCNN(const MaskRCNNConfig&             config,
+                     std::unique_ptr<InferenceBackend> backend);
+
+            /** Create a network instance based on the config. If a backend
+             * was supplied to the constructor only ensure that its bindings
+             * match the network. Return true on success.
              */
             bool build();
 
@@ -30,20 +46,109 @@ namespace mr {
              * to be in BGR order by default (the default in OpenCV) and are
              * converted to RGB internally before being passed to the network.
              * Set in_bgr_order to false to skip this conversion if rgb_image is
-             * already in RGB order.
+             * already in RGB order. If original_size isn't empty the
+             * detections are computed for an image of that size instead, e.g.
+             * when rgb_image was decoded at a reduced resolution by
+             * read_image(). original_size should have about the same aspect
+             * ratio as rgb_image.
              */
             std::vector<Detection> infer(const cv::Mat& rgb_image,
-                                         bool           in_bgr_order = true);
+                                         bool           in_bgr_order = true,
+                                         cv::Size       original_size = cv::Size());
+
+            /** Run inference on a batch of RGB images in a single network
+             * execution and return the resulting detections of each image.
+             * Element i of the returned vector contains the detections of
+             * rgb_images[i]. At most MaskRCNNConfig::max_batch_size images may
+             * be supplied and they may have different dimensions. The image
+             * requirements and the in_bgr_order parameter are the same as in
+             * MaskRCNN::infer(const cv::Mat&, bool, cv::Size). Element i of
+             * original_sizes, if present and not empty, is the original size
+             * of rgb_images[i]. An empty vector is returned on error.
+             */
+            std::vector<std::vector<Detection>> infer(
+                    const std::vector<cv::Mat>&  rgb_images,
+                    bool                         in_bgr_order = true,
+                    const std::vector<cv::Size>& original_sizes = {});
+
+            /** Return the configuration the network was initialized with.
+             */
+            const MaskRCNNConfig& config() const;
+
+            /** Create a new network instance that shares the engine of this
+             * one but has its own execution context and buffers, see
+             * InferenceBackend::clone(). The two instances can then run
+             * inference concurrently from different threads without
+             * duplicating the engine in memory. The network must have been
+             * built. Return nullptr on failure.
+             */
+            std::unique_ptr<MaskRCNN> clone() const;
+
+            /** Capture the raw network outputs of the next frame to
+             * MaskRCNNConfig::capture_filename. Has no effect if capturing is
+             * disabled. Can be called from any thread.
+             */
+            void triggerCapture();
+
+            /** Return the latency statistics of each stage of infer() since
+             * the network was built or resetStats() was called. Statistics are
+             * shared with instances created by clone(). All statistics are
+             * zero if the library was compiled without MR_ENABLE_STATS.
+             */
+            InferenceStats stats() const;
+
+            /** Return the counters, gauges and latency statistics of infer()
+             * since the network was built or resetStats() was called. Metrics
+             * are shared with instances created by clone(). See
+             * MetricsExporter to export them periodically.
+             */
+            InferenceMetrics metrics() const;
+
+            /** Return the memory held by the inference buffers and the peak
+             * memory used by temporaries and detection masks since the network
+             * was built or resetStats() was called.
+             */
+            MemoryReport memoryReport() const;
+
+            /** Clear the latency statistics and metrics.
+             */
+            void resetStats();
 
         private:
+            friend class MaskRCNNPipelineBackend;
+
             template <typename T>
             using NVUniquePtr = std::unique_ptr<T, samplesCommon::InferDeleter>;
 
             MaskRCNNConfig config_;
-            nvinfer1::Dims input_dims_;
             std::shared_ptr<nvinfer1::ICudaEngine> engine_;
-            NVUniquePtr<nvinfer1::IExecutionContext> context_;
-            std::unique_ptr<samplesCommon::BufferManager> buffer_manager_;
+            std::unique_ptr<InferenceBackend> backend_;
+            bool built_ = false;
+            // Shared with clones so that all write to the same capture.
+            std::shared_ptr<CaptureWriter> capture_writer_;
+            std::atomic<bool> capture_triggered_ {false};
+            std::shared_ptr<StageStats> stats_ = std::make_shared<StageStats>();
+            std::shared_ptr<InferenceCounters> counters_ = std::make_shared<InferenceCounters>();
+            // The ID of the next frame, shared with clones so that frame IDs
+            // are unique across all instances writing to the same capture.
+            std::shared_ptr<std::atomic<uint64_t>> next_frame_id_
+                = std::make_shared<std::atomic<uint64_t>>(0);
+            // The ID of the first frame of the current batch.
+            uint64_t frame_id_ = 0;
+
+            /** Build the network or validate the user-supplied backend.
+             */
+            bool buildBackend();
+
+            /** Open MaskRCNNConfig::capture_filename if capturing is enabled.
+             * Return true on success.
+             */
+            bool openCapture();
+
+            /** Ensure the backend bindings have the names and shapes expected
+             * by the pre- and postprocessing.
+             */
+            bool validateBindings() const;
 
             /** Create the network from a UFF model or by deserializing it.
              */
@@ -52,18 +157,24 @@ namespace mr {
                                   nvinfer1::INetworkDefinition& network,
                                   nvuffparser::IUffParser&      parser);
 
-            /** Resize, pad and copy the input image into the host input buffer.
+            /** Resize, pad and copy the input image into the slice of the host
+             * input buffer corresponding to batch_index.
+             */
+            void preprocessInput(const cv::Mat& rgb_image,
+                                 int            batch_index,
+                                 bool           in_bgr_order = true);
+
+            /** Append the raw outputs of the images in the batch that are due
+             * for capturing to the capture.
              */
-            void preprocessInput(const samplesCommon::BufferManager& buffer_manager,
-                                 const cv::Mat&                      rgb_image,
-                                 bool                                in_bgr_order = true);
+            void captureOutput(const std::vector<cv::Size>& input_sizes);
 
-            /** TODO
+            /** Get the detections of each image in the batch from the host
+             * output buffers. Element i of input_sizes should be the size of
+             * image i of the batch before preprocessing.
              */
-            std::vector<Detection> postprocessOutput(
-                    const samplesCommon::BufferManager& buffer_manager,
-                    int                                 input_width,
-                    int                                 input_height);
+            std::vector<std::vector<Detection>> postprocessOutput(
+                    const std::vector<cv::Size>& input_sizes);
     };
 } // namespace mr
 
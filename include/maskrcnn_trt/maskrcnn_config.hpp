@@ -6,8 +6,12 @@
 #ifndef __MASKRCNN_CONFIG_HPP
 #define __MASKRCNN_CONFIG_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
+#include "host_allocation.hpp"
+
 namespace mr {
     /** Constant and runtime parameters of Mask RCNN. Used to initialize an
      * instance of MaskRCNN.
@@ -26,13 +30,34 @@ namespace mr {
         /** Use up to 1 GiB of VRAM for the workspace by default.
          */
         size_t max_workspace_size = (1ULL << 30);
+        /** The maximum number of images that can be passed to a single call of
+         * MaskRCNN::infer(). The engine is built for this batch size so a
+         * serialized model created with a smaller one will be rejected.
+         */
+        int max_batch_size = 1;
+        /** The filename of a capture to append the raw network outputs of
+         * some frames to, see CaptureWriter. Capturing is disabled if empty.
+         */
+        std::string capture_filename;
+        /** Capture every capture_interval-th frame. If 0 only frames requested
+         * with MaskRCNN::triggerCapture() are captured.
+         */
+        int capture_interval = 0;
+        /** The maximum number of bytes of the Detection masks of a single
+         * image. If full-image masks would exceed it, box-local masks are
+         * returned instead, and if those would too the masks of the least
+         * confident detections are left empty. 0 means no limit.
+         */
+        size_t max_mask_bytes = 0;
+        /** How the host buffers of the network inputs and outputs are
+         * allocated. HostAllocation::pinned speeds up the copies to and from
+         * the device at the cost of page-locked memory.
+         */
+        HostAllocation host_allocation = HostAllocation::pageable;
 
 
 
         // Constant network parameters, do not change //////////////////////////
-        // Number of inputs in a batch.
-        static constexpr int batch_size = 1;
-
         // Pooled ROIs.
         static constexpr int pool_size = 7;
         static constexpr int mask_pool_size = 14;
@@ -105,6 +130,11 @@ namespace mr {
         static constexpr int model_detection_shape[2] = {MaskRCNNConfig::detection_max_instances, 6};
         // The shape of the detection masks.
         static constexpr int model_mask_shape[4] = {MaskRCNNConfig::detection_max_instances, MaskRCNNConfig::num_classes, 2 * mask_pool_size, 2 * mask_pool_size};
+        // The number of floats occupied by a single image of a batch in the
+        // input, detection and mask buffers respectively.
+        static constexpr size_t model_input_volume = model_input_shape[0] * model_input_shape[1] * model_input_shape[2];
+        static constexpr size_t model_detection_volume = model_detection_shape[0] * model_detection_shape[1];
+        static constexpr size_t model_mask_volume = model_mask_shape[0] * model_mask_shape[1] * model_mask_shape[2] * model_mask_shape[3];
 
         // COCO Class names
         static const std::string class_names[num_classes];
@@ -0,0 +1,115 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __MASKRCNN_PIPELINE_HPP
+#define __MASKRCNN_PIPELINE_HPP
+
+#include <chrono>
+
+#include "maskrcnn.hpp"
+#include "pipeline.hpp"
+
+namespace mr {
+    /** A pipeline backend where each slot is a network instance with its own
+     * InferenceBackend, i.e. its own execution context, buffers and CUDA
+     * stream when using TensorRT, all sharing one engine. Frame IDs, captures,
+     * statistics and metrics are shared with the original network as with
+     * MaskRCNN::clone(). The copies to and from the device are included in
+     * the execute stage of the statistics.
+     */
+    class MaskRCNNPipelineBackend : public PipelineBackend<cv::Mat, std::vector<Detection>> {
+        public:
+            /** Create num_slots instances by cloning network, which must
+             * have been built. Use isValid() to test for errors.
+             */
+            MaskRCNNPipelineBackend(const MaskRCNN& network,
+                                    int             num_slots,
+                                    bool            in_bgr_order = true);
+
+            /** Return whether all network instances were created
+             * successfully.
+             */
+            bool isValid() const;
+
+            size_t numSlots() const override;
+
+            void preprocess(size_t slot, const cv::Mat& rgb_image) override;
+
+            bool launch(size_t slot) override;
+
+            bool synchronize(size_t slot) override;
+
+            std::vector<Detection> postprocess(size_t slot) override;
+
+        private:
+            struct Slot {
+                std::unique_ptr<MaskRCNN> network;
+                cv::Size input_size;
+                // When the frame was submitted and launched, for the latency
+                // statistics.
+                std::chrono::steady_clock::time_point start;
+                std::chrono::steady_clock::time_point launch;
+            };
+
+            std::vector<Slot> slots_;
+            bool in_bgr_order_;
+    };
+
+
+
+    /** Run inference on a stream of images, overlapping the preprocessing of
+     * the next image and the postprocessing of the previous image with the GPU
+     * work of the current one.
+     */
+    class MaskRCNNPipeline {
+        public:
+            typedef Pipeline<cv::Mat, std::vector<Detection>>::Result Result;
+
+            /** Returned by submit() if the image couldn't be submitted.
+             */
+            static constexpr uint64_t invalid_frame_id = UINT64_MAX;
+
+            /** Initialize a pipeline of the given depth (2 for double and 3
+             * for triple buffering) sharing the engine of network. In order to
+             * create the execution contexts call MaskRCNNPipeline::build()
+             * after the constructor. The network must have been built and
+             * must outlive the pipeline.
+             */
+            MaskRCNNPipeline(const MaskRCNN& network,
+                             int             depth = 3,
+                             bool            in_bgr_order = true);
+
+            /** Create the network instances of the pipeline. Return true on
+             * success.
+             */
+            bool build();
+
+            /** Preprocess an image, start inference on it and return its frame
+             * ID. Blocks while depth images are in flight. The image is copied
+             * during the call so it may be modified afterwards. Images must be
+             * submitted from a single thread. Return invalid_frame_id if the
+             * pipeline hasn't been built.
+             */
+            uint64_t submit(const cv::Mat& rgb_image);
+
+            /** Move the oldest available result into result without blocking.
+             * Return false if no result is available.
+             */
+            bool poll(Result& result);
+
+            /** Move the oldest result into result, blocking until it is
+             * available. Return false if no images are in flight.
+             */
+            bool wait(Result& result);
+
+        private:
+            const MaskRCNN& network_;
+            int depth_;
+            bool in_bgr_order_;
+            std::unique_ptr<MaskRCNNPipelineBackend> backend_;
+            std::unique_ptr<Pipeline<cv::Mat, std::vector<Detection>>> pipeline_;
+    };
+} // namespace mr
+
+#endif // __MASKRCNN_PIPELINE_HPP
@@ -0,0 +1,69 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __MASKRCNN_POOL_HPP
+#define __MASKRCNN_POOL_HPP
+
+#include "maskrcnn.hpp"
+#include "resource_pool.hpp"
+
+namespace mr {
+    /** A thread-safe set of network instances sharing a single engine. Each
+     * instance has its own execution context and buffers so up to size()
+     * threads can run inference concurrently.
+     */
+    class MaskRCNNPool {
+        public:
+            /** Initialize a pool of num_contexts network instances based on
+             * the config. In order to load and build the network call
+             * MaskRCNNPool::build() after the constructor.
+             */
+            MaskRCNNPool(const MaskRCNNConfig& config, int num_contexts);
+
+            /** Initialize a pool of num_contexts network instances that run
+             * inference using backend and clones of it instead of a TensorRT
+             * engine, e.g. a ReplayBackend on machines without a GPU.
+             * MaskRCNNPool::build() must still be called after the
+             * constructor.
+             */
+            MaskRCNNPool(const MaskRCNNConfig&             config,
+                         int                               num_contexts,
+                         std::unique_ptr<InferenceBackend> backend);
+
+            /** Build the engine once and create all execution contexts from
+             * it. Return true on success.
+             */
+            bool build();
+
+            /** Run inference on an image using the first available execution
+             * context. Blocks only if all execution contexts are in use. See
+             * MaskRCNN::infer(const cv::Mat&, bool, cv::Size) for details.
+             */
+            std::vector<Detection> infer(const cv::Mat& rgb_image,
+                                         bool           in_bgr_order = true,
+                                         cv::Size       original_size = cv::Size());
+
+            /** Run inference on a batch of images using the first available
+             * execution context. See
+             * MaskRCNN::infer(const std::vector<cv::Mat>&, bool,
+             * const std::vector<cv::Size>&) for details.
+             */
+            std::vector<std::vector<Detection>> infer(
+                    const std::vector<cv::Mat>&  rgb_images,
+                    bool                         in_bgr_order = true,
+                    const std::vector<cv::Size>& original_sizes = {});
+
+            /** Return the number of execution contexts in the pool.
+             */
+            size_t size() const;
+
+        private:
+            MaskRCNNConfig config_;
+            int num_contexts_;
+            std::unique_ptr<InferenceBackend> backend_;
+            std::unique_ptr<ResourcePool<MaskRCNN>> pool_;
+    };
+} // namespace mr
+
+#endif // __MASKRCNN_POOL_HPP
@@ -0,0 +1,61 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __MEMORY_REPORT_HPP
+#define __MEMORY_REPORT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace mr {
+    /** The memory held by the buffers of a single network binding.
+     */
+    struct BindingMemory {
+        std::string name;
+        bool is_input = false;
+        size_t host_bytes = 0;
+        size_t device_bytes = 0;
+    };
+
+
+
+    /** The memory used by a MaskRCNN instance, see MaskRCNN::memoryReport().
+     */
+    struct MemoryReport {
+        /** The buffers of each network binding.
+         */
+        std::vector<BindingMemory> bindings;
+        /** The sum of the host bytes of all bindings.
+         */
+        size_t host_buffer_bytes = 0;
+        /** The sum of the device bytes of all bindings.
+         */
+        size_t device_buffer_bytes = 0;
+        /** An estimate of the peak bytes of the temporaries allocated by a
+         * single call of MaskRCNN::infer(), excluding the returned
+         * detections. It is computed from the sizes of the images and
+         * vectors the library allocates, not measured, and excludes the
+         * internal buffers of OpenCV functions such as cv::resize().
+         */
+        size_t peak_temporary_bytes_estimate = 0;
+        /** The peak bytes of the Detection masks returned by a single call of
+         * MaskRCNN::infer().
+         */
+        size_t peak_mask_bytes = 0;
+        /** The value of MaskRCNNConfig::max_mask_bytes, 0 if unlimited.
+         */
+        size_t mask_bytes_limit = 0;
+        /** The number of images whose masks were degraded to box-local masks
+         * or left empty because of mask_bytes_limit.
+         */
+        uint64_t degraded_frames = 0;
+    };
+
+    std::ostream& operator<<(std::ostream& os, const MemoryReport& r);
+} // namespace mr
+
+#endif // __MEMORY_REPORT_HPP
@@ -0,0 +1,130 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __METRICS_HPP
+#define __METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "stats.hpp"
+
+namespace mr {
+    /** A counter that can be incremented concurrently from many threads
+     * without contention. Each thread increments one of several shards, each
+     * on its own cache line, and value() sums all shards.
+     */
+    class ShardedCounter {
+        public:
+            void add(uint64_t n = 1)
+            {
+                shards_[shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+            }
+
+            uint64_t value() const;
+
+            void reset();
+
+        private:
+            static constexpr size_t num_shards = 16;
+
+            struct alignas(64) Shard {
+                std::atomic<uint64_t> value {0};
+            };
+
+            std::array<Shard, num_shards> shards_;
+
+            /** The shard of the calling thread, assigned round-robin the first
+             * time each thread increments any counter.
+             */
+            static size_t shardIndex();
+    };
+
+
+
+    /** A snapshot of the metrics of MaskRCNN::infer().
+     */
+    struct InferenceMetrics {
+        /** The number of images inference was run on.
+         */
+        uint64_t frames = 0;
+        /** The number of failed network executions.
+         */
+        uint64_t failed_executions = 0;
+        /** The total number of detections over all frames.
+         */
+        uint64_t detections = 0;
+        /** The number of detections in the last frame.
+         */
+        uint64_t last_frame_detections = 0;
+        /** The number of detection masks decoded.
+         */
+        uint64_t masks_decoded = 0;
+        /** The number of bytes copied from the host to the device.
+         */
+        uint64_t bytes_to_device = 0;
+        /** The number of bytes copied from the device to the host.
+         */
+        uint64_t bytes_to_host = 0;
+        /** An estimate of the peak bytes of the temporaries of a single
+         * call of infer(), see MemoryReport::peak_temporary_bytes_estimate.
+         */
+        uint64_t peak_temporary_bytes_estimate = 0;
+        /** The peak bytes of the masks returned by a single call of infer().
+         */
+        uint64_t peak_mask_bytes = 0;
+        /** The number of images whose masks were degraded because of
+         * MaskRCNNConfig::max_mask_bytes.
+         */
+        uint64_t degraded_frames = 0;
+        /** The stage latencies, all zero unless compiled with MR_ENABLE_STATS.
+         */
+        InferenceStats stats;
+    };
+
+    /** Format metrics in the Prometheus text exposition format. All metric
+     * names are prefixed with "maskrcnn_".
+     */
+    std::string to_prometheus(const InferenceMetrics& metrics);
+
+
+
+    /** The counters and gauges behind InferenceMetrics, updated by
+     * MaskRCNN::infer() and shared among its clones.
+     */
+    struct InferenceCounters {
+        ShardedCounter frames;
+        ShardedCounter failed_executions;
+        ShardedCounter detections;
+        std::atomic<uint64_t> last_frame_detections {0};
+        ShardedCounter masks_decoded;
+        ShardedCounter bytes_to_device;
+        ShardedCounter bytes_to_host;
+        std::atomic<uint64_t> peak_temporary_bytes_estimate {0};
+        std::atomic<uint64_t> peak_mask_bytes {0};
+        ShardedCounter degraded_frames;
+
+        /** Return the values of all counters and gauges. The stats member of
+         * the result is left empty.
+         */
+        InferenceMetrics snapshot() const;
+
+        void reset();
+
+        /** Set a peak gauge to value if it's greater.
+         */
+        static void updatePeak(std::atomic<uint64_t>& peak, uint64_t value)
+        {
+            uint64_t current = peak.load(std::memory_order_relaxed);
+            while (value > current
+                    && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+    };
+} // namespace mr
+
+#endif // __METRICS_HPP
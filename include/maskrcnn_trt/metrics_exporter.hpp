@@ -0,0 +1,107 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __METRICS_EXPORTER_HPP
+#define __METRICS_EXPORTER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "maskrcnn.hpp"
+#include "metrics.hpp"
+
+namespace mr {
+    /** A destination for metrics in the Prometheus text format.
+     */
+    class MetricsSink {
+        public:
+            virtual ~MetricsSink() = default;
+
+            /** Write the metrics text, return whether it was successful.
+             */
+            virtual bool write(const std::string& text) = 0;
+    };
+
+
+
+    /** Replace the contents of a file with the metrics, as expected by the
+     * textfile collector of the Prometheus node exporter. The metrics are
+     * written to a temporary file which is then renamed, so readers never see
+     * a partially written file.
+     */
+    class FileMetricsSink : public MetricsSink {
+        public:
+            FileMetricsSink(const std::string& filename);
+
+            bool write(const std::string& text) override;
+
+        private:
+            std::string filename_;
+    };
+
+
+
+    /** Send the metrics to a process listening on a local Unix stream socket.
+     * A new connection is made for each write.
+     */
+    class UnixSocketMetricsSink : public MetricsSink {
+        public:
+            UnixSocketMetricsSink(const std::string& socket_path);
+
+            bool write(const std::string& text) override;
+
+        private:
+            std::string socket_path_;
+    };
+
+
+
+    /** Periodically write metrics to a MetricsSink from a background thread.
+     */
+    class MetricsExporter {
+        public:
+            typedef std::function<InferenceMetrics()> MetricsSource;
+
+            /** Export the metrics of network and all of its clones.
+             */
+            MetricsExporter(const MaskRCNN&              network,
+                            std::unique_ptr<MetricsSink> sink,
+                            std::chrono::milliseconds    interval = std::chrono::seconds(15));
+
+            MetricsExporter(MetricsSource                source,
+                            std::unique_ptr<MetricsSink> sink,
+                            std::chrono::milliseconds    interval = std::chrono::seconds(15));
+
+            /** Write the metrics a final time and stop the exporter thread.
+             */
+            ~MetricsExporter();
+
+            MetricsExporter(const MetricsExporter&) = delete;
+            MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+            /** Write the metrics immediately, return whether it was
+             * successful.
+             */
+            bool exportNow();
+
+        private:
+            MetricsSource source_;
+            std::unique_ptr<MetricsSink> sink_;
+            std::mutex sink_mutex_;
+            const std::chrono::milliseconds interval_;
+            std::mutex mutex_;
+            std::condition_variable cv_;
+            bool stop_ = false;
+            std::thread thread_;
+
+            void run();
+    };
+} // namespace mr
+
+#endif // __METRICS_EXPORTER_HPP
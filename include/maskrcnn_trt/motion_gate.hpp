@@ -0,0 +1,127 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __MOTION_GATE_HPP
+#define __MOTION_GATE_HPP
+
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+namespace mr {
+    /** The configuration of MotionGate.
+     */
+    struct MotionGateConfig {
+        /** Frames are downscaled to this width, keeping their aspect ratio,
+         * before being compared.
+         */
+        int width = 64;
+        /** Frames whose mean absolute difference from the reference frame,
+         * per pixel and channel in the range [0-255], is below threshold are
+         * skipped.
+         */
+        float threshold = 2.0f;
+        /** Force a refresh after this many consecutive skipped frames. Never
+         * force a refresh if 0.
+         */
+        int max_skipped_frames = 30;
+    };
+
+    /** The statistics of MotionGate since it was created or reset.
+     */
+    struct MotionGateStats {
+        uint64_t frames = 0;
+        /** The frames that were skipped because they hardly changed.
+         */
+        uint64_t skipped = 0;
+        /** The frames that weren't skipped only because
+         * MotionGateConfig::max_skipped_frames was reached.
+         */
+        uint64_t refreshes = 0;
+        /** The difference score of the last frame.
+         */
+        float last_score = 0.0f;
+
+        /** Return the fraction of frames whose cached detections were
+         * reused.
+         */
+        double hitRate() const;
+    };
+
+
+
+    /** Decide whether inference needs to run on a frame of a static camera
+     * by comparing a downscaled copy of it to the reference frame, the last
+     * frame that wasn't skipped. Comparing to the reference rather than the
+     * previous frame means slow changes accumulate until they exceed the
+     * threshold. The difference is computed with vectorized OpenCV
+     * functions on a few thousand pixels so it costs a fraction of a
+     * millisecond. Usage:
+     *
+     *     if (gate.update(frame) != mr::MotionGate::Decision::skip) {
+     *         detections = network.infer(frame);
+     *     }
+     *
+     * MotionGate isn't thread-safe.
+     */
+    class MotionGate {
+        public:
+            enum class Decision {
+                /** The frame hardly changed, reuse the previous detections.
+                 */
+                skip,
+                /** The frame changed, run inference.
+                 */
+                infer,
+                /** The frame hardly changed but too many frames have been
+                 * skipped, run inference.
+                 */
+                refresh,
+            };
+
+            explicit MotionGate(const MotionGateConfig& config = MotionGateConfig());
+
+            /** Decide whether to skip inference on image, which must be of
+             * type CV_8UC3, and update the statistics. Unless the frame is
+             * skipped it becomes the new reference frame. The first frame,
+             * and any frame whose size differs from the reference frame,
+             * isn't skipped.
+             */
+            Decision update(const cv::Mat& image);
+
+            /** Return the mean absolute difference of image from the
+             * reference frame, per pixel and channel in the range [0-255]. A
+             * negative value is returned if there is no comparable reference
+             * frame.
+             */
+            float score(const cv::Mat& image) const;
+
+            const MotionGateStats& stats() const;
+
+            /** Clear the reference frame so the next frame isn't skipped,
+             * e.g. when the frame last returned by update() turned out to be
+             * unusable. The statistics are kept.
+             */
+            void invalidateReference();
+
+            /** Clear the reference frame and the statistics.
+             */
+            void reset();
+
+        private:
+            MotionGateConfig config_;
+            cv::Mat reference_;
+            int skipped_frames_ = 0;
+            MotionGateStats stats_;
+
+            cv::Mat downscale(const cv::Mat& image) const;
+
+            /** The mean absolute difference of two downscaled frames or a
+             * negative value if they aren't comparable.
+             */
+            float difference(const cv::Mat& small_image, const cv::Mat& reference) const;
+    };
+} // namespace mr
+
+#endif // __MOTION_GATE_HPP
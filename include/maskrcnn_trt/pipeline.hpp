@@ -0,0 +1,223 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __PIPELINE_HPP
+#define __PIPELINE_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace mr {
+    /** The stages of a pipelined inference backend. The backend owns
+     * numSlots() independent sets of buffers so that different frames can be
+     * in different stages at the same time. All functions of a slot are called
+     * in the order preprocess(), launch(), synchronize(), postprocess(), with
+     * at most one frame per slot in flight.
+     */
+    template <typename InputT, typename OutputT>
+    class PipelineBackend {
+        public:
+            virtual ~PipelineBackend() = default;
+
+            /** Return the number of frames that can be in flight at once.
+             */
+            virtual size_t numSlots() const = 0;
+
+            /** Prepare the input of a frame in the buffers of slot. Runs on
+             * the thread that submitted the frame.
+             */
+            virtual void preprocess(size_t slot, const InputT& input) = 0;
+
+            /** Start processing the buffers of slot without waiting for the
+             * result, e.g. by queueing the copies and inference on a CUDA
+             * stream. Return false on error.
+             */
+            virtual bool launch(size_t slot) = 0;
+
+            /** Wait until the processing started by launch() on slot has
+             * finished. Return false on error.
+             */
+            virtual bool synchronize(size_t slot) = 0;
+
+            /** Produce the output of the frame from the buffers of slot. Runs
+             * on the pipeline completion thread.
+             */
+            virtual OutputT postprocess(size_t slot) = 0;
+    };
+
+
+
+    /** Overlap the preprocessing, processing and postprocessing of successive
+     * frames. Frames are preprocessed and launched by submit() on the calling
+     * thread while a completion thread waits for launched frames and
+     * postprocesses them, so with N slots frame i+1 can be preprocessed and
+     * frame i-1 postprocessed while frame i is being processed. Results are
+     * produced in submission order.
+     */
+    template <typename InputT, typename OutputT>
+    class Pipeline {
+        public:
+            /** The output of a submitted frame.
+             */
+            struct Result {
+                /** The ID returned by submit() for this frame.
+                 */
+                uint64_t frame_id = 0;
+                /** Whether launching or synchronizing the frame failed.
+                 */
+                bool success = false;
+                OutputT output;
+            };
+
+            /** The backend must outlive the pipeline and have at least one
+             * slot.
+             */
+            explicit Pipeline(PipelineBackend<InputT, OutputT>& backend)
+                : backend_(backend)
+            {
+                for (size_t i = 0; i < backend_.numSlots(); i++) {
+                    free_slots_.push_back(i);
+                }
+                completion_thread_ = std::thread(&Pipeline::complete, this);
+            }
+
+            /** Wait for all submitted frames to finish and stop the completion
+             * thread. Results that have not been retrieved are discarded.
+             */
+            ~Pipeline()
+            {
+                {
+                    std::lock_guard<std::mutex> lock (mutex_);
+                    stop_ = true;
+                }
+                launched_cv_.notify_one();
+                completion_thread_.join();
+            }
+
+            Pipeline(const Pipeline&) = delete;
+            Pipeline& operator=(const Pipeline&) = delete;
+
+            /** Preprocess and launch a frame and return its ID. Blocks while
+             * all slots are in use, i.e. until the oldest in-flight frame has
+             * been postprocessed. Frames must be submitted from a single
+             * thread.
+             */
+            uint64_t submit(const InputT& input)
+            {
+                size_t slot;
+                uint64_t frame_id;
+                {
+                    std::unique_lock<std::mutex> lock (mutex_);
+                    free_cv_.wait(lock, [this] { return !free_slots_.empty(); });
+                    slot = free_slots_.front();
+                    free_slots_.pop_front();
+                    frame_id = next_frame_id_++;
+                    in_flight_++;
+                }
+                backend_.preprocess(slot, input);
+                const bool launched = backend_.launch(slot);
+                {
+                    std::lock_guard<std::mutex> lock (mutex_);
+                    launched_.push_back({frame_id, slot, launched});
+                }
+                launched_cv_.notify_one();
+                return frame_id;
+            }
+
+            /** Move the oldest available result into result without blocking.
+             * Return false if no result is available.
+             */
+            bool poll(Result& result)
+            {
+                std::lock_guard<std::mutex> lock (mutex_);
+                return popResult(result);
+            }
+
+            /** Move the oldest result into result, blocking until it is
+             * available. Return false without blocking if no frames are in
+             * flight and no results are available.
+             */
+            bool wait(Result& result)
+            {
+                std::unique_lock<std::mutex> lock (mutex_);
+                results_cv_.wait(lock, [this] { return !results_.empty() || in_flight_ == 0; });
+                return popResult(result);
+            }
+
+            /** Return the number of submitted frames whose results are not yet
+             * available.
+             */
+            size_t inFlight() const
+            {
+                std::lock_guard<std::mutex> lock (mutex_);
+                return in_flight_;
+            }
+
+        private:
+            struct LaunchedFrame {
+                uint64_t frame_id;
+                size_t slot;
+                bool launched;
+            };
+
+            PipelineBackend<InputT, OutputT>& backend_;
+            mutable std::mutex mutex_;
+            std::condition_variable free_cv_;
+            std::condition_variable launched_cv_;
+            std::condition_variable results_cv_;
+            std::deque<size_t> free_slots_;
+            std::deque<LaunchedFrame> launched_;
+            std::deque<Result> results_;
+            uint64_t next_frame_id_ = 0;
+            size_t in_flight_ = 0;
+            bool stop_ = false;
+            std::thread completion_thread_;
+
+            bool popResult(Result& result)
+            {
+                if (results_.empty()) {
+                    return false;
+                }
+                result = std::move(results_.front());
+                results_.pop_front();
+                return true;
+            }
+
+            /** Wait for and postprocess launched frames in submission order
+             * until the pipeline is destroyed.
+             */
+            void complete()
+            {
+                std::unique_lock<std::mutex> lock (mutex_);
+                while (true) {
+                    launched_cv_.wait(lock, [this] { return stop_ || !launched_.empty(); });
+                    if (launched_.empty()) {
+                        return;
+                    }
+                    const LaunchedFrame frame = launched_.front();
+                    launched_.pop_front();
+                    lock.unlock();
+
+                    Result result;
+                    result.frame_id = frame.frame_id;
+                    result.success = frame.launched && backend_.synchronize(frame.slot);
+                    if (result.success) {
+                        result.output = backend_.postprocess(frame.slot);
+                    }
+
+                    lock.lock();
+                    results_.push_back(std::move(result));
+                    in_flight_--;
+                    free_slots_.push_back(frame.slot);
+                    free_cv_.notify_one();
+                    results_cv_.notify_all();
+                }
+            }
+    };
+} // namespace mr
+
+#endif // __PIPELINE_HPP
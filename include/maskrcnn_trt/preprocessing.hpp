@@ -0,0 +1,58 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __PREPROCESSING_HPP
+#define __PREPROCESSING_HPP
+
+#include <string>
+
+#include <opencv2/core.hpp>
+
+namespace mr {
+    /** Resize, pad and copy an image into a network input buffer. The image
+     * must be of type CV_8UC3 and input_buffer must have space for
+     * MaskRCNNConfig::model_input_volume floats. The image is resized so that
+     * its largest dimension matches the network input, keeping its aspect
+     * ratio, and is centred in the zero-padded network input. Images are
+     * assumed to be in BGR order by default and are converted to RGB. Set
+     * in_bgr_order to false to skip this conversion if image is already in RGB
+     * order.
+     */
+    void preprocess_image(const cv::Mat& image,
+                          float*         input_buffer,
+                          bool           in_bgr_order = true);
+
+
+
+    /** Return the dimensions of a JPEG image read from its header, without
+     * decoding it. An empty size is returned if the file isn't a JPEG image
+     * or its header can't be read.
+     */
+    cv::Size read_jpeg_size(const std::string& filename);
+
+    /** Return the EXIF orientation of a JPEG image read from its header,
+     * without decoding it. The orientation is in the range 1-8, where 5-8
+     * rotate the image by 90 degrees, and is 1 if the file isn't a JPEG image
+     * or has no EXIF orientation.
+     */
+    int read_jpeg_orientation(const std::string& filename);
+
+    /** Return the largest JPEG scale denominator out of 1, 2, 4 and 8 at
+     * which the largest dimension of an image of the given size is still at
+     * least that of the network input.
+     */
+    int jpeg_reduction_factor(cv::Size size);
+
+    /** Read a BGR image with cv::imread(). JPEG images much larger than the
+     * network input are decoded at a reduced resolution using libjpeg DCT
+     * scaling, since preprocess_image() would downscale them anyway. The
+     * dimensions of the image at full resolution, taking into account any
+     * EXIF rotation applied when decoding, are written to original_size.
+     * Pass original_size to MaskRCNN::infer() to get detections in
+     * full-resolution coordinates. An empty image is returned on error.
+     */
+    cv::Mat read_image(const std::string& filename, cv::Size& original_size);
+} // namespace mr
+
+#endif // __PREPROCESSING_HPP
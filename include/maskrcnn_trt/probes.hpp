@@ -0,0 +1,36 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __PROBES_HPP
+#define __PROBES_HPP
+
+// USDT probes under the maskrcnn provider, placed at the stage boundaries of
+// the library. A probe compiles to a single nop and costs nothing unless a
+// tracer like bpftrace or perf is attached to it. The probes are available if
+// <sys/sdt.h> was found at compile time (systemtap-sdt-dev on Debian/Ubuntu)
+// and MR_DISABLE_PROBES is not defined. List them with
+//   bpftrace -l 'usdt:PATH_TO_BINARY:maskrcnn:*'
+// and see scripts/maskrcnn_latency.bt for an example.
+#if !defined(MR_DISABLE_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MR_HAVE_PROBES
+#endif
+#endif
+
+#ifdef MR_HAVE_PROBES
+#define MR_PROBE(name) DTRACE_PROBE(maskrcnn, name)
+#define MR_PROBE1(name, a) DTRACE_PROBE1(maskrcnn, name, a)
+#define MR_PROBE2(name, a, b) DTRACE_PROBE2(maskrcnn, name, a, b)
+#define MR_PROBE3(name, a, b, c) DTRACE_PROBE3(maskrcnn, name, a, b, c)
+#define MR_PROBE4(name, a, b, c, d) DTRACE_PROBE4(maskrcnn, name, a, b, c, d)
+#else
+#define MR_PROBE(name) do {} while (0)
+#define MR_PROBE1(name, a) do {} while (0)
+#define MR_PROBE2(name, a, b) do {} while (0)
+#define MR_PROBE3(name, a, b, c) do {} while (0)
+#define MR_PROBE4(name, a, b, c, d) do {} while (0)
+#endif
+
+#endif // __PROBES_HPP
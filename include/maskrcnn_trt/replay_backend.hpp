@@ -0,0 +1,138 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __REPLAY_BACKEND_HPP
+#define __REPLAY_BACKEND_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include "capture.hpp"
+#include "inference_backend.hpp"
+
+namespace mr {
+    /** Fill a detection and a mask buffer, with space for a single image, with
+     * num_detections synthetic detections of random classes. Each bounding box
+     * is a square whose side is box_size times the network input side and box_size
+     * must be in the range (0-1]. The masks are centred discs. The same seed
+     * produces the same output.
+     */
+    void generate_synthetic_output(int      num_detections,
+                                   float    box_size,
+                                   uint32_t seed,
+                                   float*   detection_buffer,
+                                   float*   mask_buffer);
+
+
+
+    /** A backend that doesn't use a GPU. Instead of running the network it
+     * returns previously recorded or synthetic output tensors, cycling through
+     * them in the order they were added, after a simulated latency. It can be
+     * used to test and benchmark the preprocessing and postprocessing on
+     * machines without a GPU. All outputs are empty if no frames were added.
+     */
+    class ReplayBackend : public InferenceBackend {
+        public:
+            /** Return the simulated latency of a batch of the given size.
+             */
+            typedef std::function<std::chrono::microseconds(int)> LatencyModel;
+
+            explicit ReplayBackend(int max_batch_size = 1);
+
+            /** Add a frame of output tensors. The buffers must contain
+             * MaskRCNNConfig::model_detection_volume and
+             * MaskRCNNConfig::model_mask_volume floats respectively. Frames
+             * are shared with backends created by clone(). Frames added after
+             * clone() aren't visible to the clone, so frames can be added
+             * while clones run inference.
+             */
+            void addFrame(const float* detection_buffer, const float* mask_buffer);
+
+            /** Add a frame generated by generate_synthetic_output().
+             */
+            void addSyntheticFrame(int num_detections, float box_size, uint32_t seed = 0);
+
+            /** Add all records of an open capture as frames. The records
+             * aren't copied when added and the capture is kept open while the
+             * frames are in use. Like the device to host copy of a GPU
+             * backend, each replayed frame is copied into the output buffers.
+             */
+            void addCapture(std::shared_ptr<const CaptureReader> capture);
+
+            /** Return the number of added frames.
+             */
+            size_t numFrames() const;
+
+            /** Set the latency simulated by execute() and enqueue()/
+             * synchronize(). There is no latency by default.
+             */
+            void setLatency(LatencyModel latency);
+
+            int maxBatchSize() const override;
+
+            int numBindings() const override;
+
+            std::string bindingName(int index) const override;
+
+            bool bindingIsInput(int index) const override;
+
+            std::vector<int> bindingShape(int index) const override;
+
+            void* hostBuffer(const std::string& tensor_name) const override;
+
+            /** There are no device buffers so this always returns nullptr.
+             */
+            void* deviceBuffer(const std::string& tensor_name) const override;
+
+            bool copyInputToDevice(int batch_size) override;
+
+            bool execute(int batch_size) override;
+
+            bool copyOutputToHost(int batch_size) override;
+
+            bool enqueue(int batch_size) override;
+
+            bool synchronize() override;
+
+            std::vector<BindingMemory> memoryUsage() const override;
+
+            std::unique_ptr<InferenceBackend> clone() const override;
+
+        private:
+            /** A frame of output tensors. The buffers are kept alive by
+             * owner, which holds either a copy of the tensors or a capture.
+             */
+            struct Frame {
+                const float* detection_buffer;
+                const float* mask_buffer;
+                std::shared_ptr<const void> owner;
+            };
+
+            int max_batch_size_;
+            LatencyModel latency_;
+            std::shared_ptr<std::vector<Frame>> frames_;
+            size_t next_frame_ = 0;
+            // The host buffers, mutable since hostBuffer() is const like
+            // BufferManager::getHostBuffer().
+            mutable std::vector<float> input_buffer_;
+            mutable std::vector<float> detection_buffer_;
+            mutable std::vector<float> mask_buffer_;
+            std::chrono::steady_clock::time_point enqueue_end_;
+            int enqueued_batch_size_ = 0;
+
+            /** Return the frames for appending, copying them first if
+             * they're shared with a clone.
+             */
+            std::vector<Frame>& mutableFrames();
+
+            /** Copy the next batch_size frames into the output buffers.
+             */
+            void writeOutput(int batch_size);
+
+            std::chrono::microseconds latency(int batch_size) const;
+    };
+} // namespace mr
+
+#endif // __REPLAY_BACKEND_HPP
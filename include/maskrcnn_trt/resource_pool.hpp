@@ -0,0 +1,217 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __RESOURCE_POOL_HPP
+#define __RESOURCE_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace mr {
+    /** A lock-free LIFO list of the indices in the range [0, capacity). All
+     * indices are initially in the list. The head is tagged with a counter
+     * that is incremented on each modification to avoid the ABA problem.
+     */
+    class FreeList {
+        public:
+            explicit FreeList(uint32_t capacity)
+                : next_(new std::atomic<uint32_t>[capacity])
+            {
+                for (uint32_t i = 0; i < capacity; i++) {
+                    next_[i].store(i + 1 < capacity ? i + 1 : null_index, std::memory_order_relaxed);
+                }
+                head_.store(capacity > 0 ? 0 : null_index);
+            }
+
+            /** Remove an index from the list and store it in index. Return
+             * false without modifying index if the list is empty.
+             */
+            bool tryPop(uint32_t& index)
+            {
+                uint64_t head = head_.load();
+                while (true) {
+                    const uint32_t head_index = head & index_mask;
+                    if (head_index == null_index) {
+                        return false;
+                    }
+                    const uint32_t next = next_[head_index].load(std::memory_order_relaxed);
+                    if (head_.compare_exchange_weak(head, tagged(head, next))) {
+                        index = head_index;
+                        return true;
+                    }
+                }
+            }
+
+            /** Return an index previously obtained from tryPop() to the list.
+             */
+            void push(uint32_t index)
+            {
+                uint64_t head = head_.load(std::memory_order_relaxed);
+                do {
+                    next_[index].store(head & index_mask, std::memory_order_relaxed);
+                } while (!head_.compare_exchange_weak(head, tagged(head, index)));
+            }
+
+        private:
+            static constexpr uint32_t null_index = UINT32_MAX;
+            static constexpr uint64_t index_mask = UINT32_MAX;
+
+            std::unique_ptr<std::atomic<uint32_t>[]> next_;
+            /** The tag in the upper 32 bits and the index in the lower 32.
+             */
+            std::atomic<uint64_t> head_;
+
+            /** Return a new head containing index with the tag of head
+             * incremented.
+             */
+            static uint64_t tagged(uint64_t head, uint32_t index)
+            {
+                return (((head >> 32) + 1) << 32) | index;
+            }
+    };
+
+
+
+    /** A fixed set of resources that can be checked out by multiple threads.
+     * Checking out a resource is lock-free while one is available. Threads
+     * only block when all resources are in use.
+     */
+    template <typename T>
+    class ResourcePool {
+        public:
+            /** A resource checked out from the pool. It is returned to the
+             * pool when the Lease is destroyed.
+             */
+            class Lease {
+                public:
+                    Lease() = default;
+
+                    Lease(Lease&& other)
+                        : pool_(other.pool_), index_(other.index_)
+                    {
+                        other.pool_ = nullptr;
+                    }
+
+                    Lease& operator=(Lease&& other)
+                    {
+                        if (this != &other) {
+                            release();
+                            pool_ = other.pool_;
+                            index_ = other.index_;
+                            other.pool_ = nullptr;
+                        }
+                        return *this;
+                    }
+
+                    ~Lease()
+                    {
+                        release();
+                    }
+
+                    /** Return whether the Lease holds a resource.
+                     */
+                    explicit operator bool() const
+                    {
+                        return pool_;
+                    }
+
+                    T& operator*() const
+                    {
+                        return *pool_->resources_[index_];
+                    }
+
+                    T* operator->() const
+                    {
+                        return pool_->resources_[index_].get();
+                    }
+
+                private:
+                    friend class ResourcePool;
+
+                    ResourcePool* pool_ = nullptr;
+                    uint32_t index_ = 0;
+
+                    Lease(ResourcePool* pool, uint32_t index)
+                        : pool_(pool), index_(index)
+                    {
+                    }
+
+                    void release()
+                    {
+                        if (pool_) {
+                            pool_->release(index_);
+                            pool_ = nullptr;
+                        }
+                    }
+            };
+
+            explicit ResourcePool(std::vector<std::unique_ptr<T>> resources)
+                : resources_(std::move(resources)), free_list_(resources_.size())
+            {
+            }
+
+            /** Check out a resource, blocking until one is available. The pool
+             * must not be empty.
+             */
+            Lease acquire()
+            {
+                uint32_t index;
+                if (free_list_.tryPop(index)) {
+                    return Lease(this, index);
+                }
+                // Slow path, wait for a resource to be released.
+                std::unique_lock<std::mutex> lock (mutex_);
+                waiters_++;
+                while (!free_list_.tryPop(index)) {
+                    cv_.wait(lock);
+                }
+                waiters_--;
+                return Lease(this, index);
+            }
+
+            /** Check out a resource without blocking. The returned Lease
+             * evaluates to false if all resources are in use.
+             */
+            Lease tryAcquire()
+            {
+                uint32_t index;
+                if (free_list_.tryPop(index)) {
+                    return Lease(this, index);
+                }
+                return Lease();
+            }
+
+            /** Return the total number of resources in the pool.
+             */
+            size_t size() const
+            {
+                return resources_.size();
+            }
+
+        private:
+            std::vector<std::unique_ptr<T>> resources_;
+            FreeList free_list_;
+            std::atomic<int> waiters_ {0};
+            std::mutex mutex_;
+            std::condition_variable cv_;
+
+            void release(uint32_t index)
+            {
+                free_list_.push(index);
+                // Both the push and the waiter count use sequentially
+                // consistent operations so either a waiter sees the released
+                // resource or the waiter is seen here.
+                if (waiters_.load() > 0) {
+                    std::lock_guard<std::mutex> lock (mutex_);
+                    cv_.notify_one();
+                }
+            }
+    };
+} // namespace mr
+
+#endif // __RESOURCE_POOL_HPP
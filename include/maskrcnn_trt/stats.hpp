@@ -0,0 +1,190 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __STATS_HPP
+#define __STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace mr {
+    /** Summary statistics of a latency distribution in milliseconds.
+     */
+    struct LatencySummary {
+        uint64_t count = 0;
+        double p50 = 0.0;
+        double p90 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+
+
+    /** A lock-free histogram of latencies in nanoseconds. Buckets are
+     * logarithmic with 32 linear sub-buckets each, like an HDR histogram with
+     * 5 significant bits. Values below 32 are recorded exactly. As in an HDR
+     * histogram the lower half of each subsequent bucket overlaps the
+     * previous one, so each further power of two is split into 16
+     * sub-buckets, giving about 3% relative precision over the whole uint64_t
+     * range. Recording is lock-free and can be done concurrently from any
+     * thread. Counting is wait-free but updating the maximum may retry.
+     */
+    class LatencyHistogram {
+        public:
+            LatencyHistogram();
+
+            /** Record a latency in nanoseconds.
+             */
+            void record(uint64_t ns)
+            {
+                counts_[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+                uint64_t max = max_.load(std::memory_order_relaxed);
+                while (ns > max && !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+                }
+            }
+
+            /** Return the percentiles and maximum of the recorded latencies.
+             * The percentiles are approximate if recording happens
+             * concurrently.
+             */
+            LatencySummary summary() const;
+
+            /** Clear all recorded latencies.
+             */
+            void reset();
+
+        private:
+            static constexpr int sub_bucket_bits = 5;
+            static constexpr uint64_t sub_bucket_count = 1 << sub_bucket_bits;
+            static constexpr uint64_t half_sub_bucket_count = sub_bucket_count / 2;
+            static constexpr size_t num_buckets
+                = sub_bucket_count + (64 - sub_bucket_bits) * half_sub_bucket_count;
+
+            std::array<std::atomic<uint64_t>, num_buckets> counts_;
+            std::atomic<uint64_t> max_;
+
+            static size_t bucketIndex(uint64_t ns)
+            {
+                if (ns < sub_bucket_count) {
+                    return ns;
+                }
+                // Keep the sub_bucket_bits most significant bits of ns.
+                const int shift = 63 - __builtin_clzll(ns) - (sub_bucket_bits - 1);
+                return sub_bucket_count + (shift - 1) * half_sub_bucket_count
+                    + ((ns >> shift) - half_sub_bucket_count);
+            }
+
+            /** Return the value in the middle of the bucket at index.
+             */
+            static uint64_t bucketValue(size_t index);
+    };
+
+
+
+    /** The stages of MaskRCNN::infer() whose latency is recorded.
+     */
+    enum class InferenceStage {
+        preprocess,
+        copy_to_device,
+        execute,
+        copy_to_host,
+        detection_decode,
+        mask_decode,
+        total,
+        num_stages,
+    };
+
+    /** Return the name of an inference stage.
+     */
+    const char* stage_name(InferenceStage stage);
+
+
+
+    /** A snapshot of the latency statistics of MaskRCNN::infer().
+     */
+    struct InferenceStats {
+        /** The number of images inference was run on.
+         */
+        uint64_t frames = 0;
+        /** The latency of each stage indexed by InferenceStage. Batched
+         * stages are recorded once per batch and per-image stages once per
+         * image.
+         */
+        std::array<LatencySummary, static_cast<size_t>(InferenceStage::num_stages)> stages;
+
+        const LatencySummary& operator[](InferenceStage stage) const
+        {
+            return stages[static_cast<size_t>(stage)];
+        }
+    };
+
+    std::ostream& operator<<(std::ostream& os, const InferenceStats& s);
+
+
+
+    /** The latency histograms of all inference stages.
+     */
+    class StageStats {
+        public:
+            void record(InferenceStage stage, std::chrono::steady_clock::duration duration)
+            {
+                histograms_[static_cast<size_t>(stage)].record(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+            }
+
+            void addFrames(uint64_t frames)
+            {
+                frames_.fetch_add(frames, std::memory_order_relaxed);
+            }
+
+            InferenceStats snapshot() const;
+
+            void reset();
+
+        private:
+            std::array<LatencyHistogram, static_cast<size_t>(InferenceStage::num_stages)> histograms_;
+            std::atomic<uint64_t> frames_ {0};
+    };
+
+
+
+    /** Record the time from its construction to its destruction as the latency
+     * of an inference stage.
+     */
+    class ScopedStageTimer {
+        public:
+            ScopedStageTimer(StageStats& stats, InferenceStage stage)
+                : stats_(stats), stage_(stage), start_(std::chrono::steady_clock::now())
+            {
+            }
+
+            ~ScopedStageTimer()
+            {
+                stats_.record(stage_, std::chrono::steady_clock::now() - start_);
+            }
+
+        private:
+            StageStats& stats_;
+            InferenceStage stage_;
+            std::chrono::steady_clock::time_point start_;
+    };
+} // namespace mr
+
+// Time the rest of the enclosing scope as an inference stage. Compiled out
+// unless MR_ENABLE_STATS is defined.
+#ifdef MR_ENABLE_STATS
+#ifndef MR_CONCAT
+#define MR_CONCAT_IMPL(a, b) a##b
+#define MR_CONCAT(a, b) MR_CONCAT_IMPL(a, b)
+#endif
+#define MR_TIME_STAGE(stats, stage) \
+    ::mr::ScopedStageTimer MR_CONCAT(mr_stage_timer_, __LINE__) ((stats), (stage))
+#else
+#define MR_TIME_STAGE(stats, stage) do {} while (0)
+#endif
+
+#endif // __STATS_HPP
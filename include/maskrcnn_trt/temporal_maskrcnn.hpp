@@ -0,0 +1,123 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __TEMPORAL_MASKRCNN_HPP
+#define __TEMPORAL_MASKRCNN_HPP
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "detection.hpp"
+#include "mask_propagation.hpp"
+#include "motion_gate.hpp"
+#include "tracker.hpp"
+
+namespace mr {
+    class MaskRCNN;
+
+
+
+    /** The configuration of the keyframe scheduling of TemporalMaskRCNN.
+     */
+    struct KeyframeConfig {
+        /** Run inference every stride frames. A stride of 1 runs inference on
+         * every frame.
+         */
+        int stride = 5;
+        /** Adapt the stride to the scene: halve it, down to min_stride, when
+         * the tracker fails to explain more than max_unmatched_fraction of
+         * the tracks and detections of a keyframe and increase it by one, up
+         * to stride, otherwise. Keyframes when there are no tracks, e.g. the
+         * first one, leave the stride unchanged.
+         */
+        bool adaptive = false;
+        int min_stride = 1;
+        float max_unmatched_fraction = 0.2f;
+        TrackerConfig tracker;
+        /** Pass frames through a MotionGate first and return the previous
+         * detections for frames that hardly changed, without running
+         * inference or advancing the tracker. A refresh forced by the gate
+         * makes the frame a keyframe.
+         */
+        bool motion_gate = false;
+        MotionGateConfig motion;
+        /** Propagate the masks of the last keyframe to the frames in between
+         * with a MaskPropagator instead of moving them with the tracker
+         * boxes. Frames where the flow confidence drops become keyframes.
+         */
+        bool optical_flow = false;
+        MaskPropagationConfig flow;
+    };
+
+
+
+    /** Run inference on a video stream only on keyframes and carry the
+     * detections forward to the frames in between with an IoUTracker.
+     * Optionally skip static frames with a MotionGate. All returned
+     * detections have their track_id set.
+     */
+    class TemporalMaskRCNN {
+        public:
+            /** The network must outlive the TemporalMaskRCNN.
+             */
+            TemporalMaskRCNN(MaskRCNN& network, const KeyframeConfig& config = KeyframeConfig());
+
+            /** Return the detections of the next frame of the stream, either
+             * from inference or predicted by the tracker. The image
+             * requirements and the in_bgr_order parameter are the same as in
+             * MaskRCNN::infer().
+             */
+            std::vector<Detection> process(const cv::Mat& rgb_image, bool in_bgr_order = true);
+
+            /** Return whether inference was run on the last processed frame.
+             */
+            bool lastWasKeyframe() const;
+
+            /** Return whether inference failed on the last processed frame.
+             * No detections are returned for it, the tracks are left
+             * unchanged and the next frame is a keyframe.
+             */
+            bool lastFailed() const;
+
+            /** Return the stride until the next keyframe.
+             */
+            int currentStride() const;
+
+            /** Return the statistics of the motion gate. They are all zero
+             * if KeyframeConfig::motion_gate is false.
+             */
+            const MotionGateStats& motionGateStats() const;
+
+            /** Return the number of frames that became keyframes because the
+             * optical flow confidence dropped.
+             */
+            size_t flowFallbacks() const;
+
+            /** Remove all tracks, clear the motion gate and make the next
+             * frame a keyframe, e.g. on a scene cut.
+             */
+            void reset();
+
+        private:
+            MaskRCNN& network_;
+            KeyframeConfig config_;
+            IoUTracker tracker_;
+            MotionGate gate_;
+            MaskPropagator propagator_;
+            size_t flow_fallbacks_ = 0;
+            std::vector<Detection> last_detections_;
+            int stride_;
+            int frames_since_keyframe_ = 0;
+            bool last_was_keyframe_ = false;
+            bool last_failed_ = false;
+            bool force_keyframe_ = true;
+
+            /** Adapt the stride based on the last tracker update.
+             */
+            void adaptStride();
+    };
+} // namespace mr
+
+#endif // __TEMPORAL_MASKRCNN_HPP
@@ -0,0 +1,73 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __TENSORRT_BACKEND_HPP
+#define __TENSORRT_BACKEND_HPP
+
+#include "buffers.hpp"
+#include "inference_backend.hpp"
+
+namespace mr {
+    /** Run the network on a TensorRT engine. Each instance has its own
+     * execution context, host/device buffers and CUDA stream.
+     */
+    class TensorRTBackend : public InferenceBackend {
+        public:
+            /** Create a backend running engine on batches of up to
+             * max_batch_size items with host buffers allocated according to
+             * host_allocation. Return nullptr on failure.
+             */
+            static std::unique_ptr<TensorRTBackend> create(
+                    std::shared_ptr<nvinfer1::ICudaEngine> engine,
+                    int                                    max_batch_size,
+                    HostAllocation                         host_allocation = HostAllocation::pageable);
+
+            ~TensorRTBackend() override;
+
+            int maxBatchSize() const override;
+
+            int numBindings() const override;
+
+            std::string bindingName(int index) const override;
+
+            bool bindingIsInput(int index) const override;
+
+            std::vector<int> bindingShape(int index) const override;
+
+            void* hostBuffer(const std::string& tensor_name) const override;
+
+            void* deviceBuffer(const std::string& tensor_name) const override;
+
+            bool copyInputToDevice(int batch_size) override;
+
+            bool execute(int batch_size) override;
+
+            bool copyOutputToHost(int batch_size) override;
+
+            bool enqueue(int batch_size) override;
+
+            bool synchronize() override;
+
+            std::vector<BindingMemory> memoryUsage() const override;
+
+            std::unique_ptr<InferenceBackend> clone() const override;
+
+        private:
+            template <typename T>
+            using NVUniquePtr = std::unique_ptr<T, samplesCommon::InferDeleter>;
+
+            std::shared_ptr<nvinfer1::ICudaEngine> engine_;
+            int max_batch_size_;
+            HostAllocation host_allocation_;
+            NVUniquePtr<nvinfer1::IExecutionContext> context_;
+            std::unique_ptr<samplesCommon::BufferManager> buffer_manager_;
+            cudaStream_t stream_ = nullptr;
+
+            TensorRTBackend(std::shared_ptr<nvinfer1::ICudaEngine> engine,
+                            int                                    max_batch_size,
+                            HostAllocation                         host_allocation);
+    };
+} // namespace mr
+
+#endif // __TENSORRT_BACKEND_HPP
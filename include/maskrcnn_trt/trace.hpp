@@ -0,0 +1,93 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __TRACE_HPP
+#define __TRACE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mr {
+    /** Start recording trace spans. Each thread records into its own ring
+     * buffer of events_per_thread spans, allocated the first time the thread
+     * records a span after tracing was enabled. Once a ring buffer is full the
+     * oldest spans are overwritten.
+     */
+    void trace_enable(size_t events_per_thread = 65536);
+
+    /** Stop recording trace spans. Recorded spans are kept until
+     * trace_clear() is called.
+     */
+    void trace_disable();
+
+    /** Discard all recorded spans.
+     */
+    void trace_clear();
+
+    /** Set the name the calling thread will be shown with in the trace.
+     */
+    void trace_thread_name(const std::string& name);
+
+    /** Write the recorded spans of all threads to filename in the Chrome trace
+     * event JSON format. The file can be opened in chrome://tracing or
+     * https://ui.perfetto.dev. It is safe to call while other threads are still
+     * recording. Return whether the file was written successfully.
+     */
+    bool trace_write(const std::string& filename);
+
+    namespace detail {
+        extern std::atomic<bool> trace_enabled;
+
+        int64_t trace_now();
+
+        void trace_record(const char* name, int64_t start_ns, int64_t end_ns);
+    } // namespace detail
+
+
+
+    /** Record a span from construction until destruction if tracing is
+     * enabled. The name must be a string literal or otherwise outlive the
+     * trace. Recording neither allocates nor locks, except for the first span
+     * of each thread which allocates its ring buffer.
+     */
+    class TraceSpan {
+        public:
+            explicit TraceSpan(const char* name)
+                : name_(name),
+                  start_(detail::trace_enabled.load(std::memory_order_relaxed)
+                          ? detail::trace_now() : -1)
+            {
+            }
+
+            ~TraceSpan()
+            {
+                if (start_ >= 0) {
+                    detail::trace_record(name_, start_, detail::trace_now());
+                }
+            }
+
+            TraceSpan(const TraceSpan&) = delete;
+            TraceSpan& operator=(const TraceSpan&) = delete;
+
+        private:
+            const char* name_;
+            const int64_t start_;
+    };
+} // namespace mr
+
+// Record a span until the end of the enclosing scope. Compiled out unless
+// MR_ENABLE_TRACE is defined.
+#ifdef MR_ENABLE_TRACE
+#ifndef MR_CONCAT
+#define MR_CONCAT_IMPL(a, b) a##b
+#define MR_CONCAT(a, b) MR_CONCAT_IMPL(a, b)
+#endif
+#define MR_TRACE_SPAN(name) ::mr::TraceSpan MR_CONCAT(mr_trace_span_, __LINE__) (name)
+#else
+#define MR_TRACE_SPAN(name) do {} while (0)
+#endif
+
+#endif // __TRACE_HPP
@@ -0,0 +1,145 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __TRACKER_HPP
+#define __TRACKER_HPP
+
+#include <array>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "detection.hpp"
+
+namespace mr {
+    /** The configuration of IoUTracker.
+     */
+    struct TrackerConfig {
+        /** The minimum IoU between the predicted box of a track and a
+         * detection of the same class for them to be matched.
+         */
+        float iou_threshold = 0.3f;
+        /** Tracks are removed after not being matched on this many
+         * consecutive keyframes.
+         */
+        int max_missed_keyframes = 1;
+        /** The standard deviation of the acceleration of the box centre and
+         * dimensions in pixels per frame squared.
+         */
+        float process_noise = 1.0f;
+        /** The standard deviation of the box centre and dimensions of a
+         * detection in pixels.
+         */
+        float measurement_noise = 4.0f;
+    };
+
+
+
+    /** Track detections across frames when detections are only available on
+     * keyframes. Each track holds a constant-velocity Kalman filter of the
+     * box centre and dimensions. On keyframes detections are greedily matched
+     * to the predicted track boxes by IoU and on the frames in between the
+     * detections of the last keyframe are carried forward to the predicted
+     * boxes, with their masks shifted and resized accordingly.
+     *
+     * The tracker is deterministic: the same sequence of calls with the same
+     * detections produces the same tracks and track IDs.
+     */
+    class IoUTracker {
+        public:
+            /** The outcome of the last call of update().
+             */
+            struct UpdateStats {
+                /** Detections matched to existing tracks.
+                 */
+                size_t matched = 0;
+                /** Detections that started new tracks.
+                 */
+                size_t created = 0;
+                /** Tracks that weren't matched to any detection.
+                 */
+                size_t missed = 0;
+            };
+
+            explicit IoUTracker(const TrackerConfig& config = TrackerConfig());
+
+            /** Advance to a keyframe of size image_size with detections.
+             * Return the detections with their track_id set. Detections not
+             * matched to an existing track start a new one.
+             */
+            std::vector<Detection> update(std::vector<Detection> detections,
+                                          cv::Size               image_size);
+
+            /** Advance to a frame without detections and return the
+             * predicted detections of the tracks matched or created on the
+             * last keyframe. Tracks whose predicted box leaves the image are
+             * omitted.
+             */
+            std::vector<Detection> predict();
+
+            /** Advance to a frame without detections like predict() but
+             * without computing the predicted detections, e.g. when they are
+             * obtained otherwise.
+             */
+            void advance();
+
+            /** Remove all tracks. Track IDs keep increasing.
+             */
+            void reset();
+
+            /** Return the number of tracks, including those not matched on
+             * the last keyframe.
+             */
+            size_t numTracks() const;
+
+            const UpdateStats& lastUpdate() const;
+
+        private:
+            /** A constant-velocity Kalman filter of a single coordinate.
+             */
+            struct Filter {
+                float position = 0.0f;
+                float velocity = 0.0f;
+                /** The covariance matrix in row-major order.
+                 */
+                std::array<float, 4> p;
+
+                void predict(float process_variance);
+
+                void update(float measurement, float measurement_variance);
+            };
+
+            struct Track {
+                int id;
+                /** Filters of the centre x, centre y, width and height.
+                 */
+                std::array<Filter, 4> filters;
+                /** The detection of the last keyframe the track was matched
+                 * on, whose mask is carried forward.
+                 */
+                Detection keyframe_detection;
+                int missed_keyframes = 0;
+            };
+
+            TrackerConfig config_;
+            std::vector<Track> tracks_;
+            cv::Size image_size_;
+            int next_id_ = 0;
+            UpdateStats last_update_;
+
+            Track createTrack(const Detection& detection);
+
+            /** Advance the filters of all tracks by one frame.
+             */
+            void predictTracks();
+
+            /** Return the detection of the last keyframe of track moved to its
+             * predicted box. The result has an empty box if the box is
+             * outside the image.
+             */
+            Detection predictedDetection(const Track& track) const;
+    };
+} // namespace mr
+
+#endif // __TRACKER_HPP
@@ -0,0 +1,307 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "maskrcnn_trt/async_logger.hpp"
+
+namespace mr {
+    /** A fixed-size piece of a message. Messages longer than a record span
+     * several consecutive records, all but the last having continued set.
+     */
+    struct LogRecord {
+        int64_t timestamp_ns;
+        uint16_t length;
+        uint8_t severity;
+        uint8_t continued;
+        char text[244];
+    };
+
+    static_assert(sizeof(LogRecord) == 256, "LogRecord should be 256 bytes");
+
+
+
+    /** A single-producer single-consumer ring buffer of log records. The owning
+     * thread advances tail after writing records and the writer thread advances
+     * head after writing them out.
+     */
+    struct LogRing {
+        static constexpr uint64_t capacity = 256;
+
+        alignas(64) std::atomic<uint64_t> tail {0};
+        alignas(64) std::atomic<uint64_t> head {0};
+        LogRecord records[capacity];
+    };
+
+
+
+    static thread_local std::shared_ptr<LogRing> thread_ring;
+
+    static const char* severity_prefix(AsyncLogWriter::Severity severity)
+    {
+        switch (severity) {
+            case AsyncLogWriter::Severity::kINTERNAL_ERROR: return "[F] ";
+            case AsyncLogWriter::Severity::kERROR: return "[E] ";
+            case AsyncLogWriter::Severity::kWARNING: return "[W] ";
+            case AsyncLogWriter::Severity::kINFO: return "[I] ";
+            case AsyncLogWriter::Severity::kVERBOSE: return "[V] ";
+            default: return "";
+        }
+    }
+
+    static bool is_stdout_severity(AsyncLogWriter::Severity severity)
+    {
+        return severity >= AsyncLogWriter::Severity::kINFO;
+    }
+
+    static int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+
+
+    AsyncLogWriter& AsyncLogWriter::instance()
+    {
+        // Never destroyed so that logging from static destructors is safe.
+        static AsyncLogWriter* writer = [] {
+            AsyncLogWriter* w = new AsyncLogWriter();
+            std::atexit([] { AsyncLogWriter::instance().shutdown(); });
+            return w;
+        }();
+        return *writer;
+    }
+
+
+
+    AsyncLogWriter::AsyncLogWriter()
+    {
+        thread_ = std::thread(&AsyncLogWriter::run, this);
+    }
+
+
+
+    void AsyncLogWriter::write(Severity severity, std::string_view prefix, std::string_view text)
+    {
+        const bool add_newline = text.empty() || text.back() != '\n';
+        const size_t length = prefix.size() + text.size() + add_newline;
+        if (!running_.load(std::memory_order_acquire)) {
+            // The writer thread has stopped, write synchronously.
+            std::lock_guard<std::mutex> lock (output_mutex_);
+            FILE* f = is_stdout_severity(severity) ? stdout : stderr;
+            std::fputs(severity_prefix(severity), f);
+            std::fwrite(prefix.data(), 1, prefix.size(), f);
+            std::fwrite(text.data(), 1, text.size(), f);
+            if (add_newline) {
+                std::fputc('\n', f);
+            }
+            std::fflush(f);
+            return;
+        }
+
+        LogRing& ring = localRing();
+        const size_t chunk = sizeof(LogRecord::text);
+        const uint64_t num_records = (length + chunk - 1) / chunk;
+        const uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        const uint64_t head = ring.head.load(std::memory_order_acquire);
+        if (num_records > LogRing::capacity - (tail - head)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        const int64_t timestamp = now_ns();
+        size_t offset = 0;
+        for (uint64_t r = 0; r < num_records; r++) {
+            LogRecord& record = ring.records[(tail + r) % LogRing::capacity];
+            record.timestamp_ns = timestamp;
+            record.severity = static_cast<uint8_t>(severity);
+            record.continued = r + 1 < num_records;
+            // Copy the next chunk of the concatenated prefix, text and newline.
+            size_t n = 0;
+            for (; n < chunk && offset < length; n++, offset++) {
+                if (offset < prefix.size()) {
+                    record.text[n] = prefix[offset];
+                } else if (offset < prefix.size() + text.size()) {
+                    record.text[n] = text[offset - prefix.size()];
+                } else {
+                    record.text[n] = '\n';
+                }
+            }
+            record.length = n;
+        }
+        ring.tail.store(tail + num_records, std::memory_order_release);
+        // If shutdown() stopped the writer after the check above, its final
+        // drain may have missed this message, so write it out here. The fence
+        // pairs with the one in shutdown() so at least one of them sees it.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!running_.load(std::memory_order_relaxed)) {
+            drain();
+            return;
+        }
+        if (severity <= Severity::kERROR) {
+            // Don't delay errors until the next poll.
+            wake_.notify_one();
+        }
+    }
+
+
+
+    void AsyncLogWriter::flush()
+    {
+        if (!running_.load(std::memory_order_acquire)) {
+            std::fflush(stdout);
+            std::fflush(stderr);
+            return;
+        }
+        const uint64_t request = flush_requests_.fetch_add(1) + 1;
+        wake_.notify_one();
+        std::unique_lock<std::mutex> lock (wake_mutex_);
+        flushed_.wait(lock, [&] {
+            return flushes_done_.load() >= request || !running_.load();
+        });
+    }
+
+
+
+    void AsyncLogWriter::shutdown()
+    {
+        if (!running_.exchange(false)) {
+            return;
+        }
+        wake_.notify_one();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        // Write any messages queued while the thread was stopping. Messages
+        // published after the fence are written by write() itself.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        drain();
+        flushed_.notify_all();
+    }
+
+
+
+    uint64_t AsyncLogWriter::dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+
+
+    void AsyncLogWriter::run()
+    {
+        // The polling interval while idle, doubled up to 16 ms for each idle
+        // poll.
+        std::chrono::milliseconds poll_interval (1);
+        while (true) {
+            const bool running = running_.load(std::memory_order_acquire);
+            const uint64_t flush_request = flush_requests_.load();
+            const bool wrote = drain();
+            if (flush_request > flushes_done_.load()) {
+                {
+                    std::lock_guard<std::mutex> lock (wake_mutex_);
+                    flushes_done_.store(flush_request);
+                }
+                flushed_.notify_all();
+            }
+            if (!running) {
+                // Messages written before running_ was cleared have been
+                // drained.
+                break;
+            }
+            if (wrote) {
+                poll_interval = std::chrono::milliseconds(1);
+            } else {
+                // Producers don't lock so poll while idle.
+                std::unique_lock<std::mutex> lock (wake_mutex_);
+                wake_.wait_for(lock, poll_interval);
+                poll_interval = std::min(2 * poll_interval, std::chrono::milliseconds(16));
+            }
+        }
+    }
+
+
+
+    bool AsyncLogWriter::drain()
+    {
+        std::vector<std::shared_ptr<LogRing>> rings;
+        {
+            std::lock_guard<std::mutex> lock (rings_mutex_);
+            // Remove the empty ring buffers of threads that have exited.
+            rings_.erase(std::remove_if(rings_.begin(), rings_.end(),
+                    [](const std::shared_ptr<LogRing>& r) {
+                        return r.use_count() == 1
+                            && r->head.load(std::memory_order_relaxed) == r->tail.load(std::memory_order_acquire);
+                    }), rings_.end());
+            rings = rings_;
+        }
+
+        std::lock_guard<std::mutex> lock (output_mutex_);
+        bool wrote = false;
+        for (const auto& ring : rings) {
+            const uint64_t head = ring->head.load(std::memory_order_relaxed);
+            const uint64_t tail = ring->tail.load(std::memory_order_acquire);
+            bool continuation = false;
+            for (uint64_t i = head; i < tail; i++) {
+                const LogRecord& record = ring->records[i % LogRing::capacity];
+                const Severity severity = static_cast<Severity>(record.severity);
+                std::string& out = is_stdout_severity(severity) ? stdout_buffer_ : stderr_buffer_;
+                if (!continuation) {
+                    // Only format the date and time once per second.
+                    const int64_t second = record.timestamp_ns / 1000000000;
+                    if (second != cached_second_) {
+                        const std::time_t t = second;
+                        std::tm tm_local;
+                        localtime_r(&t, &tm_local);
+                        char buffer[32];
+                        std::strftime(buffer, sizeof(buffer), "[%m/%d/%Y-%H:%M:%S] ", &tm_local);
+                        cached_timestamp_ = buffer;
+                        cached_second_ = second;
+                    }
+                    out += cached_timestamp_;
+                    out += severity_prefix(severity);
+                }
+                out.append(record.text, record.length);
+                continuation = record.continued;
+            }
+            ring->head.store(tail, std::memory_order_release);
+            wrote = wrote || tail > head;
+        }
+
+        const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped > reported_dropped_) {
+            stderr_buffer_ += "[W] Dropped " + std::to_string(dropped - reported_dropped_)
+                + " log messages\n";
+            reported_dropped_ = dropped;
+        }
+        if (!stdout_buffer_.empty()) {
+            std::fwrite(stdout_buffer_.data(), 1, stdout_buffer_.size(), stdout);
+            std::fflush(stdout);
+            stdout_buffer_.clear();
+        }
+        if (!stderr_buffer_.empty()) {
+            std::fwrite(stderr_buffer_.data(), 1, stderr_buffer_.size(), stderr);
+            std::fflush(stderr);
+            stderr_buffer_.clear();
+        }
+        return wrote;
+    }
+
+
+
+    LogRing& AsyncLogWriter::localRing()
+    {
+        if (!thread_ring) {
+            thread_ring = std::make_shared<LogRing>();
+            std::lock_guard<std::mutex> lock (rings_mutex_);
+            rings_.push_back(thread_ring);
+        }
+        return *thread_ring;
+    }
+} // namespace mr
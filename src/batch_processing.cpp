@@ -0,0 +1,486 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+#include <glob.h>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "maskrcnn_trt/batch_processing.hpp"
+#include "maskrcnn_trt/filesystem.hpp"
+#include "maskrcnn_trt/frame_source.hpp"
+#include "maskrcnn_trt/logger.hpp"
+#include "maskrcnn_trt/maskrcnn.hpp"
+#include "maskrcnn_trt/preprocessing.hpp"
+#include "maskrcnn_trt/temporal_maskrcnn.hpp"
+#include "maskrcnn_trt/trace.hpp"
+
+namespace mr {
+    /** Return whether filename has an extension of an image format supported
+     * by cv::imread().
+     */
+    static bool is_image_filename(const stdfs::path& filename)
+    {
+        static const char* extensions[] = {".bmp", ".jpeg", ".jpg", ".pgm",
+            ".png", ".ppm", ".tif", ".tiff", ".webp"};
+        std::string extension = filename.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                [](unsigned char c) { return std::tolower(c); });
+        return std::find(std::begin(extensions), std::end(extensions), extension)
+            != std::end(extensions);
+    }
+
+
+
+    std::vector<std::string> collect_image_filenames(const std::string& input)
+    {
+        std::vector<std::string> filenames;
+        std::error_code error;
+        if (stdfs::is_directory(input, error)) {
+            // Use the overloads taking an error code throughout since the
+            // others throw.
+            stdfs::recursive_directory_iterator it (input, error);
+            for (; !error && it != stdfs::recursive_directory_iterator(); it.increment(error)) {
+                std::error_code file_error;
+                if (stdfs::is_regular_file(it->path(), file_error) && is_image_filename(it->path())) {
+                    filenames.push_back(it->path().string());
+                }
+            }
+            if (error) {
+                MR_LOG_ERROR << "Error: Could not list directory " << input << ": "
+                    << error.message() << std::endl;
+                return std::vector<std::string>();
+            }
+            std::sort(filenames.begin(), filenames.end());
+        } else if (input.find_first_of("*?[") != std::string::npos) {
+            glob_t matches;
+            const int status = glob(input.c_str(), 0, nullptr, &matches);
+            if (status == 0) {
+                filenames.assign(matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+            }
+            globfree(&matches);
+            if (status != 0 && status != GLOB_NOMATCH) {
+                MR_LOG_ERROR << "Error: Could not expand " << input << std::endl;
+            }
+        } else {
+            std::ifstream f (input);
+            if (!f.good()) {
+                MR_LOG_ERROR << "Error: Could not open " << input << std::endl;
+                return std::vector<std::string>();
+            }
+            std::string line;
+            while (std::getline(f, line)) {
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                if (!line.empty()) {
+                    filenames.push_back(line);
+                }
+            }
+        }
+        return filenames;
+    }
+
+
+
+    ImagePrefetcher::ImagePrefetcher(std::vector<std::string> filenames,
+                                     size_t                   num_threads,
+                                     size_t                   max_ahead,
+                                     Decoder                  decoder)
+        : filenames_(std::move(filenames)), decoder_(std::move(decoder)),
+          slots_(std::max<size_t>(max_ahead, 1)), ready_(slots_.size(), false)
+    {
+        if (!decoder_) {
+            decoder_ = read_image;
+        }
+        for (size_t i = 0; i < std::max<size_t>(num_threads, 1); i++) {
+            threads_.emplace_back(&ImagePrefetcher::decode, this);
+        }
+    }
+
+
+
+    ImagePrefetcher::~ImagePrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex_);
+            stop_ = true;
+        }
+        decoder_cv_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+
+
+    bool ImagePrefetcher::next(DecodedImage& image)
+    {
+        std::unique_lock<std::mutex> lock (mutex_);
+        if (next_consume_ >= filenames_.size()) {
+            return false;
+        }
+        const size_t slot = next_consume_ % slots_.size();
+        consumer_cv_.wait(lock, [&] { return ready_[slot]; });
+        image = std::move(slots_[slot]);
+        slots_[slot] = DecodedImage();
+        ready_[slot] = false;
+        next_consume_++;
+        // The slot can now be used by the image max_ahead after this one.
+        decoder_cv_.notify_one();
+        return true;
+    }
+
+
+
+    void ImagePrefetcher::decode()
+    {
+        std::unique_lock<std::mutex> lock (mutex_);
+        while (true) {
+            decoder_cv_.wait(lock, [this] {
+                    return stop_ || next_decode_ >= filenames_.size()
+                        || next_decode_ < next_consume_ + slots_.size();
+                });
+            if (stop_ || next_decode_ >= filenames_.size()) {
+                return;
+            }
+            const size_t i = next_decode_++;
+            lock.unlock();
+            DecodedImage image;
+            image.filename = filenames_[i];
+            {
+                MR_TRACE_SPAN("decode");
+                image.image = decoder_(image.filename, image.original_size);
+            }
+            lock.lock();
+            const size_t slot = i % slots_.size();
+            slots_[slot] = std::move(image);
+            ready_[slot] = true;
+            consumer_cv_.notify_one();
+        }
+    }
+
+
+
+    /** Write s to os as a JSON string.
+     */
+    static void write_json_string(std::ostream& os, const std::string& s)
+    {
+        os << '"';
+        for (const char c : s) {
+            if (c == '"' || c == '\\') {
+                os << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                const char* hex = "0123456789abcdef";
+                os << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+            } else {
+                os << c;
+            }
+        }
+        os << '"';
+    }
+
+
+
+    /** Format the detections of an image as a line of JSON.
+     */
+    static std::string format_result(uint64_t                      frame,
+                                     const std::string&            image_filename,
+                                     cv::Size                      image_size,
+                                     const std::vector<Detection>& detections,
+                                     const std::string&            error)
+    {
+        std::ostringstream os;
+        os << "{\"frame\":" << frame;
+        if (!image_filename.empty()) {
+            os << ",\"image\":";
+            write_json_string(os, image_filename);
+        }
+        if (!error.empty() || image_size.empty()) {
+            os << ",\"error\":";
+            write_json_string(os, error.empty() ? "could not decode image" : error);
+            os << "}\n";
+            return os.str();
+        }
+        os << ",\"width\":" << image_size.width << ",\"height\":" << image_size.height
+            << ",\"detections\":[";
+        for (size_t i = 0; i < detections.size(); i++) {
+            const Detection& d = detections[i];
+            os << (i > 0 ? "," : "") << "{";
+            if (d.track_id >= 0) {
+                os << "\"track_id\":" << d.track_id << ",";
+            }
+            os << "\"class_id\":" << d.class_id << ",\"class\":";
+            write_json_string(os, MaskRCNNConfig::class_names[d.class_id]);
+            os << ",\"confidence\":" << d.confidence
+                << ",\"box\":[" << d.x_start << "," << d.y_start << ","
+                << d.x_end << "," << d.y_end << "]}";
+        }
+        os << "]}\n";
+        return os.str();
+    }
+
+
+
+    ResultWriter::~ResultWriter()
+    {
+        close();
+    }
+
+
+
+    bool ResultWriter::open(const std::string& filename,
+                            size_t             num_threads,
+                            size_t             max_pending,
+                            const std::string& visualization_directory)
+    {
+        close();
+        if (!visualization_directory.empty()) {
+            std::error_code error;
+            stdfs::create_directories(visualization_directory, error);
+            if (error) {
+                MR_LOG_ERROR << "Error: Could not create directory " << visualization_directory
+                    << ": " << error.message() << std::endl;
+                return false;
+            }
+        }
+        file_.open(filename);
+        if (!file_.good()) {
+            MR_LOG_ERROR << "Error: Could not open " << filename << " for writing" << std::endl;
+            return false;
+        }
+        visualization_directory_ = visualization_directory;
+        max_pending_ = std::max<size_t>(max_pending, 1);
+        next_sequence_ = 0;
+        next_line_ = 0;
+        failed_ = false;
+        stop_ = false;
+        for (size_t i = 0; i < std::max<size_t>(num_threads, 1); i++) {
+            threads_.emplace_back(&ResultWriter::write, this);
+        }
+        return true;
+    }
+
+
+
+    void ResultWriter::add(const std::string&     image_filename,
+                           cv::Size               image_size,
+                           std::vector<Detection> detections,
+                           cv::Mat                image)
+    {
+        push({0, image_filename, image_size, std::move(image), std::move(detections), ""});
+    }
+
+
+
+    void ResultWriter::addError(const std::string& image_filename, const std::string& error)
+    {
+        push({0, image_filename, cv::Size(), cv::Mat(), std::vector<Detection>(), error});
+    }
+
+
+
+    void ResultWriter::push(Task task)
+    {
+        std::unique_lock<std::mutex> lock (mutex_);
+        space_cv_.wait(lock, [this] { return tasks_.size() < max_pending_; });
+        task.sequence = next_sequence_++;
+        tasks_.push_back(std::move(task));
+        task_cv_.notify_one();
+    }
+
+
+
+    bool ResultWriter::close()
+    {
+        if (threads_.empty()) {
+            return !failed_;
+        }
+        {
+            std::lock_guard<std::mutex> lock (mutex_);
+            stop_ = true;
+        }
+        task_cv_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+        threads_.clear();
+        file_.close();
+        if (file_.fail()) {
+            MR_LOG_ERROR << "Error: Could not write the detections" << std::endl;
+            failed_ = true;
+        }
+        return !failed_;
+    }
+
+
+
+    void ResultWriter::write()
+    {
+        std::unique_lock<std::mutex> lock (mutex_);
+        while (true) {
+            task_cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;
+            }
+            Task task = std::move(tasks_.front());
+            tasks_.pop_front();
+            space_cv_.notify_one();
+            lock.unlock();
+
+            bool success = true;
+            if (!visualization_directory_.empty() && !task.image.empty()) {
+                MR_TRACE_SPAN("encode");
+                char frame_name[32];
+                snprintf(frame_name, sizeof(frame_name), "%08llu",
+                        static_cast<unsigned long long>(task.sequence));
+                // Prefix the stem with the index since images in different
+                // directories may have the same name.
+                const std::string name = task.image_filename.empty() ? frame_name
+                    : frame_name + ("_" + stdfs::path(task.image_filename).stem().string());
+                const stdfs::path filename = stdfs::path(visualization_directory_)
+                    / (name + ".detections.png");
+                // The detections are in full-resolution coordinates.
+                if (task.image.size() != task.image_size) {
+                    cv::resize(task.image, task.image, task.image_size);
+                }
+                render_detections(task.detections, task.image);
+                success = cv::imwrite(filename.string(), task.image);
+                if (!success) {
+                    MR_LOG_ERROR << "Error: Could not save detection visualization in "
+                        << filename.string() << std::endl;
+                }
+            }
+            std::string line = format_result(task.sequence, task.image_filename,
+                    task.image_size, task.detections, task.error);
+
+            lock.lock();
+            failed_ = failed_ || !success;
+            lines_.emplace(task.sequence, std::move(line));
+            // Write the lines that are next in order, including any finished
+            // earlier by other threads.
+            for (auto it = lines_.begin(); it != lines_.end() && it->first == next_line_;
+                    it = lines_.erase(it)) {
+                file_ << it->second;
+                next_line_++;
+            }
+        }
+    }
+
+
+
+    BatchSummary process_batch(MaskRCNN&                       network,
+                               const std::vector<std::string>& filenames,
+                               const BatchOptions&             options)
+    {
+        BatchSummary summary;
+        ResultWriter writer;
+        if (!writer.open(options.output_filename, options.num_writers,
+                    options.max_prefetch, options.visualization_directory)) {
+            return summary;
+        }
+        const bool visualize = !options.visualization_directory.empty();
+        const auto start = std::chrono::steady_clock::now();
+        ImagePrefetcher prefetcher (filenames, options.num_decoders,
+                options.max_prefetch, options.decoder);
+        DecodedImage decoded;
+        while (prefetcher.next(decoded)) {
+            summary.images++;
+            if (decoded.image.empty()) {
+                MR_LOG_ERROR << "Error: Could not decode " << decoded.filename << std::endl;
+                summary.failed++;
+                writer.addError(decoded.filename, "could not decode image");
+            } else {
+                // Run inference on a batch of one image since only the batch
+                // version tells failures apart from images without
+                // detections.
+                std::vector<std::vector<Detection>> batch_detections = network.infer(
+                        std::vector<cv::Mat>{decoded.image}, true,
+                        std::vector<cv::Size>{decoded.original_size});
+                if (batch_detections.empty()) {
+                    summary.failed_inference++;
+                    writer.addError(decoded.filename, "inference failed");
+                } else {
+                    writer.add(decoded.filename, decoded.original_size,
+                            std::move(batch_detections.front()),
+                            visualize ? std::move(decoded.image) : cv::Mat());
+                }
+            }
+            if (summary.images % 1000 == 0) {
+                MR_LOG_INFO << "Processed " << summary.images << "/" << filenames.size()
+                    << " images" << std::endl;
+            }
+        }
+        summary.written = writer.close();
+        summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return summary;
+    }
+
+
+
+    BatchSummary process_stream(MaskRCNN&           network,
+                                FrameSource&        source,
+                                const BatchOptions& options)
+    {
+        BatchSummary summary;
+        ResultWriter writer;
+        if (!writer.open(options.output_filename, options.num_writers,
+                    options.max_prefetch, options.visualization_directory)) {
+            return summary;
+        }
+        const bool visualize = !options.visualization_directory.empty();
+        KeyframeConfig keyframes;
+        keyframes.stride = options.keyframe_stride;
+        keyframes.adaptive = options.adaptive_keyframes;
+        keyframes.motion_gate = options.motion_threshold > 0.0f;
+        keyframes.motion.threshold = options.motion_threshold;
+        keyframes.optical_flow = options.optical_flow;
+        const bool temporal = keyframes.stride > 1 || keyframes.motion_gate;
+        TemporalMaskRCNN temporal_network (network, keyframes);
+        const auto start = std::chrono::steady_clock::now();
+        cv::Mat frame;
+        while (source.read(frame)) {
+            summary.images++;
+            std::vector<Detection> detections;
+            bool inferred = true;
+            if (temporal) {
+                detections = temporal_network.process(frame, source.bgrOrder());
+                inferred = !temporal_network.lastFailed();
+            } else {
+                std::vector<std::vector<Detection>> batch_detections
+                    = network.infer(std::vector<cv::Mat>{frame}, source.bgrOrder());
+                inferred = !batch_detections.empty();
+                if (inferred) {
+                    detections = std::move(batch_detections.front());
+                }
+            }
+            if (!inferred) {
+                summary.failed_inference++;
+                writer.addError("", "inference failed");
+            } else {
+                // The visualizations are saved in BGR order.
+                if (visualize && !source.bgrOrder()) {
+                    cv::cvtColor(frame, frame, cv::COLOR_RGB2BGR);
+                }
+                const cv::Size frame_size = frame.size();
+                writer.add("", frame_size, std::move(detections),
+                        visualize ? std::move(frame) : cv::Mat());
+            }
+            if (summary.images % 1000 == 0) {
+                MR_LOG_INFO << "Processed " << summary.images << " frames" << std::endl;
+            }
+        }
+        summary.written = writer.close();
+        summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        summary.skipped = temporal_network.motionGateStats().skipped;
+        summary.source_failed = source.failed();
+        return summary;
+    }
+} // namespace mr
@@ -0,0 +1,158 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "maskrcnn_trt/batching_scheduler.hpp"
+#include "maskrcnn_trt/maskrcnn.hpp"
+
+namespace mr {
+    BatchingScheduler::BatchingScheduler(MaskRCNN&                 network,
+                                         int                       max_batch_size,
+                                         std::chrono::microseconds max_delay,
+                                         bool                      in_bgr_order)
+        : BatchingScheduler(
+                [&network, in_bgr_order](const std::vector<cv::Mat>& images) {
+                    return network.infer(images, in_bgr_order);
+                },
+                std::min(max_batch_size, network.config().max_batch_size), max_delay)
+    {
+    }
+
+
+
+    BatchingScheduler::BatchingScheduler(InferenceFunction         infer,
+                                         int                       max_batch_size,
+                                         std::chrono::microseconds max_delay)
+        : infer_(std::move(infer)),
+          max_batch_size_(std::max(max_batch_size, 1)),
+          max_delay_(max_delay),
+          queue_depth_histogram_(4 * max_batch_size_ + 1, 0),
+          batch_size_histogram_(max_batch_size_ + 1, 0)
+    {
+        dispatcher_ = std::thread(&BatchingScheduler::dispatch, this);
+    }
+
+
+
+    BatchingScheduler::~BatchingScheduler()
+    {
+        shutdown();
+    }
+
+
+
+    std::future<std::vector<Detection>> BatchingScheduler::submit(const cv::Mat& image)
+    {
+        Request request {image, Clock::now() + max_delay_, std::promise<std::vector<Detection>>()};
+        std::future<std::vector<Detection>> future = request.promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock (mutex_);
+            if (stop_) {
+                request.promise.set_exception(std::make_exception_ptr(
+                        std::runtime_error("The batching scheduler has been shut down")));
+                return future;
+            }
+            queue_.push_back(std::move(request));
+        }
+        // Wake up the dispatcher either to start waiting for the deadline of
+        // the new oldest request or to dispatch a full batch.
+        cv_.notify_one();
+        return future;
+    }
+
+
+
+    void BatchingScheduler::shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        if (dispatcher_.joinable()) {
+            dispatcher_.join();
+        }
+    }
+
+
+
+    size_t BatchingScheduler::queueDepth() const
+    {
+        std::lock_guard<std::mutex> lock (mutex_);
+        return queue_.size();
+    }
+
+
+
+    BatchingScheduler::Stats BatchingScheduler::stats() const
+    {
+        std::lock_guard<std::mutex> lock (mutex_);
+        Stats s;
+        s.queue_depth = queue_.size();
+        s.queue_depth_histogram = queue_depth_histogram_;
+        s.batch_size_histogram = batch_size_histogram_;
+        return s;
+    }
+
+
+
+    void BatchingScheduler::dispatch()
+    {
+        std::unique_lock<std::mutex> lock (mutex_);
+        while (true) {
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                // Stopped with nothing left to dispatch.
+                return;
+            }
+            // Wait until the batch is full or the oldest request is due.
+            // Remaining requests are dispatched immediately when stopping.
+            const Clock::time_point deadline = queue_.front().deadline;
+            cv_.wait_until(lock, deadline,
+                    [this] { return stop_ || queue_.size() >= max_batch_size_; });
+
+            // Form the batch from the oldest requests.
+            const size_t queue_depth = queue_.size();
+            const size_t batch_size = std::min(queue_depth, max_batch_size_);
+            queue_depth_histogram_[std::min(queue_depth, queue_depth_histogram_.size() - 1)]++;
+            batch_size_histogram_[batch_size]++;
+            std::vector<Request> batch;
+            batch.reserve(batch_size);
+            for (size_t i = 0; i < batch_size; i++) {
+                batch.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+
+            // Run inference without holding the lock so that new requests can
+            // be queued in the meantime.
+            lock.unlock();
+            std::vector<cv::Mat> images;
+            images.reserve(batch.size());
+            for (const auto& request : batch) {
+                images.push_back(request.image);
+            }
+            std::vector<std::vector<Detection>> detections;
+            try {
+                detections = infer_(images);
+            } catch (...) {
+                // Keep dispatching and let the submitters handle the error.
+                const std::exception_ptr error = std::current_exception();
+                for (auto& request : batch) {
+                    request.promise.set_exception(error);
+                }
+                lock.lock();
+                continue;
+            }
+            const bool success = detections.size() == batch.size();
+            for (size_t i = 0; i < batch.size(); i++) {
+                batch[i].promise.set_value(success
+                        ? std::move(detections[i]) : std::vector<Detection>());
+            }
+            lock.lock();
+        }
+    }
+} // namespace mr
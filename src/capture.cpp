@@ -0,0 +1,302 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <chrono>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "maskrcnn_trt/capture.hpp"
+#include "maskrcnn_trt/logger.hpp"
+#include "maskrcnn_trt/maskrcnn_config.hpp"
+
+namespace mr {
+    /** The header at the start of both capture files.
+     */
+    struct CaptureHeader {
+        char magic[8] = {'M', 'R', 'C', 'A', 'P', 'T', 'U', 'R'};
+        uint32_t version = 1;
+        /** 0 for the data file, 1 for the index file.
+         */
+        uint32_t type = 0;
+        uint64_t detection_volume = MaskRCNNConfig::model_detection_volume;
+        uint64_t mask_volume = MaskRCNNConfig::model_mask_volume;
+        uint8_t padding[32] = {};
+    };
+
+    static_assert(sizeof(CaptureHeader) == 64, "The capture header must be 64 bytes");
+    static_assert(sizeof(CaptureIndexEntry) == 40, "The capture index entry must be 40 bytes");
+
+    /** Records start at multiples of this many bytes.
+     */
+    static constexpr size_t record_alignment = 64;
+
+    static constexpr size_t record_data_size
+        = (MaskRCNNConfig::model_detection_volume + MaskRCNNConfig::model_mask_volume) * sizeof(float);
+
+    static constexpr size_t record_size
+        = (record_data_size + record_alignment - 1) / record_alignment * record_alignment;
+
+
+
+    /** Ensure the header has the expected magic, type and buffer sizes.
+     */
+    static bool valid_header(const CaptureHeader& header, uint32_t type)
+    {
+        const CaptureHeader expected;
+        return memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0
+            && header.version == expected.version
+            && header.type == type
+            && header.detection_volume == expected.detection_volume
+            && header.mask_volume == expected.mask_volume;
+    }
+
+
+
+    /** Write the whole buffer to fd, retrying on partial writes.
+     */
+    static bool write_all(int fd, const void* buffer, size_t size)
+    {
+        const uint8_t* data = static_cast<const uint8_t*>(buffer);
+        while (size > 0) {
+            const ssize_t written = ::write(fd, data, size);
+            if (written < 0) {
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+
+
+    /** Open a capture file for appending, writing a header if it's empty.
+     * Return the file descriptor and the file size or -1 on error.
+     */
+    static int open_append(const std::string& filename, uint32_t type, uint64_t& size)
+    {
+        const int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            return -1;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        CaptureHeader header;
+        if (st.st_size == 0) {
+            header.type = type;
+            if (!write_all(fd, &header, sizeof(header))) {
+                ::close(fd);
+                return -1;
+            }
+            size = sizeof(header);
+        } else {
+            if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+                    || !valid_header(header, type)) {
+                ::close(fd);
+                return -1;
+            }
+            size = st.st_size;
+        }
+        return fd;
+    }
+
+
+
+    /** Map a whole capture file read-only and validate its header. Return
+     * nullptr on error.
+     */
+    static const uint8_t* map_file(const std::string& filename, uint32_t type, size_t& size)
+    {
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CaptureHeader)) {
+            ::close(fd);
+            return nullptr;
+        }
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        // The mapping remains valid after closing the file.
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            return nullptr;
+        }
+        if (!valid_header(*static_cast<const CaptureHeader*>(data), type)) {
+            munmap(data, st.st_size);
+            return nullptr;
+        }
+        size = st.st_size;
+        return static_cast<const uint8_t*>(data);
+    }
+
+
+
+    CaptureWriter::~CaptureWriter()
+    {
+        close();
+    }
+
+
+
+    bool CaptureWriter::open(const std::string& filename)
+    {
+        std::lock_guard<std::mutex> lock (mutex_);
+        closeFiles();
+        uint64_t index_size = 0;
+        data_fd_ = open_append(filename, 0, data_size_);
+        index_fd_ = open_append(filename + ".idx", 1, index_size);
+        if (data_fd_ < 0 || index_fd_ < 0) {
+            closeFiles();
+            return false;
+        }
+        return true;
+    }
+
+
+
+    bool CaptureWriter::write(uint64_t     frame_id,
+                              cv::Size     image_size,
+                              bool         triggered,
+                              const float* detection_buffer,
+                              const float* mask_buffer)
+    {
+        std::lock_guard<std::mutex> lock (mutex_);
+        if (data_fd_ < 0) {
+            return false;
+        }
+        CaptureIndexEntry entry;
+        entry.frame_id = frame_id;
+        entry.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        // Pad the file so that the record is aligned.
+        entry.offset = (data_size_ + record_alignment - 1) / record_alignment * record_alignment;
+        entry.image_width = image_size.width;
+        entry.image_height = image_size.height;
+        entry.triggered = triggered;
+        const uint8_t padding[record_alignment] = {};
+        const size_t padding_size = entry.offset - data_size_;
+        const size_t tail_size = record_size - record_data_size;
+        if (!write_all(data_fd_, padding, padding_size)
+                || !write_all(data_fd_, detection_buffer, MaskRCNNConfig::model_detection_volume * sizeof(float))
+                || !write_all(data_fd_, mask_buffer, MaskRCNNConfig::model_mask_volume * sizeof(float))
+                || !write_all(data_fd_, padding, tail_size)) {
+            // Resynchronize with whatever part of the record was written.
+            data_size_ = lseek(data_fd_, 0, SEEK_END);
+            return false;
+        }
+        data_size_ = entry.offset + record_size;
+        // Only index the record once its data is complete.
+        return write_all(index_fd_, &entry, sizeof(entry));
+    }
+
+
+
+    void CaptureWriter::close()
+    {
+        std::lock_guard<std::mutex> lock (mutex_);
+        closeFiles();
+    }
+
+
+
+    void CaptureWriter::closeFiles()
+    {
+        if (data_fd_ >= 0) {
+            ::close(data_fd_);
+            data_fd_ = -1;
+        }
+        if (index_fd_ >= 0) {
+            ::close(index_fd_);
+            index_fd_ = -1;
+        }
+    }
+
+
+
+    CaptureReader::~CaptureReader()
+    {
+        close();
+    }
+
+
+
+    bool CaptureReader::open(const std::string& filename)
+    {
+        close();
+        data_ = map_file(filename, 0, data_size_);
+        index_ = map_file(filename + ".idx", 1, index_size_);
+        if (!data_ || !index_) {
+            close();
+            return false;
+        }
+        // Validate every entry so that record() never points outside the
+        // data file. Records are indexed once their data is complete, so only
+        // trailing records may extend past the end of a truncated data file
+        // and they are ignored.
+        const size_t num_entries = (index_size_ - sizeof(CaptureHeader)) / sizeof(CaptureIndexEntry);
+        bool truncated = false;
+        for (size_t i = 0; i < num_entries; i++) {
+            CaptureIndexEntry entry;
+            memcpy(&entry, index_ + sizeof(CaptureHeader) + i * sizeof(CaptureIndexEntry), sizeof(entry));
+            const bool complete = entry.offset <= data_size_ && record_size <= data_size_ - entry.offset;
+            if (entry.offset < sizeof(CaptureHeader) || entry.offset % record_alignment != 0
+                    || (complete && truncated)) {
+                MR_LOG_ERROR << "Error: Invalid entry " << i << " in the capture index "
+                    << filename << ".idx" << std::endl;
+                close();
+                return false;
+            }
+            truncated = truncated || !complete;
+            if (!truncated) {
+                num_records_ = i + 1;
+            }
+        }
+        return true;
+    }
+
+
+
+    size_t CaptureReader::size() const
+    {
+        return num_records_;
+    }
+
+
+
+    CaptureRecord CaptureReader::record(size_t index) const
+    {
+        CaptureRecord record;
+        memcpy(&record.metadata, index_ + sizeof(CaptureHeader) + index * sizeof(CaptureIndexEntry),
+                sizeof(CaptureIndexEntry));
+        const float* data = reinterpret_cast<const float*>(data_ + record.metadata.offset);
+        record.detection_buffer = data;
+        record.mask_buffer = data + MaskRCNNConfig::model_detection_volume;
+        return record;
+    }
+
+
+
+    void CaptureReader::close()
+    {
+        if (data_) {
+            munmap(const_cast<uint8_t*>(data_), data_size_);
+            data_ = nullptr;
+        }
+        if (index_) {
+            munmap(const_cast<uint8_t*>(index_), index_size_);
+            index_ = nullptr;
+        }
+        data_size_ = 0;
+        index_size_ = 0;
+        num_records_ = 0;
+    }
+} // namespace mr
@@ -3,11 +3,18 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
 
 #include <opencv2/imgproc.hpp>
 
 #include "maskrcnn_trt/detection.hpp"
+#include "maskrcnn_trt/logger.hpp"
 #include "maskrcnn_trt/maskrcnn_config.hpp"
+#include "maskrcnn_trt/probes.hpp"
 
 namespace mr {
     /** A detection as stored in host memory.
@@ -46,7 +53,23 @@ namespace mr {
                                           const void* detection_buffer,
                                           const void* mask_buffer)
     {
+        std::vector<int> raw_indices;
+        std::vector<Detection> detections = get_detection_boxes(input_width,
+                input_height, detection_buffer, raw_indices);
+        get_detection_masks(detections, raw_indices, input_width, input_height, mask_buffer);
+        return detections;
+    }
+
+
+
+    std::vector<Detection> get_detection_boxes(int               input_width,
+                                               int               input_height,
+                                               const void*       detection_buffer,
+                                               std::vector<int>& raw_indices)
+    {
+        MR_PROBE2(boxes_start, input_width, input_height);
         std::vector<Detection> detections;
+        raw_indices.clear();
 
         const int net_width = MaskRCNNConfig::model_input_shape[2];
         const int net_height = MaskRCNNConfig::model_input_shape[1];
@@ -65,10 +88,9 @@ namespace mr {
         float final_ratio_x = (float) input_width / window_width;
         float final_ratio_y = (float) input_height / window_height;
 
-        // There is no image offset since we assume a batch size of 1 so
-        // inference is run on a single image.
+        // The buffer is expected to point to the data of a single image, see
+        // get_batch_detections() for the batch offsets.
         const RawDetection* raw_detections = reinterpret_cast<const RawDetection*>(detection_buffer);
-        const RawMask* raw_masks = reinterpret_cast<const RawMask*>(mask_buffer);
         // Loop over all possible detections.
         for (int d = 0; d < MaskRCNNConfig::detection_max_instances; d++) {
             const RawDetection raw_detection = raw_detections[d];
@@ -88,55 +110,249 @@ namespace mr {
                 continue;
             }
 
-            Detection detection = {class_id, raw_detection.confidence, x_start, y_start, x_end, y_end};
+            detections.push_back({class_id, raw_detection.confidence, x_start, y_start, x_end, y_end, cv::Mat(), false, -1});
+            raw_indices.push_back(d);
+        }
+        MR_PROBE1(boxes_done, detections.size());
+        return detections;
+    }
+
 
+
+    size_t get_detection_masks(std::vector<Detection>& detections,
+                               const std::vector<int>& raw_indices,
+                               int                     input_width,
+                               int                     input_height,
+                               const void*             mask_buffer,
+                               size_t                  max_mask_bytes)
+    {
+        MR_PROBE1(masks_start, detections.size());
+        // Fall back to box-local masks if the full-image ones would exceed the
+        // limit.
+        const size_t full_mask_bytes = static_cast<size_t>(input_width) * input_height;
+        const bool box_local = max_mask_bytes > 0
+            && detections.size() * full_mask_bytes > max_mask_bytes;
+        size_t mask_bytes = 0;
+        // The buffer is expected to point to the data of a single image, see
+        // get_batch_detections() for the batch offsets.
+        const RawMask* raw_masks = reinterpret_cast<const RawMask*>(mask_buffer);
+        for (size_t i = 0; i < detections.size(); i++) {
+            Detection& detection = detections[i];
+            detection.box_local_mask = box_local;
+            // Boxes less than a pixel wide or tall have an empty mask.
+            const int box_width = detection.x_end - detection.x_start;
+            const int box_height = detection.y_end - detection.y_start;
+            const size_t bytes = box_local
+                ? static_cast<size_t>(std::max(box_width, 0)) * std::max(box_height, 0)
+                : full_mask_bytes;
+            if (max_mask_bytes > 0 && mask_bytes + bytes > max_mask_bytes) {
+                // Leave the mask empty, as for all following detections
+                // since the detections are sorted by decreasing confidence.
+                continue;
+            }
+            mask_bytes += bytes;
+            // Initialize a mask for the whole input image or the bounding box.
+            if (box_local) {
+                detection.mask = cv::Mat(std::max(box_height, 0), std::max(box_width, 0), CV_8UC1);
+            } else {
+                detection.mask = cv::Mat(input_height, input_width, CV_8UC1, cv::Scalar(0));
+            }
+            if (box_width <= 0 || box_height <= 0) {
+                continue;
+            }
             // Initialize a mask from the raw data.
-            RawMask* raw_mask_data = (RawMask*) raw_masks + d * MaskRCNNConfig::num_classes + class_id;
+            RawMask* raw_mask_data = (RawMask*) raw_masks + raw_indices[i] * MaskRCNNConfig::num_classes + detection.class_id;
             cv::Mat raw_mask (2 * MaskRCNNConfig::mask_pool_size, 2 * MaskRCNNConfig::mask_pool_size, CV_32FC1, raw_mask_data);
             // Convert the float mask to an int mask.
             cv::Mat int_mask;
             raw_mask.convertTo(int_mask, CV_8UC1, UINT8_MAX);
-            // Resize the mask to the bounding box dimensions.
-            cv::Mat box_mask;
-            const int box_width = detection.x_end - detection.x_start;
-            const int box_height = detection.y_end - detection.y_start;
-            cv::resize(int_mask, box_mask, cv::Size(box_width, box_height));
-            // Initialize a mask for the whole input image.
-            detection.mask = cv::Mat(input_height, input_width, CV_8UC1, cv::Scalar(0));
             // Get the ROI of the bounding box portion of the whole image mask
-            // and copy the mask there.
-            cv::Rect roi (x_start, y_start, box_width, box_height);
-            cv::Mat mask_roi = detection.mask(roi);
-            box_mask.copyTo(mask_roi);
+            // and resize the mask directly into it.
+            cv::Mat mask_roi = box_local ? detection.mask
+                : detection.mask(cv::Rect(detection.x_start, detection.y_start, box_width, box_height));
+            cv::resize(int_mask, mask_roi, mask_roi.size());
+        }
+        MR_PROBE1(masks_done, detections.size());
+        return mask_bytes;
+    }
 
-            detections.push_back(detection);
+
+
+    std::vector<std::vector<Detection>> get_batch_detections(
+            const std::vector<cv::Size>& input_sizes,
+            const void*                  detection_buffer,
+            const void*                  mask_buffer)
+    {
+        std::vector<std::vector<Detection>> batch_detections;
+        batch_detections.reserve(input_sizes.size());
+        const float* detection_data = static_cast<const float*>(detection_buffer);
+        const float* mask_data = static_cast<const float*>(mask_buffer);
+        for (size_t i = 0; i < input_sizes.size(); i++) {
+            // Each image of the batch occupies a contiguous slice of each
+            // buffer.
+            const float* image_detection_data = detection_data + i * MaskRCNNConfig::model_detection_volume;
+            const float* image_mask_data = mask_data + i * MaskRCNNConfig::model_mask_volume;
+            batch_detections.push_back(get_detections(input_sizes[i].width,
+                        input_sizes[i].height, image_detection_data, image_mask_data));
         }
-        return detections;
+        return batch_detections;
     }
 
 
 
-    cv::Mat visualize_detections(const std::vector<Detection>& detections,
-                                 const cv::Mat&                image)
+    /** Lookup tables blending an 8-bit channel value with a class colour.
+     * Element [c][i][v] is channel i (in BGR order) of value v blended with
+     * the colour of class c.
+     */
+    typedef std::array<std::array<std::array<uint8_t, 256>, 3>, MaskRCNNConfig::num_classes> BlendLUTs;
+
+    static const BlendLUTs& blend_luts()
     {
-        cv::Mat render = image.clone();
+        static const BlendLUTs luts = []() {
+            BlendLUTs l;
+            constexpr float alpha = MaskRCNNConfig::mask_threshold;
+            for (int c = 0; c < MaskRCNNConfig::num_classes; c++) {
+                for (int i = 0; i < 3; i++) {
+                    // The class colours are in RGB order.
+                    const float colour = MaskRCNNConfig::class_colours[c][2 - i];
+                    for (int v = 0; v < 256; v++) {
+                        // Same computation and rounding as cv::addWeighted().
+                        l[c][i][v] = cv::saturate_cast<uint8_t>(v * (1.0f - alpha) + colour * alpha);
+                    }
+                }
+            }
+            return l;
+        }();
+        return luts;
+    }
+
+
+
+    /** Blend the class colour into the pixels of render where the mask of
+     * detection d is set. Only the part of the bounding box of the detection
+     * inside the rows of render in the range [row_start, row_end) is visited.
+     */
+    static void blend_mask(const Detection& d, cv::Mat& render, int row_start, int row_end)
+    {
+        // The pixel of render corresponding to the top left mask pixel.
+        const cv::Point mask_origin = d.box_local_mask
+            ? cv::Point(d.x_start, d.y_start) : cv::Point(0, 0);
+        // Full-image masks are zero outside the bounding box, see
+        // get_detection_masks().
+        cv::Rect roi = d.box_local_mask
+            ? cv::Rect(mask_origin, d.mask.size())
+            : cv::Rect(d.x_start, d.y_start, d.x_end - d.x_start, d.y_end - d.y_start);
+        roi &= cv::Rect(mask_origin, d.mask.size());
+        roi &= cv::Rect(0, row_start, render.cols, row_end - row_start);
+        const auto& lut = blend_luts()[d.class_id];
+        for (int y = roi.y; y < roi.y + roi.height; y++) {
+            const uint8_t* mask_row = d.mask.ptr<uint8_t>(y - mask_origin.y) + roi.x - mask_origin.x;
+            uint8_t* render_row = render.ptr<uint8_t>(y) + 3 * roi.x;
+            for (int x = 0; x < roi.width; x++) {
+                // Binarize the mask at half its range.
+                if (mask_row[x] > UINT8_MAX / 2) {
+                    uint8_t* p = render_row + 3 * x;
+                    p[0] = lut[0][p[0]];
+                    p[1] = lut[1][p[1]];
+                    p[2] = lut[2][p[2]];
+                }
+            }
+        }
+    }
+
+
+
+    /** The label of a detection, rasterized once and reused for all
+     * detections with the same class and displayed confidence.
+     */
+    struct LabelGlyph {
+        /** Non-zero where the text is drawn.
+         */
+        cv::Mat mask;
+        /** The position of the text origin in mask.
+         */
+        cv::Point origin;
+    };
+
+    /** Return the glyph of a label with the given class ID and confidence.
+     * The confidence is displayed with 2 decimal digits so there are at most
+     * 101 glyphs per class.
+     */
+    static LabelGlyph label_glyph(int class_id, float confidence)
+    {
+        static std::mutex mutex;
+        static std::unordered_map<int, LabelGlyph> glyphs;
+        // Match the rounding of std::to_string() to 6 decimal digits, which
+        // the confidence used to be truncated from.
+        const int bucket = std::clamp<long>(std::lround(confidence * 1e6) / 10000, 0, 100);
+        const int key = class_id * 101 + bucket;
+        std::lock_guard<std::mutex> lock (mutex);
+        const auto it = glyphs.find(key);
+        if (it != glyphs.end()) {
+            return it->second;
+        }
+        char confidence_str[8];
+        snprintf(confidence_str, sizeof(confidence_str), "%d.%02d", bucket / 100, bucket % 100);
+        const std::string label = MaskRCNNConfig::class_names[class_id] + " " + confidence_str;
+        constexpr int font = cv::FONT_HERSHEY_SIMPLEX;
+        constexpr double font_scale = 0.5;
+        int baseline = 0;
+        const cv::Size size = cv::getTextSize(label, font, font_scale, 1, &baseline);
+        // Leave a margin since the strokes may extend slightly beyond the text
+        // size.
+        constexpr int margin = 2;
+        LabelGlyph glyph;
+        glyph.origin = cv::Point(margin, margin + size.height);
+        glyph.mask = cv::Mat(size.height + baseline + 2 * margin, size.width + 2 * margin,
+                CV_8UC1, cv::Scalar(0));
+        cv::putText(glyph.mask, label, glyph.origin, font, font_scale, cv::Scalar(UINT8_MAX));
+        glyphs.emplace(key, glyph);
+        return glyph;
+    }
+
+
+
+    /** Draw glyph in colour on render with its origin at the pixel origin.
+     */
+    static void draw_glyph(const LabelGlyph& glyph, const cv::Scalar& colour,
+                           const cv::Point& origin, cv::Mat& render)
+    {
+        const cv::Point top_left = origin - glyph.origin;
+        const cv::Rect roi = cv::Rect(top_left, glyph.mask.size())
+            & cv::Rect(0, 0, render.cols, render.rows);
+        if (roi.empty()) {
+            return;
+        }
+        render(roi).setTo(colour, glyph.mask(roi - top_left));
+    }
+
+
+
+    bool render_detections(const std::vector<Detection>& detections,
+                           cv::Mat&                      render)
+    {
+        if (render.type() != CV_8UC3) {
+            MR_LOG_ERROR << "Error: Can only render detections on CV_8UC3 images" << std::endl;
+            return false;
+        }
         // Overlay the detection masks first to avoid affecting the other
-        // overlays.
-        for (size_t i = 0; i < detections.size(); i++) {
-            const Detection& d = detections[i];
-            // Select the colour to use based on the class ID.
-            const uint8_t* colour = MaskRCNNConfig::class_colours[d.class_id];
-            const cv::Scalar cv_colour (colour[2], colour[1], colour[0]);
-            // Blend the colour mask with a solid colour image.
-            cv::Mat colour_image (d.mask.size(), CV_8UC3, cv_colour);
-            cv::Mat blended_render;
-            cv::addWeighted(render, 1.0 - MaskRCNNConfig::mask_threshold,
-                    colour_image, MaskRCNNConfig::mask_threshold, 0.0, blended_render);
-            // Binarize the mask to make blending simpler.
-            cv::Mat binary_mask;
-            cv::threshold(d.mask, binary_mask, UINT8_MAX/2.0, UINT8_MAX, cv::THRESH_BINARY);
-            // Use only the masked part of the blended render.
-            blended_render.copyTo(render, binary_mask);
+        // overlays. Each tile of rows is blended in parallel, with the masks
+        // blended in the order of the detections like when blending the whole
+        // image.
+        constexpr int tile_rows = 32;
+        const int num_tiles = (render.rows + tile_rows - 1) / tile_rows;
+        const bool has_masks = std::any_of(detections.begin(), detections.end(),
+                [](const Detection& d) { return !d.mask.empty(); });
+        if (has_masks) {
+            cv::parallel_for_(cv::Range(0, num_tiles), [&](const cv::Range& tiles) {
+                    const int row_start = tiles.start * tile_rows;
+                    const int row_end = std::min(tiles.end * tile_rows, render.rows);
+                    for (const auto& d : detections) {
+                        if (!d.mask.empty() && d.y_start < row_end && d.y_end > row_start) {
+                            blend_mask(d, render, row_start, row_end);
+                        }
+                    }
+                });
         }
         // Then overlay the rest of the info.
         for (size_t i = 0; i < detections.size(); i++) {
@@ -148,11 +364,19 @@ namespace mr {
             cv::rectangle(render, cv::Point(d.x_start, d.y_start),
                     cv::Point(d.x_end - 1, d.y_end - 1), cv_colour);
             // Draw the class name and confidence.
-            const std::string label = MaskRCNNConfig::class_names[d.class_id]
-                + " " + std::to_string(d.confidence).substr(0, 4);
-            cv::putText(render, label, cv::Point(d.x_start, d.y_start - 2),
-                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv_colour);
-         }
+            draw_glyph(label_glyph(d.class_id, d.confidence), cv_colour,
+                    cv::Point(d.x_start, d.y_start - 2), render);
+        }
+        return true;
+    }
+
+
+
+    cv::Mat visualize_detections(const std::vector<Detection>& detections,
+                                 const cv::Mat&                image)
+    {
+        cv::Mat render = image.clone();
+        render_detections(detections, render);
         return render;
     }
 } // namespace mr
@@ -0,0 +1,424 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "maskrcnn_trt/detection_stream.hpp"
+#include "maskrcnn_trt/logger.hpp"
+#include "maskrcnn_trt/trace.hpp"
+
+namespace mr {
+    /** The header at the start of a detection stream.
+     */
+    struct DetectionStreamHeader {
+        char magic[8] = {'M', 'R', 'D', 'E', 'T', 'E', 'C', 'T'};
+        uint32_t version = 1;
+        uint32_t reserved = 0;
+        uint8_t padding[48] = {};
+    };
+
+    /** The header at the start of each record.
+     */
+    struct DetectionFrameHeader {
+        uint64_t frame = 0;
+        /** The size of the record in bytes, including this header and the
+         * padding at the end.
+         */
+        uint64_t record_size = 0;
+        int32_t image_width = 0;
+        int32_t image_height = 0;
+        uint32_t num_detections = 0;
+        uint32_t reserved = 0;
+        uint8_t padding[32] = {};
+    };
+
+    static_assert(sizeof(DetectionStreamHeader) == 64, "The detection stream header must be 64 bytes");
+    static_assert(sizeof(DetectionFrameHeader) == 64, "The detection frame header must be 64 bytes");
+    static_assert(sizeof(DetectionMaskEntry) == 32, "The detection mask entry must be 32 bytes");
+
+    /** Records start at multiples of this many bytes.
+     */
+    static constexpr size_t record_alignment = 64;
+
+    /** The offsets of the arrays of a record with n detections from its
+     * start. The mask entries come first since they need 8-byte alignment.
+     */
+    struct RecordLayout {
+        size_t masks;
+        size_t boxes;
+        size_t confidences;
+        size_t class_ids;
+        size_t track_ids;
+        size_t mask_data;
+
+        explicit RecordLayout(size_t n)
+            : masks(sizeof(DetectionFrameHeader)),
+            boxes(masks + n * sizeof(DetectionMaskEntry)),
+            confidences(boxes + 4 * n * sizeof(float)),
+            class_ids(confidences + n * sizeof(float)),
+            track_ids(class_ids + n * sizeof(int32_t)),
+            mask_data(track_ids + n * sizeof(int32_t))
+        {
+        }
+    };
+
+
+
+    /** Write the whole buffer to fd, retrying on partial and interrupted
+     * writes.
+     */
+    static bool write_all(int fd, const void* buffer, size_t size)
+    {
+        const uint8_t* data = static_cast<const uint8_t*>(buffer);
+        while (size > 0) {
+            const ssize_t written = ::write(fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+
+
+    /** Write the run lengths of mask thresholded at 128 to runs.
+     */
+    static void encode_rle(const cv::Mat& mask, std::vector<uint32_t>& runs)
+    {
+        runs.clear();
+        uint32_t run = 0;
+        bool foreground = false;
+        for (int y = 0; y < mask.rows; y++) {
+            const uint8_t* row = mask.ptr<uint8_t>(y);
+            for (int x = 0; x < mask.cols; x++) {
+                if ((row[x] >= 128) != foreground) {
+                    runs.push_back(run);
+                    run = 0;
+                    foreground = !foreground;
+                }
+                run++;
+            }
+        }
+        runs.push_back(run);
+    }
+
+
+
+    /** Return whether the mask entries of a record with n detections lie
+     * inside its mask data and have a size consistent with their encoding
+     * and dimensions.
+     */
+    static bool valid_masks(const uint8_t* record, uint64_t record_size, size_t n)
+    {
+        const RecordLayout layout (n);
+        const DetectionMaskEntry* masks = reinterpret_cast<const DetectionMaskEntry*>(record + layout.masks);
+        for (size_t i = 0; i < n; i++) {
+            const DetectionMaskEntry& entry = masks[i];
+            if (entry.encoding == MaskEncoding::none) {
+                continue;
+            }
+            if (entry.width < 0 || entry.height < 0
+                    || entry.offset < layout.mask_data || entry.offset > record_size
+                    || entry.size > record_size - entry.offset) {
+                return false;
+            }
+            const uint64_t pixels = (uint64_t) entry.width * entry.height;
+            switch (entry.encoding) {
+                case MaskEncoding::raw:
+                    if (entry.size != pixels) {
+                        return false;
+                    }
+                    break;
+                case MaskEncoding::rle:
+                    if (entry.offset % sizeof(uint32_t) != 0 || entry.size % sizeof(uint32_t) != 0) {
+                        return false;
+                    }
+                    break;
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+
+
+
+    /** Decode run lengths into a mask of the given size with values 0 and
+     * 255. At most num_runs run lengths are read.
+     */
+    static cv::Mat decode_rle(const uint32_t* runs, size_t num_runs, int width, int height)
+    {
+        cv::Mat mask (height, width, CV_8UC1);
+        uint8_t* data = mask.ptr<uint8_t>();
+        const size_t total = mask.total();
+        size_t pos = 0;
+        uint8_t value = 0;
+        for (size_t i = 0; i < num_runs && pos < total; i++) {
+            const size_t run = std::min<size_t>(runs[i], total - pos);
+            memset(data + pos, value, run);
+            pos += run;
+            value = 255 - value;
+        }
+        memset(data + pos, 0, total - pos);
+        return mask;
+    }
+
+
+
+    cv::Mat DetectionFrameView::mask(size_t i) const
+    {
+        const DetectionMaskEntry& entry = masks[i];
+        const uint8_t* data = record + entry.offset;
+        switch (entry.encoding) {
+            case MaskEncoding::raw:
+                return cv::Mat(entry.height, entry.width, CV_8UC1, const_cast<uint8_t*>(data));
+            case MaskEncoding::rle:
+                return decode_rle(reinterpret_cast<const uint32_t*>(data),
+                        entry.size / sizeof(uint32_t), entry.width, entry.height);
+            default:
+                return cv::Mat();
+        }
+    }
+
+
+
+    Detection DetectionFrameView::detection(size_t i) const
+    {
+        Detection d;
+        d.class_id = class_ids[i];
+        d.confidence = confidences[i];
+        d.x_start = boxes[4 * i];
+        d.y_start = boxes[4 * i + 1];
+        d.x_end = boxes[4 * i + 2];
+        d.y_end = boxes[4 * i + 3];
+        d.mask = mask(i);
+        d.box_local_mask = true;
+        d.track_id = track_ids[i];
+        return d;
+    }
+
+
+
+    DetectionStreamWriter::~DetectionStreamWriter()
+    {
+        close();
+    }
+
+
+
+    bool DetectionStreamWriter::open(const std::string& filename, MaskEncoding encoding)
+    {
+        close();
+        fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) {
+            return false;
+        }
+        const DetectionStreamHeader header;
+        if (!write_all(fd_, &header, sizeof(header))) {
+            close();
+            return false;
+        }
+        encoding_ = encoding;
+        size_ = sizeof(header);
+        return true;
+    }
+
+
+
+    bool DetectionStreamWriter::write(uint64_t                      frame,
+                                      cv::Size                      image_size,
+                                      const std::vector<Detection>& detections)
+    {
+        MR_TRACE_SPAN("write_detection_stream");
+        if (fd_ < 0) {
+            return false;
+        }
+        const size_t n = detections.size();
+        const RecordLayout layout (n);
+        // Lay out the fixed-size arrays, then append the masks.
+        record_.assign(layout.mask_data, 0);
+        for (size_t i = 0; i < n; i++) {
+            const Detection& d = detections[i];
+            const float box[4] = {d.x_start, d.y_start, d.x_end, d.y_end};
+            const int32_t class_id = d.class_id;
+            const int32_t track_id = d.track_id;
+            memcpy(record_.data() + layout.boxes + 4 * i * sizeof(float), box, sizeof(box));
+            memcpy(record_.data() + layout.confidences + i * sizeof(float), &d.confidence, sizeof(float));
+            memcpy(record_.data() + layout.class_ids + i * sizeof(int32_t), &class_id, sizeof(int32_t));
+            memcpy(record_.data() + layout.track_ids + i * sizeof(int32_t), &track_id, sizeof(int32_t));
+
+            DetectionMaskEntry entry;
+            const cv::Mat mask = d.mask.empty() || d.box_local_mask ? d.mask
+                : d.mask(cv::Rect(d.x_start, d.y_start, d.x_end - d.x_start, d.y_end - d.y_start)
+                        & cv::Rect(0, 0, d.mask.cols, d.mask.rows));
+            if (!mask.empty() && encoding_ != MaskEncoding::none) {
+                entry.encoding = encoding_;
+                entry.width = mask.cols;
+                entry.height = mask.rows;
+                entry.offset = record_.size();
+                if (encoding_ == MaskEncoding::raw) {
+                    for (int y = 0; y < mask.rows; y++) {
+                        const uint8_t* row = mask.ptr<uint8_t>(y);
+                        record_.insert(record_.end(), row, row + mask.cols);
+                    }
+                } else {
+                    encode_rle(mask, runs_);
+                    const uint8_t* runs = reinterpret_cast<const uint8_t*>(runs_.data());
+                    record_.insert(record_.end(), runs, runs + runs_.size() * sizeof(uint32_t));
+                }
+                entry.size = record_.size() - entry.offset;
+                // Keep the next mask aligned for its run lengths.
+                record_.resize((record_.size() + 3) / 4 * 4, 0);
+            }
+            memcpy(record_.data() + layout.masks + i * sizeof(DetectionMaskEntry), &entry, sizeof(entry));
+        }
+        record_.resize((record_.size() + record_alignment - 1) / record_alignment * record_alignment, 0);
+
+        DetectionFrameHeader header;
+        header.frame = frame;
+        header.record_size = record_.size();
+        header.image_width = image_size.width;
+        header.image_height = image_size.height;
+        header.num_detections = n;
+        memcpy(record_.data(), &header, sizeof(header));
+        if (!write_all(fd_, record_.data(), record_.size())) {
+            // Drop whatever part of the record was written so the next record
+            // starts right after the last complete one.
+            MR_LOG_ERROR << "Error: Could not write a detection stream record: "
+                << std::strerror(errno) << std::endl;
+            if (ftruncate(fd_, size_) != 0 || lseek(fd_, size_, SEEK_SET) < 0) {
+                MR_LOG_ERROR << "Error: Could not remove a partial detection stream record: "
+                    << std::strerror(errno) << std::endl;
+            }
+            return false;
+        }
+        size_ += record_.size();
+        return true;
+    }
+
+
+
+    uint64_t DetectionStreamWriter::bytesWritten() const
+    {
+        return size_;
+    }
+
+
+
+    void DetectionStreamWriter::close()
+    {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+
+
+    DetectionStreamReader::~DetectionStreamReader()
+    {
+        close();
+    }
+
+
+
+    bool DetectionStreamReader::open(const std::string& filename)
+    {
+        close();
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(DetectionStreamHeader)) {
+            ::close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        // The mapping remains valid after closing the file.
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        data_ = static_cast<const uint8_t*>(data);
+        data_size_ = st.st_size;
+        const DetectionStreamHeader expected;
+        const DetectionStreamHeader* header = static_cast<const DetectionStreamHeader*>(data);
+        if (memcmp(header->magic, expected.magic, sizeof(expected.magic)) != 0
+                || header->version != expected.version) {
+            close();
+            return false;
+        }
+        // Index the records, ignoring a trailing incomplete one. Validate the
+        // mask entries here so frame() and mask() can't read past a record.
+        size_t offset = sizeof(DetectionStreamHeader);
+        while (offset + sizeof(DetectionFrameHeader) <= data_size_) {
+            const DetectionFrameHeader* frame = reinterpret_cast<const DetectionFrameHeader*>(data_ + offset);
+            if (frame->record_size < RecordLayout(frame->num_detections).mask_data
+                    || frame->record_size % record_alignment != 0
+                    || frame->record_size > data_size_ - offset) {
+                break;
+            }
+            if (!valid_masks(data_ + offset, frame->record_size, frame->num_detections)) {
+                MR_LOG_ERROR << "Error: Invalid mask in the record of frame " << frame->frame
+                    << " in " << filename << std::endl;
+                close();
+                return false;
+            }
+            offsets_.push_back(offset);
+            offset += frame->record_size;
+        }
+        return true;
+    }
+
+
+
+    size_t DetectionStreamReader::size() const
+    {
+        return offsets_.size();
+    }
+
+
+
+    DetectionFrameView DetectionStreamReader::frame(size_t index) const
+    {
+        const uint8_t* record = data_ + offsets_[index];
+        const DetectionFrameHeader* header = reinterpret_cast<const DetectionFrameHeader*>(record);
+        const RecordLayout layout (header->num_detections);
+        DetectionFrameView view;
+        view.frame = header->frame;
+        view.image_size = cv::Size(header->image_width, header->image_height);
+        view.size = header->num_detections;
+        view.boxes = reinterpret_cast<const float*>(record + layout.boxes);
+        view.confidences = reinterpret_cast<const float*>(record + layout.confidences);
+        view.class_ids = reinterpret_cast<const int32_t*>(record + layout.class_ids);
+        view.track_ids = reinterpret_cast<const int32_t*>(record + layout.track_ids);
+        view.masks = reinterpret_cast<const DetectionMaskEntry*>(record + layout.masks);
+        view.record = record;
+        return view;
+    }
+
+
+
+    void DetectionStreamReader::close()
+    {
+        if (data_) {
+            munmap(const_cast<uint8_t*>(data_), data_size_);
+            data_ = nullptr;
+        }
+        data_size_ = 0;
+        offsets_.clear();
+    }
+} // namespace mr
@@ -0,0 +1,168 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "maskrcnn_trt/frame_source.hpp"
+#include "maskrcnn_trt/logger.hpp"
+#include "maskrcnn_trt/trace.hpp"
+
+namespace mr {
+    RawFrameSource::RawFrameSource(int fd, cv::Size size, PixelFormat format)
+        : fd_(fd), size_(size), format_(format)
+    {
+    }
+
+
+
+    bool RawFrameSource::read(cv::Mat& frame)
+    {
+        MR_TRACE_SPAN("read_raw");
+        frame = cv::Mat(size_, CV_8UC3);
+        const size_t frame_size = frame.total() * frame.elemSize();
+        size_t read_size = 0;
+        while (read_size < frame_size) {
+            const ssize_t r = ::read(fd_, frame.data + read_size, frame_size - read_size);
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            if (r < 0) {
+                MR_LOG_ERROR << "Error: Could not read a raw frame: " << std::strerror(errno)
+                    << std::endl;
+                failed_ = true;
+                frame = cv::Mat();
+                return false;
+            }
+            if (r == 0) {
+                break;
+            }
+            read_size += r;
+        }
+        if (read_size == frame_size) {
+            return true;
+        }
+        if (read_size > 0) {
+            MR_LOG_WARNING << "Warning: Ignoring a partial frame of " << read_size << "/"
+                << frame_size << " bytes at the end of the stream" << std::endl;
+        }
+        frame = cv::Mat();
+        return false;
+    }
+
+
+
+    bool RawFrameSource::failed() const
+    {
+        return failed_;
+    }
+
+
+
+    bool RawFrameSource::bgrOrder() const
+    {
+        return format_ == PixelFormat::bgr24;
+    }
+
+
+
+    bool parse_raw_frame_spec(const std::string&           spec,
+                              cv::Size&                    size,
+                              RawFrameSource::PixelFormat& format)
+    {
+        int width = 0;
+        int height = 0;
+        char format_name[8] = "bgr24";
+        const int fields = sscanf(spec.c_str(), "%dx%d:%7s", &width, &height, format_name);
+        if (fields < 2 || width <= 0 || height <= 0) {
+            return false;
+        }
+        const std::string name (format_name);
+        if (name == "bgr24") {
+            format = RawFrameSource::PixelFormat::bgr24;
+        } else if (name == "rgb24") {
+            format = RawFrameSource::PixelFormat::rgb24;
+        } else {
+            return false;
+        }
+        size = cv::Size(width, height);
+        return true;
+    }
+
+
+
+    VideoFrameSource::VideoFrameSource(const std::string& filename, size_t max_ahead)
+        : capture_(filename), max_ahead_(std::max<size_t>(max_ahead, 1))
+    {
+        if (capture_.isOpened()) {
+            thread_ = std::thread(&VideoFrameSource::decode, this);
+        }
+    }
+
+
+
+    VideoFrameSource::~VideoFrameSource()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex_);
+            stop_ = true;
+        }
+        decoder_cv_.notify_one();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+
+
+    bool VideoFrameSource::isOpened() const
+    {
+        return thread_.joinable();
+    }
+
+
+
+    bool VideoFrameSource::read(cv::Mat& frame)
+    {
+        std::unique_lock<std::mutex> lock (mutex_);
+        reader_cv_.wait(lock, [this] { return done_ || !frames_.empty() || !thread_.joinable(); });
+        if (frames_.empty()) {
+            return false;
+        }
+        frame = std::move(frames_.front());
+        frames_.pop_front();
+        decoder_cv_.notify_one();
+        return true;
+    }
+
+
+
+    void VideoFrameSource::decode()
+    {
+        trace_thread_name("video decoder");
+        while (true) {
+            cv::Mat frame;
+            bool success = false;
+            {
+                MR_TRACE_SPAN("decode_video");
+                success = capture_.read(frame);
+            }
+            std::unique_lock<std::mutex> lock (mutex_);
+            if (!success || frame.empty()) {
+                done_ = true;
+                reader_cv_.notify_one();
+                return;
+            }
+            frames_.push_back(std::move(frame));
+            reader_cv_.notify_one();
+            decoder_cv_.wait(lock, [this] { return stop_ || frames_.size() < max_ahead_; });
+            if (stop_) {
+                return;
+            }
+        }
+    }
+} // namespace mr
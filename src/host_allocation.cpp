@@ -0,0 +1,107 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdlib>
+
+#include <cuda_runtime_api.h>
+#include <sys/mman.h>
+
+#include "maskrcnn_trt/host_allocation.hpp"
+
+namespace mr {
+    static constexpr size_t cache_line_size = 64;
+    static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+    /** Round bytes up to a multiple of alignment as required by
+     * aligned_alloc().
+     */
+    static size_t round_up(size_t bytes, size_t alignment)
+    {
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+
+
+
+    const char* host_allocation_name(HostAllocation allocation)
+    {
+        switch (allocation) {
+            case HostAllocation::pageable: return "pageable";
+            case HostAllocation::aligned: return "aligned";
+            case HostAllocation::huge_pages: return "huge_pages";
+            case HostAllocation::pinned: return "pinned";
+            default: return "unknown";
+        }
+    }
+
+
+
+    HostAllocation resolve_host_allocation(HostAllocation allocation)
+    {
+        if (allocation == HostAllocation::pinned) {
+            int num_devices = 0;
+            if (cudaGetDeviceCount(&num_devices) != cudaSuccess || num_devices == 0) {
+                return HostAllocation::aligned;
+            }
+        }
+        return allocation;
+    }
+
+
+
+    size_t host_allocation_size(size_t bytes, HostAllocation allocation)
+    {
+        switch (allocation) {
+            case HostAllocation::aligned:
+                return round_up(bytes, cache_line_size);
+            case HostAllocation::huge_pages:
+                return round_up(bytes, huge_page_size);
+            default:
+                return bytes;
+        }
+    }
+
+
+
+    void* allocate_host(size_t bytes, HostAllocation allocation)
+    {
+        void* ptr = nullptr;
+        const size_t size = host_allocation_size(bytes, allocation);
+        switch (allocation) {
+            case HostAllocation::pageable:
+                ptr = std::malloc(size);
+                break;
+            case HostAllocation::aligned:
+                ptr = std::aligned_alloc(cache_line_size, size);
+                break;
+            case HostAllocation::huge_pages:
+                ptr = std::aligned_alloc(huge_page_size, size);
+                if (ptr) {
+                    // Only a hint, the allocation is still usable if
+                    // transparent huge pages are disabled.
+                    madvise(ptr, size, MADV_HUGEPAGE);
+                }
+                break;
+            case HostAllocation::pinned:
+                if (cudaMallocHost(&ptr, size) != cudaSuccess) {
+                    ptr = nullptr;
+                }
+                break;
+        }
+        return ptr;
+    }
+
+
+
+    void free_host(void* ptr, HostAllocation allocation)
+    {
+        if (!ptr) {
+            return;
+        }
+        if (allocation == HostAllocation::pinned) {
+            cudaFreeHost(ptr);
+        } else {
+            std::free(ptr);
+        }
+    }
+} // namespace mr
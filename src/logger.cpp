@@ -4,19 +4,28 @@
 #include "maskrcnn_trt/logger.hpp"
 
 Logger gLogger{Logger::Severity::kINFO};
-LogStreamConsumer gLogVerbose{LOG_VERBOSE(gLogger)};
-LogStreamConsumer gLogInfo{LOG_INFO(gLogger)};
-LogStreamConsumer gLogWarning{LOG_WARN(gLogger)};
-LogStreamConsumer gLogError{LOG_ERROR(gLogger)};
-LogStreamConsumer gLogFatal{LOG_FATAL(gLogger)};
+LogStream gLogVerbose{Severity::kVERBOSE};
+LogStream gLogInfo{Severity::kINFO};
+LogStream gLogWarning{Severity::kWARNING};
+LogStream gLogError{Severity::kERROR};
+LogStream gLogFatal{Severity::kINTERNAL_ERROR};
 
-void setReportableSeverity(Logger::Severity severity)
+LogStreamConsumer& LogStream::stream() const
 {
-    gLogger.setReportableSeverity(severity);
-    gLogVerbose.setReportableSeverity(severity);
-    gLogInfo.setReportableSeverity(severity);
-    gLogWarning.setReportableSeverity(severity);
-    gLogError.setReportableSeverity(severity);
-    gLogFatal.setReportableSeverity(severity);
+    // Indexed by severity.
+    thread_local LogStreamConsumer consumers[] = {
+        LOG_FATAL(gLogger),
+        LOG_ERROR(gLogger),
+        LOG_WARN(gLogger),
+        LOG_INFO(gLogger),
+        LOG_VERBOSE(gLogger),
+    };
+    LogStreamConsumer& consumer = consumers[static_cast<int>(mSeverity)];
+    consumer.setReportableSeverity(gLogger.getReportableSeverity());
+    return consumer;
 }
 
+void setReportableSeverity(Severity severity)
+{
+    gLogger.setReportableSeverity(severity);
+}
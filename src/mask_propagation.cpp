@@ -0,0 +1,273 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video.hpp>
+
+#include "maskrcnn_trt/mask_propagation.hpp"
+#include "maskrcnn_trt/trace.hpp"
+
+namespace mr {
+    /** Detections with fewer features on their keyframe don't affect the
+     * confidence since a few lost features would force a new keyframe.
+     */
+    static constexpr size_t min_keyframe_points = 3;
+
+
+
+    /** Return the median of values, reordering them.
+     */
+    static float median(std::vector<float>& values)
+    {
+        auto middle = values.begin() + values.size() / 2;
+        std::nth_element(values.begin(), middle, values.end());
+        return *middle;
+    }
+
+
+
+    MaskPropagator::MaskPropagator(const MaskPropagationConfig& config)
+        : config_(config)
+    {
+        config_.grid_size = std::max(config_.grid_size, 1);
+    }
+
+
+
+    void MaskPropagator::setKeyframe(const cv::Mat& gray_image, const std::vector<Detection>& detections)
+    {
+        MR_TRACE_SPAN("propagation_keyframe");
+        previous_image_ = gray_image;
+        objects_.clear();
+        last_confidence_ = 1.0f;
+        const cv::Rect image_rect (0, 0, gray_image.cols, gray_image.rows);
+        for (const auto& d : detections) {
+            const cv::Point origin (d.x_start, d.y_start);
+            const cv::Rect box = (d.box_local_mask && !d.mask.empty()
+                    ? cv::Rect(origin, d.mask.size())
+                    : cv::Rect(d.x_start, d.y_start, d.x_end - d.x_start, d.y_end - d.y_start))
+                & image_rect;
+            if (box.empty()) {
+                continue;
+            }
+            Object object;
+            object.detection = d;
+            object.detection.x_start = box.x;
+            object.detection.y_start = box.y;
+            object.detection.x_end = box.x + box.width;
+            object.detection.y_end = box.y + box.height;
+            object.full_mask = !d.box_local_mask && !d.mask.empty();
+            cv::Mat feature_mask;
+            if (!d.mask.empty()) {
+                object.detection.mask = d.box_local_mask ? d.mask(box - origin) : d.mask(box);
+                object.detection.box_local_mask = true;
+                cv::threshold(object.detection.mask, feature_mask, 127, 255, cv::THRESH_BINARY);
+            }
+            cv::goodFeaturesToTrack(gray_image(box), object.points, config_.max_points,
+                    config_.quality_level, config_.min_distance,
+                    feature_mask.empty() ? cv::noArray() : feature_mask);
+            for (auto& p : object.points) {
+                p.x += box.x;
+                p.y += box.y;
+            }
+            object.keyframe_points = object.points.size();
+            objects_.push_back(std::move(object));
+        }
+    }
+
+
+
+    bool MaskPropagator::propagate(const cv::Mat& gray_image, std::vector<Detection>& detections)
+    {
+        MR_TRACE_SPAN("propagate_masks");
+        // Track the features of all objects together, forward and back.
+        std::vector<cv::Point2f> points;
+        for (const auto& object : objects_) {
+            points.insert(points.end(), object.points.begin(), object.points.end());
+        }
+        std::vector<cv::Point2f> tracked;
+        std::vector<cv::Point2f> back_tracked;
+        std::vector<uint8_t> status;
+        std::vector<uint8_t> back_status;
+        std::vector<float> error;
+        if (!points.empty()) {
+            const cv::Size window (config_.window_size, config_.window_size);
+            cv::calcOpticalFlowPyrLK(previous_image_, gray_image, points, tracked, status,
+                    error, window, config_.pyramid_levels);
+            cv::calcOpticalFlowPyrLK(gray_image, previous_image_, tracked, back_tracked,
+                    back_status, error, window, config_.pyramid_levels);
+        }
+
+        // Compute the confidence before changing any state.
+        std::vector<std::vector<cv::Point2f>> from (objects_.size());
+        std::vector<std::vector<cv::Point2f>> to (objects_.size());
+        float confidence = 1.0f;
+        size_t i = 0;
+        for (size_t o = 0; o < objects_.size(); o++) {
+            for (size_t j = 0; j < objects_[o].points.size(); j++, i++) {
+                const float e = std::hypot(back_tracked[i].x - points[i].x,
+                        back_tracked[i].y - points[i].y);
+                if (status[i] && back_status[i] && e <= config_.max_forward_backward_error) {
+                    from[o].push_back(points[i]);
+                    to[o].push_back(tracked[i]);
+                }
+            }
+            if (objects_[o].keyframe_points >= min_keyframe_points) {
+                confidence = std::min(confidence,
+                        static_cast<float>(to[o].size()) / objects_[o].keyframe_points);
+            }
+        }
+        last_confidence_ = confidence;
+        if (confidence < config_.min_confidence) {
+            return false;
+        }
+
+        for (size_t o = 0; o < objects_.size(); o++) {
+            warpObject(objects_[o], from[o], to[o]);
+            if (!from[o].empty()) {
+                objects_[o].points = std::move(to[o]);
+            }
+        }
+        objects_.erase(std::remove_if(objects_.begin(), objects_.end(),
+                    [](const Object& object) {
+                        return object.detection.x_end <= object.detection.x_start
+                            || object.detection.y_end <= object.detection.y_start;
+                    }), objects_.end());
+        previous_image_ = gray_image;
+        detections.clear();
+        for (const auto& object : objects_) {
+            detections.push_back(outputDetection(object));
+        }
+        return true;
+    }
+
+
+
+    float MaskPropagator::lastConfidence() const
+    {
+        return last_confidence_;
+    }
+
+
+
+    void MaskPropagator::warpObject(Object&                         object,
+                                    const std::vector<cv::Point2f>& from,
+                                    const std::vector<cv::Point2f>& to) const
+    {
+        Detection& d = object.detection;
+        const cv::Rect box (d.x_start, d.y_start, d.x_end - d.x_start, d.y_end - d.y_start);
+        if (from.empty()) {
+            return;
+        }
+        std::vector<float> dx (from.size());
+        std::vector<float> dy (from.size());
+        for (size_t i = 0; i < from.size(); i++) {
+            dx[i] = to[i].x - from[i].x;
+            dy[i] = to[i].y - from[i].y;
+        }
+        // The median displacement is robust to the few features that
+        // converged on the background.
+        const cv::Point shift (std::lround(median(dx)), std::lround(median(dy)));
+        const cv::Rect image_rect (0, 0, previous_image_.cols, previous_image_.rows);
+        if (d.mask.empty()) {
+            const cv::Rect moved = (box + shift) & image_rect;
+            d.x_start = moved.x;
+            d.y_start = moved.y;
+            d.x_end = moved.x + moved.width;
+            d.y_end = moved.y + moved.height;
+            return;
+        }
+
+        // Interpolate the displacements at the grid cell centres with inverse
+        // distance weighting.
+        const int g = config_.grid_size;
+        cv::Mat grid (g, g, CV_32FC2);
+        float max_deviation = 0.0f;
+        for (int gy = 0; gy < g; gy++) {
+            for (int gx = 0; gx < g; gx++) {
+                const float cx = box.x + (gx + 0.5f) * box.width / g;
+                const float cy = box.y + (gy + 0.5f) * box.height / g;
+                float weight_sum = 0.0f;
+                float fx = 0.0f;
+                float fy = 0.0f;
+                for (size_t i = 0; i < from.size(); i++) {
+                    const float ex = from[i].x - cx;
+                    const float ey = from[i].y - cy;
+                    const float w = 1.0f / (ex * ex + ey * ey + 1.0f);
+                    weight_sum += w;
+                    fx += w * (to[i].x - from[i].x);
+                    fy += w * (to[i].y - from[i].y);
+                }
+                cv::Vec2f& f = grid.at<cv::Vec2f>(gy, gx);
+                f[0] = fx / weight_sum;
+                f[1] = fy / weight_sum;
+                max_deviation = std::max({max_deviation,
+                        std::fabs(f[0] - shift.x), std::fabs(f[1] - shift.y)});
+            }
+        }
+        cv::Mat flow;
+        cv::resize(grid, flow, box.size(), 0, 0, cv::INTER_LINEAR);
+
+        // Warp the mask backwards into the shifted box, grown to fit the
+        // deviations from the median displacement. The flow at each
+        // destination pixel is approximated by the flow at the pixel it was
+        // shifted from.
+        const int margin = std::ceil(max_deviation);
+        const cv::Rect warped_box = cv::Rect(box.x + shift.x - margin, box.y + shift.y - margin,
+                box.width + 2 * margin, box.height + 2 * margin) & image_rect;
+        if (warped_box.empty()) {
+            d.x_end = d.x_start;
+            return;
+        }
+        cv::Mat map_x (warped_box.size(), CV_32FC1);
+        cv::Mat map_y (warped_box.size(), CV_32FC1);
+        for (int y = 0; y < warped_box.height; y++) {
+            const int py = warped_box.y + y;
+            const int sy = std::clamp(py - shift.y - box.y, 0, box.height - 1);
+            const cv::Vec2f* flow_row = flow.ptr<cv::Vec2f>(sy);
+            float* map_x_row = map_x.ptr<float>(y);
+            float* map_y_row = map_y.ptr<float>(y);
+            for (int x = 0; x < warped_box.width; x++) {
+                const int px = warped_box.x + x;
+                const int sx = std::clamp(px - shift.x - box.x, 0, box.width - 1);
+                map_x_row[x] = px - flow_row[sx][0] - box.x;
+                map_y_row[x] = py - flow_row[sx][1] - box.y;
+            }
+        }
+        cv::Mat warped;
+        cv::remap(d.mask, warped, map_x, map_y, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(0));
+
+        // Shrink the box back to the warped mask.
+        cv::Mat binary;
+        cv::threshold(warped, binary, 127, 255, cv::THRESH_BINARY);
+        const cv::Rect mask_box = cv::boundingRect(binary);
+        if (mask_box.empty()) {
+            d.x_end = d.x_start;
+            return;
+        }
+        d.mask = warped(mask_box).clone();
+        d.x_start = warped_box.x + mask_box.x;
+        d.y_start = warped_box.y + mask_box.y;
+        d.x_end = d.x_start + mask_box.width;
+        d.y_end = d.y_start + mask_box.height;
+    }
+
+
+
+    Detection MaskPropagator::outputDetection(const Object& object) const
+    {
+        if (!object.full_mask) {
+            return object.detection;
+        }
+        Detection d = object.detection;
+        const cv::Rect box (d.x_start, d.y_start, d.x_end - d.x_start, d.y_end - d.y_start);
+        d.mask = cv::Mat(previous_image_.size(), CV_8UC1, cv::Scalar(0));
+        object.detection.mask.copyTo(d.mask(box));
+        d.box_local_mask = false;
+        return d;
+    }
+} // namespace mr
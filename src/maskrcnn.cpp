@@ -2,12 +2,50 @@
 // SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
 // SPDX-License-Identifier: Apache-2.0
 
-#include <opencv2/imgproc.hpp>
+#include <algorithm>
 
 #include "maskrcnn_trt/maskrcnn.hpp"
 #include "maskrcnn_trt/filesystem.hpp"
+#include "maskrcnn_trt/preprocessing.hpp"
+#include "maskrcnn_trt/probes.hpp"
+#include "maskrcnn_trt/tensorrt_backend.hpp"
+#include "maskrcnn_trt/trace.hpp"
 
 namespace mr {
+    /** Return whether a binding shape matches an expected tensor shape.
+     * Trailing dimensions of size 1 are ignored since the UFF parser may
+     * append them to the outputs, e.g. {100, 6, 1, 1} for the detections.
+     */
+    static bool shape_matches(std::vector<int> shape, std::vector<int> expected)
+    {
+        while (!shape.empty() && shape.back() == 1) {
+            shape.pop_back();
+        }
+        while (!expected.empty() && expected.back() == 1) {
+            expected.pop_back();
+        }
+        return shape == expected;
+    }
+
+
+
+    /** Fire the infer_done probe when going out of scope so that it's fired
+     * on every exit path of MaskRCNN::infer() after infer_start.
+     */
+    struct InferDoneProbe {
+        uint64_t frame_id;
+        int batch_size;
+        size_t num_detections = 0;
+        bool success = false;
+
+        ~InferDoneProbe()
+        {
+            MR_PROBE4(infer_done, frame_id, batch_size, num_detections, success);
+        }
+    };
+
+
+
     MaskRCNN::MaskRCNN(const MaskRCNNConfig& config)
         : config_(config)
     {
@@ -16,8 +54,32 @@ namespace mr {
 
 
 
+    MaskRCNN::MaskRCNN(const MaskRCNNConfig&             config,
+                       std::unique_ptr<InferenceBackend> backend)
+        : config_(config), backend_(std::move(backend))
+    {
+        srand((int) time(nullptr));
+    }
+
+
+
     bool MaskRCNN::build()
     {
+        MR_PROBE1(build_start, backend_ != nullptr);
+        built_ = buildBackend();
+        MR_PROBE1(build_done, built_);
+        return built_;
+    }
+
+
+
+    bool MaskRCNN::buildBackend()
+    {
+        // Only validate a user-supplied backend.
+        if (backend_) {
+            return openCapture() && validateBindings();
+        }
+
         initLibNvInferPlugins(&gLogger.getTRTLogger(), "");
         auto builder = NVUniquePtr<nvinfer1::IBuilder>(nvinfer1::createInferBuilder(gLogger.getTRTLogger()));
         if (!builder) {
@@ -45,58 +107,269 @@ namespace mr {
             return false;
         }
 
-        context_ = NVUniquePtr<nvinfer1::IExecutionContext>(engine_->createExecutionContext());
-        if (!context_) {
+        backend_ = TensorRTBackend::create(engine_, config_.max_batch_size, config_.host_allocation);
+        if (!backend_) {
             return false;
         }
 
-        // Create the host/device buffer manager.
-        buffer_manager_ = std::make_unique<samplesCommon::BufferManager>(engine_, config_.batch_size);
+        if (!openCapture()) {
+            return false;
+        }
 
         // Ensure the network has the expected number of inputs and outputs.
         assert(network->getNbInputs() == 1);
         assert(network->getNbOutputs() == 2);
-        // Ensure the network input has the expected shape.
-        input_dims_ = network->getInput(0)->getDimensions();
-        assert(input_dims_.nbDims == 3);
-        assert(input_dims_.d[0] == MaskRCNNConfig::model_input_shape[0]);
-        assert(input_dims_.d[1] == MaskRCNNConfig::model_input_shape[1]);
-        assert(input_dims_.d[2] == MaskRCNNConfig::model_input_shape[2]);
-        // Ensure the network output has the expected shape.
-        // TODO
+        // Ensure the network input and outputs have the expected shapes.
+        return validateBindings();
+    }
+
+
+
+    bool MaskRCNN::openCapture()
+    {
+        if (config_.capture_filename.empty()) {
+            return true;
+        }
+        capture_writer_ = std::make_shared<CaptureWriter>();
+        if (!capture_writer_->open(config_.capture_filename)) {
+            MR_LOG_ERROR << "Error: Could not open capture " << config_.capture_filename
+                << std::endl;
+            capture_writer_.reset();
+            return false;
+        }
         return true;
     }
 
 
 
     std::vector<Detection> MaskRCNN::infer(const cv::Mat& rgb_image,
-                                           bool           in_bgr_order)
+                                           bool           in_bgr_order,
+                                           cv::Size       original_size)
+    {
+        // Run inference on a batch containing only this image.
+        std::vector<std::vector<Detection>> batch_detections
+            = infer(std::vector<cv::Mat>{rgb_image}, in_bgr_order,
+                    std::vector<cv::Size>{original_size});
+        if (batch_detections.empty()) {
+            return std::vector<Detection>();
+        }
+        return std::move(batch_detections.front());
+    }
+
+
+
+    std::vector<std::vector<Detection>> MaskRCNN::infer(
+            const std::vector<cv::Mat>&  rgb_images,
+            bool                         in_bgr_order,
+            const std::vector<cv::Size>& original_sizes)
     {
         // Ensure the network has been built before running inference.
-        if (!context_) {
-            gLogError << "Error: The network must be built using build() before running infer()"
+        if (!built_) {
+            MR_LOG_ERROR << "Error: The network must be built using build() before running infer()"
                 << std::endl;
-            return std::vector<Detection>();
+            return std::vector<std::vector<Detection>>();
+        }
+        const int batch_size = rgb_images.size();
+        if (batch_size == 0) {
+            return std::vector<std::vector<Detection>>();
+        }
+        if (batch_size > config_.max_batch_size) {
+            MR_LOG_ERROR << "Error: Tried to run inference on " << batch_size
+                << " images but MaskRCNNConfig::max_batch_size is "
+                << config_.max_batch_size << std::endl;
+            return std::vector<std::vector<Detection>>();
         }
 
-        // Read the input data into the host buffer.
-        preprocessInput(*buffer_manager_, rgb_image, in_bgr_order);
+        MR_TIME_STAGE(*stats_, InferenceStage::total);
+        MR_TRACE_SPAN("infer");
+        frame_id_ = next_frame_id_->fetch_add(batch_size);
+        MR_PROBE2(infer_start, frame_id_, batch_size);
+        InferDoneProbe infer_done {frame_id_, batch_size};
 
-        // Copy image from the host input buffer to the device input buffer.
-        buffer_manager_->copyInputToDevice();
+        // Read the input data into the host buffer.
+        std::vector<cv::Size> input_sizes;
+        input_sizes.reserve(batch_size);
+        for (int i = 0; i < batch_size; i++) {
+            MR_TIME_STAGE(*stats_, InferenceStage::preprocess);
+            MR_TRACE_SPAN("preprocess");
+            preprocessInput(rgb_images[i], i, in_bgr_order);
+            // The detections are computed for the original size if known
+            // since the letterboxing only depends on the aspect ratio.
+            const bool has_original_size = i < static_cast<int>(original_sizes.size())
+                && !original_sizes[i].empty();
+            input_sizes.push_back(has_original_size ? original_sizes[i] : rgb_images[i].size());
+        }
+        // preprocess_image() allocates an 8-bit image of the network input
+        // dimensions and its split channels for each image in turn.
+        InferenceCounters::updatePeak(counters_->peak_temporary_bytes_estimate,
+                input_sizes.capacity() * sizeof(cv::Size) + 2 * MaskRCNNConfig::model_input_volume);
+
+        // Copy the images from the host input buffer to the device input
+        // buffer.
+        {
+            MR_TIME_STAGE(*stats_, InferenceStage::copy_to_device);
+            MR_TRACE_SPAN("copy_to_device");
+            if (!backend_->copyInputToDevice(batch_size)) {
+                return std::vector<std::vector<Detection>>();
+            }
+            counters_->bytes_to_device.add(
+                    batch_size * MaskRCNNConfig::model_input_volume * sizeof(float));
+        }
 
-        // Run and time inference.
-        const bool status = context_->execute(config_.batch_size, buffer_manager_->getDeviceBindings().data());
-        if (!status) {
-            return std::vector<Detection>();
+        // Run inference.
+        {
+            MR_TIME_STAGE(*stats_, InferenceStage::execute);
+            MR_TRACE_SPAN("execute");
+            if (!backend_->execute(batch_size)) {
+                counters_->failed_executions.add();
+                return std::vector<std::vector<Detection>>();
+            }
         }
 
         // Copy the detections from the device output buffers to the host output
         // buffers.
-        buffer_manager_->copyOutputToHost();
+        {
+            MR_TIME_STAGE(*stats_, InferenceStage::copy_to_host);
+            MR_TRACE_SPAN("copy_to_host");
+            if (!backend_->copyOutputToHost(batch_size)) {
+                return std::vector<std::vector<Detection>>();
+            }
+            counters_->bytes_to_host.add(batch_size * sizeof(float)
+                    * (MaskRCNNConfig::model_detection_volume + MaskRCNNConfig::model_mask_volume));
+        }
+
+        if (capture_writer_) {
+            captureOutput(input_sizes);
+        }
+        stats_->addFrames(batch_size);
+        counters_->frames.add(batch_size);
+
+        // Post-process the detections into a Detection vector for each image.
+        std::vector<std::vector<Detection>> batch_detections = postprocessOutput(input_sizes);
+#ifdef MR_HAVE_PROBES
+        for (const auto& detections : batch_detections) {
+            infer_done.num_detections += detections.size();
+        }
+#endif
+        infer_done.success = true;
+        return batch_detections;
+    }
+
+
+
+    const MaskRCNNConfig& MaskRCNN::config() const
+    {
+        return config_;
+    }
+
+
+
+    std::unique_ptr<MaskRCNN> MaskRCNN::clone() const
+    {
+        if (!built_) {
+            MR_LOG_ERROR << "Error: The network must be built using build() before running clone()"
+                << std::endl;
+            return nullptr;
+        }
+        std::unique_ptr<InferenceBackend> backend = backend_->clone();
+        if (!backend) {
+            return nullptr;
+        }
+        std::unique_ptr<MaskRCNN> network
+            = std::make_unique<MaskRCNN>(config_, std::move(backend));
+        network->engine_ = engine_;
+        network->capture_writer_ = capture_writer_;
+        network->next_frame_id_ = next_frame_id_;
+        network->stats_ = stats_;
+        network->counters_ = counters_;
+        network->built_ = true;
+        return network;
+    }
+
+
+
+    void MaskRCNN::triggerCapture()
+    {
+        capture_triggered_ = true;
+    }
+
+
 
-        // Post-process the detections into a Detection vector.
-        return postprocessOutput(*buffer_manager_, rgb_image.cols, rgb_image.rows);
+    InferenceStats MaskRCNN::stats() const
+    {
+        return stats_->snapshot();
+    }
+
+
+
+    InferenceMetrics MaskRCNN::metrics() const
+    {
+        InferenceMetrics m = counters_->snapshot();
+        m.stats = stats_->snapshot();
+        return m;
+    }
+
+
+
+    MemoryReport MaskRCNN::memoryReport() const
+    {
+        MemoryReport r;
+        if (backend_) {
+            r.bindings = backend_->memoryUsage();
+        }
+        for (const auto& b : r.bindings) {
+            r.host_buffer_bytes += b.host_bytes;
+            r.device_buffer_bytes += b.device_bytes;
+        }
+        const InferenceMetrics m = counters_->snapshot();
+        r.peak_temporary_bytes_estimate = m.peak_temporary_bytes_estimate;
+        r.peak_mask_bytes = m.peak_mask_bytes;
+        r.mask_bytes_limit = config_.max_mask_bytes;
+        r.degraded_frames = m.degraded_frames;
+        return r;
+    }
+
+
+
+    void MaskRCNN::resetStats()
+    {
+        stats_->reset();
+        counters_->reset();
+    }
+
+
+
+    bool MaskRCNN::validateBindings() const
+    {
+        if (backend_->maxBatchSize() < config_.max_batch_size) {
+            MR_LOG_ERROR << "Error: The inference backend supports batches of up to "
+                << backend_->maxBatchSize() << " images but MaskRCNNConfig::max_batch_size is "
+                << config_.max_batch_size << std::endl;
+            return false;
+        }
+        const std::vector<int> input_shape (std::begin(MaskRCNNConfig::model_input_shape),
+                std::end(MaskRCNNConfig::model_input_shape));
+        const std::vector<int> detection_shape (std::begin(MaskRCNNConfig::model_detection_shape),
+                std::end(MaskRCNNConfig::model_detection_shape));
+        const std::vector<int> mask_shape (std::begin(MaskRCNNConfig::model_mask_shape),
+                std::end(MaskRCNNConfig::model_mask_shape));
+        for (int i = 0; i < backend_->numBindings(); i++) {
+            const std::string name = backend_->bindingName(i);
+            const std::vector<int> shape = backend_->bindingShape(i);
+            if ((name == MaskRCNNConfig::model_input && !shape_matches(shape, input_shape))
+                    || (name == MaskRCNNConfig::model_outputs[0] && !shape_matches(shape, detection_shape))
+                    || (name == MaskRCNNConfig::model_outputs[1] && !shape_matches(shape, mask_shape))) {
+                MR_LOG_ERROR << "Error: Unexpected shape for tensor " << name << std::endl;
+                return false;
+            }
+        }
+        if (!backend_->hostBuffer(MaskRCNNConfig::model_input)
+                || !backend_->hostBuffer(MaskRCNNConfig::model_outputs[0])
+                || !backend_->hostBuffer(MaskRCNNConfig::model_outputs[1])) {
+            MR_LOG_ERROR << "Error: The inference backend is missing a network tensor" << std::endl;
+            return false;
+        }
+        return true;
     }
 
 
@@ -119,7 +392,7 @@ namespace mr {
             return false;
         }
 
-        builder.setMaxBatchSize(config_.batch_size);
+        builder.setMaxBatchSize(config_.max_batch_size);
 
         // Test if the a serialized model is available.
         if (!config_.serialized_model_filename.empty()
@@ -127,7 +400,7 @@ namespace mr {
             // Open the file and go to the end of the stream.
             std::ifstream f (config_.serialized_model_filename, std::ios::binary | std::ios::ate);
             if (!f.is_open()) {
-                gLogError << "Error: Could not read serialized network model from "
+                MR_LOG_ERROR << "Error: Could not read serialized network model from "
                     << config_.serialized_model_filename << std::endl;
                 return false;
             }
@@ -143,12 +416,21 @@ namespace mr {
                     reinterpret_cast<void*>(buffer.data()), buffer.size());
             runtime->destroy();
             if (!engine) {
-                gLogError << "Error: Could not create engine from serialized network model "
+                MR_LOG_ERROR << "Error: Could not create engine from serialized network model "
                     << config_.serialized_model_filename << std::endl;
                 return false;
             }
             engine_ = std::shared_ptr<nvinfer1::ICudaEngine>(engine, samplesCommon::InferDeleter());
-            gLogInfo << "Loaded serialized network model from "
+            // The serialized engine can't run batches larger than the one it
+            // was built with.
+            if (engine_->getMaxBatchSize() < config_.max_batch_size) {
+                MR_LOG_ERROR << "Error: The serialized network model "
+                    << config_.serialized_model_filename << " supports batches of up to "
+                    << engine_->getMaxBatchSize() << " images but MaskRCNNConfig::max_batch_size is "
+                    << config_.max_batch_size << ", remove it to rebuild the network" << std::endl;
+                return false;
+            }
+            MR_LOG_INFO << "Loaded serialized network model from "
                 << config_.serialized_model_filename << std::endl;
         } else {
             // Build the network
@@ -165,10 +447,10 @@ namespace mr {
                 if (f.is_open()) {
                     f.write(reinterpret_cast<char*>(serializedModel->data()), serializedModel->size());
                     serializedModel->destroy();
-                    gLogInfo << "Saved serialized network model to "
+                    MR_LOG_INFO << "Saved serialized network model to "
                         << config_.serialized_model_filename << std::endl;
                 } else {
-                    gLogWarning << "Warning: Could not write serialized network model to "
+                    MR_LOG_WARNING << "Warning: Could not write serialized network model to "
                         << config_.serialized_model_filename << std::endl;
                 }
             }
@@ -179,75 +461,93 @@ namespace mr {
 
 
 
-    void MaskRCNN::preprocessInput(const samplesCommon::BufferManager& buffer_manager,
-                                   const cv::Mat&                      rgb_image,
-                                   bool                                in_bgr_order)
+    void MaskRCNN::preprocessInput(const cv::Mat& rgb_image,
+                                   int            batch_index,
+                                   bool           in_bgr_order)
     {
-        const int net_channels = input_dims_.d[0];
-        const int net_height = input_dims_.d[1];
-        const int net_width = input_dims_.d[2];
-        const int net_type = CV_8UC(net_channels);
-        // Ensure the input image has the same pixel type as the network.
-        assert(rgb_image.type() == net_type);
-        // This is the image that will be passed to the network. The zero
-        // initialization is important for padding purposes.
-        cv::Mat net_image (net_height, net_width, net_type, cv::Scalar(0));
-
-        // Find the dimensions that rgb_image must be resized to so that its
-        // maximum dimension is the same as the net_width (which should be the
-        // same as net_height) while keeping the aspect ratio.
-        const int input_max_dim = std::max(rgb_image.rows, rgb_image.cols);
-        const double scaling_factor = (double) net_width / input_max_dim;
-        const int input_new_width = rgb_image.cols * scaling_factor;
-        const int input_new_height = rgb_image.rows * scaling_factor;
-
-        // The coordinates in net_image where rgb_image will be copied.
-        const int x_start = (net_width - input_new_width) / 2;
-        const int y_start = (net_height - input_new_height) / 2;
-        const int x_end = x_start + input_new_width;
-        const int y_end = y_start + input_new_height;
-
-        // Get a view of the center of the net_image where the resized rgb_image
-        // will be copied into.
-        cv::Mat centre_image
-            = net_image(cv::Range(y_start, y_end), cv::Range(x_start, x_end));
-
-        // Resize the input image into the centre of the network image.
-        cv::resize(rgb_image, centre_image, centre_image.size());
+        // Get a pointer to the slice of the host input buffer for this image.
+        float* host_input_buffer = static_cast<float*>(backend_->hostBuffer(MaskRCNNConfig::model_input))
+            + batch_index * MaskRCNNConfig::model_input_volume;
+        MR_PROBE3(preprocess_start, frame_id_ + batch_index, rgb_image.cols, rgb_image.rows);
+        preprocess_image(rgb_image, host_input_buffer, in_bgr_order);
+        MR_PROBE1(preprocess_done, frame_id_ + batch_index);
+    }
 
-        // Change the channel order from BGR to RGB.
-        if (in_bgr_order) {
-            cv::cvtColor(net_image, net_image, cv::COLOR_BGR2RGB);
-        }
 
-        // The image data must be in continuous memory.
-        if (!net_image.isContinuous()) {
-            net_image = net_image.clone();
-        }
 
-        // Get a pointer to the host input buffer.
-        float* host_input_buffer = static_cast<float*>(buffer_manager.getHostBuffer(MaskRCNNConfig::model_input));
-        // Copy the image into the host buffer. The channels are not interleaved
-        // in the host buffer.
-        const size_t num_pixels = net_image.total();
-        const size_t num_channels = net_image.channels();
-        for (int c = 0; c < num_channels; c++) {
-            for (size_t p = 0; p < num_pixels; p++) {
-                host_input_buffer[c * num_pixels + p] = (float) net_image.data[p * num_channels + c] - MaskRCNNConfig::network_bias[c];
+    void MaskRCNN::captureOutput(const std::vector<cv::Size>& input_sizes)
+    {
+        const float* host_detection_buffer = static_cast<const float*>(
+                backend_->hostBuffer(MaskRCNNConfig::model_outputs[0]));
+        const float* host_mask_buffer = static_cast<const float*>(
+                backend_->hostBuffer(MaskRCNNConfig::model_outputs[1]));
+        for (size_t i = 0; i < input_sizes.size(); i++) {
+            const uint64_t frame_id = frame_id_ + i;
+            const bool periodic = config_.capture_interval > 0
+                && frame_id % config_.capture_interval == 0;
+            // Consume the trigger even if the frame is also periodic.
+            const bool triggered = capture_triggered_.exchange(false);
+            if (!periodic && !triggered) {
+                continue;
+            }
+            const bool written = capture_writer_->write(frame_id, input_sizes[i], triggered,
+                    host_detection_buffer + i * MaskRCNNConfig::model_detection_volume,
+                    host_mask_buffer + i * MaskRCNNConfig::model_mask_volume);
+            if (!written) {
+                MR_LOG_WARNING << "Warning: Could not write frame " << frame_id
+                    << " to capture " << config_.capture_filename << std::endl;
             }
         }
     }
 
 
 
-    std::vector<Detection> MaskRCNN::postprocessOutput(
-            const samplesCommon::BufferManager& buffer_manager,
-            int                                 input_width,
-            int                                 input_height)
+    std::vector<std::vector<Detection>> MaskRCNN::postprocessOutput(
+            const std::vector<cv::Size>& input_sizes)
     {
-        const void* host_detection_buffer = buffer_manager.getHostBuffer(MaskRCNNConfig::model_outputs[0]);
-        const void* host_mask_buffer = buffer_manager.getHostBuffer(MaskRCNNConfig::model_outputs[1]);
-        return get_detections(input_width, input_height, host_detection_buffer, host_mask_buffer);
+        MR_TRACE_SPAN("postprocess");
+        const float* host_detection_buffer = static_cast<const float*>(
+                backend_->hostBuffer(MaskRCNNConfig::model_outputs[0]));
+        const float* host_mask_buffer = static_cast<const float*>(
+                backend_->hostBuffer(MaskRCNNConfig::model_outputs[1]));
+        // Same as get_batch_detections() but timing the box and mask decoding
+        // separately.
+        std::vector<std::vector<Detection>> batch_detections (input_sizes.size());
+        std::vector<int> raw_indices;
+        size_t mask_bytes = 0;
+        for (size_t i = 0; i < input_sizes.size(); i++) {
+            const cv::Size& size = input_sizes[i];
+            {
+                MR_TIME_STAGE(*stats_, InferenceStage::detection_decode);
+                MR_TRACE_SPAN("decode_boxes");
+                batch_detections[i] = get_detection_boxes(size.width, size.height,
+                        host_detection_buffer + i * MaskRCNNConfig::model_detection_volume,
+                        raw_indices);
+            }
+            {
+                MR_TIME_STAGE(*stats_, InferenceStage::mask_decode);
+                MR_TRACE_SPAN("decode_masks");
+                mask_bytes += get_detection_masks(batch_detections[i], raw_indices,
+                        size.width, size.height,
+                        host_mask_buffer + i * MaskRCNNConfig::model_mask_volume,
+                        config_.max_mask_bytes);
+            }
+            const std::vector<Detection>& detections = batch_detections[i];
+            counters_->detections.add(detections.size());
+            counters_->masks_decoded.add(std::count_if(detections.begin(), detections.end(),
+                        [](const Detection& d) { return !d.mask.empty(); }));
+            counters_->last_frame_detections.store(detections.size(), std::memory_order_relaxed);
+            if (config_.max_mask_bytes > 0 && detections.size() * size.area() > config_.max_mask_bytes) {
+                counters_->degraded_frames.add();
+            }
+        }
+        InferenceCounters::updatePeak(counters_->peak_mask_bytes, mask_bytes);
+        // The 8-bit network mask get_detection_masks() allocates for each
+        // detection in turn.
+        const size_t int_mask_bytes = 4 * MaskRCNNConfig::mask_pool_size * MaskRCNNConfig::mask_pool_size;
+        InferenceCounters::updatePeak(counters_->peak_temporary_bytes_estimate,
+                input_sizes.capacity() * sizeof(cv::Size) + raw_indices.capacity() * sizeof(int)
+                + int_mask_bytes);
+        return batch_detections;
     }
 } // namespace mr
-
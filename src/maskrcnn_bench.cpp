@@ -0,0 +1,776 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+// Microbenchmarks of the CPU parts of the inference. No GPU is required, the
+// network outputs are generated with generate_synthetic_output().
+
+#include <algorithm>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "maskrcnn_trt/batch_processing.hpp"
+#include "maskrcnn_trt/detection.hpp"
+#include "maskrcnn_trt/detection_stream.hpp"
+#include "maskrcnn_trt/filesystem.hpp"
+#include "maskrcnn_trt/frame_source.hpp"
+#include "maskrcnn_trt/host_allocation.hpp"
+#include "maskrcnn_trt/logger.hpp"
+#include "maskrcnn_trt/mask_propagation.hpp"
+#include "maskrcnn_trt/maskrcnn.hpp"
+#include "maskrcnn_trt/maskrcnn_config.hpp"
+#include "maskrcnn_trt/motion_gate.hpp"
+#include "maskrcnn_trt/preprocessing.hpp"
+#include "maskrcnn_trt/replay_backend.hpp"
+#include "maskrcnn_trt/tracker.hpp"
+
+/** Return a random BGR image of the given dimensions.
+ */
+static cv::Mat random_image(int width, int height)
+{
+    cv::Mat image (height, width, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(UINT8_MAX));
+    return image;
+}
+
+
+
+/** Synthetic network output buffers for a single image.
+ */
+struct SyntheticOutput {
+    std::vector<float> detections;
+    std::vector<float> masks;
+
+    SyntheticOutput(int num_detections, float box_size)
+        : detections(mr::MaskRCNNConfig::model_detection_volume),
+          masks(mr::MaskRCNNConfig::model_mask_volume)
+    {
+        mr::generate_synthetic_output(num_detections, box_size, 0,
+                detections.data(), masks.data());
+    }
+};
+
+
+
+// Arguments: input width, input height.
+static void BM_preprocess_image(benchmark::State& state)
+{
+    const cv::Mat image = random_image(state.range(0), state.range(1));
+    std::vector<float> input_buffer (mr::MaskRCNNConfig::model_input_volume);
+    for (auto _ : state) {
+        mr::preprocess_image(image, input_buffer.data());
+        benchmark::DoNotOptimize(input_buffer.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_preprocess_image)
+    ->Args({640, 480})
+    ->Args({1280, 720})
+    ->Args({1920, 1080})
+    ->Args({3840, 2160})
+    ->Unit(benchmark::kMillisecond);
+
+
+
+/** The implementation of mr::preprocess_image() before it split the
+ * channels with cv::split(), converting each pixel in a scalar loop.
+ */
+static void legacy_preprocess_image(const cv::Mat& image, float* input_buffer)
+{
+    const int net_height = mr::MaskRCNNConfig::model_input_shape[1];
+    const int net_width = mr::MaskRCNNConfig::model_input_shape[2];
+    cv::Mat net_image (net_height, net_width, CV_8UC3, cv::Scalar(0));
+    const double scaling_factor = (double) net_width / std::max(image.rows, image.cols);
+    const int input_new_width = image.cols * scaling_factor;
+    const int input_new_height = image.rows * scaling_factor;
+    const int x_start = (net_width - input_new_width) / 2;
+    const int y_start = (net_height - input_new_height) / 2;
+    cv::Mat centre_image = net_image(cv::Rect(x_start, y_start, input_new_width, input_new_height));
+    cv::resize(image, centre_image, centre_image.size());
+    cv::cvtColor(net_image, net_image, cv::COLOR_BGR2RGB);
+    const size_t num_pixels = net_image.total();
+    const size_t num_channels = net_image.channels();
+    for (size_t c = 0; c < num_channels; c++) {
+        for (size_t p = 0; p < num_pixels; p++) {
+            input_buffer[c * num_pixels + p] = (float) net_image.data[p * num_channels + c]
+                - mr::MaskRCNNConfig::network_bias[c];
+        }
+    }
+}
+
+
+
+// Arguments: mr::HostAllocation of the input buffer. Pinned memory falls back
+// to aligned memory without a CUDA device.
+static void BM_preprocess_image_legacy_allocation(benchmark::State& state)
+{
+    const cv::Mat image = random_image(1280, 720);
+    const mr::HostAllocation allocation
+        = mr::resolve_host_allocation(static_cast<mr::HostAllocation>(state.range(0)));
+    const size_t bytes = mr::MaskRCNNConfig::model_input_volume * sizeof(float);
+    float* input_buffer = static_cast<float*>(mr::allocate_host(bytes, allocation));
+    if (!input_buffer) {
+        state.SkipWithError("Could not allocate the input buffer");
+        return;
+    }
+    std::vector<float> expected (mr::MaskRCNNConfig::model_input_volume);
+    mr::preprocess_image(image, expected.data());
+    legacy_preprocess_image(image, input_buffer);
+    if (!std::equal(expected.begin(), expected.end(), input_buffer)) {
+        mr::free_host(input_buffer, allocation);
+        state.SkipWithError("The input buffers differ");
+        return;
+    }
+    for (auto _ : state) {
+        legacy_preprocess_image(image, input_buffer);
+        benchmark::DoNotOptimize(input_buffer);
+        benchmark::ClobberMemory();
+    }
+    mr::free_host(input_buffer, allocation);
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(mr::host_allocation_name(allocation));
+}
+BENCHMARK(BM_preprocess_image_legacy_allocation)
+    ->DenseRange(static_cast<int>(mr::HostAllocation::pageable),
+            static_cast<int>(mr::HostAllocation::pinned))
+    ->Unit(benchmark::kMillisecond);
+
+
+
+// Arguments: mr::HostAllocation of the input buffer. Pinned memory falls back
+// to aligned memory without a CUDA device.
+static void BM_preprocess_image_allocation(benchmark::State& state)
+{
+    const cv::Mat image = random_image(1280, 720);
+    const mr::HostAllocation allocation
+        = mr::resolve_host_allocation(static_cast<mr::HostAllocation>(state.range(0)));
+    const size_t bytes = mr::MaskRCNNConfig::model_input_volume * sizeof(float);
+    float* input_buffer = static_cast<float*>(mr::allocate_host(bytes, allocation));
+    if (!input_buffer) {
+        state.SkipWithError("Could not allocate the input buffer");
+        return;
+    }
+    for (auto _ : state) {
+        mr::preprocess_image(image, input_buffer);
+        benchmark::DoNotOptimize(input_buffer);
+        benchmark::ClobberMemory();
+    }
+    mr::free_host(input_buffer, allocation);
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(mr::host_allocation_name(allocation));
+}
+BENCHMARK(BM_preprocess_image_allocation)
+    ->DenseRange(static_cast<int>(mr::HostAllocation::pageable),
+            static_cast<int>(mr::HostAllocation::pinned))
+    ->Unit(benchmark::kMillisecond);
+
+
+
+// Arguments: number of valid detections, box side as a percentage of the
+// network input side.
+static void BM_get_detections(benchmark::State& state)
+{
+    const SyntheticOutput output (state.range(0), state.range(1) / 100.0f);
+    for (auto _ : state) {
+        std::vector<mr::Detection> detections = mr::get_detections(1280, 720,
+                output.detections.data(), output.masks.data());
+        benchmark::DoNotOptimize(detections.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["detections"] = state.range(0);
+}
+BENCHMARK(BM_get_detections)
+    ->ArgsProduct({{0, 1, 10, 50, 100}, {5, 20, 50}})
+    ->Unit(benchmark::kMillisecond);
+
+
+
+/** The implementation of mr::visualize_detections() before
+ * mr::render_detections(), blending each mask over the whole image.
+ */
+static cv::Mat legacy_visualize_detections(const std::vector<mr::Detection>& detections,
+                                           const cv::Mat&                    image)
+{
+    cv::Mat render = image.clone();
+    for (const auto& d : detections) {
+        if (d.mask.empty()) {
+            continue;
+        }
+        const uint8_t* colour = mr::MaskRCNNConfig::class_colours[d.class_id];
+        const cv::Scalar cv_colour (colour[2], colour[1], colour[0]);
+        cv::Mat render_roi = d.box_local_mask
+            ? render(cv::Rect(d.x_start, d.y_start, d.mask.cols, d.mask.rows))
+            : render;
+        cv::Mat colour_image (d.mask.size(), CV_8UC3, cv_colour);
+        cv::Mat blended_render;
+        cv::addWeighted(render_roi, 1.0 - mr::MaskRCNNConfig::mask_threshold,
+                colour_image, mr::MaskRCNNConfig::mask_threshold, 0.0, blended_render);
+        cv::Mat binary_mask;
+        cv::threshold(d.mask, binary_mask, UINT8_MAX/2.0, UINT8_MAX, cv::THRESH_BINARY);
+        blended_render.copyTo(render_roi, binary_mask);
+    }
+    for (const auto& d : detections) {
+        const uint8_t* colour = mr::MaskRCNNConfig::class_colours[d.class_id];
+        const cv::Scalar cv_colour (colour[2], colour[1], colour[0]);
+        cv::rectangle(render, cv::Point(d.x_start, d.y_start),
+                cv::Point(d.x_end - 1, d.y_end - 1), cv_colour);
+        const std::string label = mr::MaskRCNNConfig::class_names[d.class_id]
+            + " " + std::to_string(d.confidence).substr(0, 4);
+        cv::putText(render, label, cv::Point(d.x_start, d.y_start - 2),
+                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv_colour);
+    }
+    return render;
+}
+
+
+
+// Arguments: number of detections.
+static void BM_visualize_detections_legacy(benchmark::State& state)
+{
+    const SyntheticOutput output (state.range(0), 0.2f);
+    const cv::Mat image = random_image(1280, 720);
+    const std::vector<mr::Detection> detections = mr::get_detections(image.cols,
+            image.rows, output.detections.data(), output.masks.data());
+    if (cv::norm(legacy_visualize_detections(detections, image),
+                mr::visualize_detections(detections, image), cv::NORM_INF) != 0) {
+        state.SkipWithError("The renders differ");
+        return;
+    }
+    for (auto _ : state) {
+        cv::Mat render = legacy_visualize_detections(detections, image);
+        benchmark::DoNotOptimize(render.data);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_visualize_detections_legacy)
+    ->Arg(1)
+    ->Arg(10)
+    ->Arg(100)
+    ->Unit(benchmark::kMillisecond);
+
+
+
+// Arguments: number of detections.
+static void BM_visualize_detections(benchmark::State& state)
+{
+    const SyntheticOutput output (state.range(0), 0.2f);
+    const cv::Mat image = random_image(1280, 720);
+    const std::vector<mr::Detection> detections = mr::get_detections(image.cols,
+            image.rows, output.detections.data(), output.masks.data());
+    for (auto _ : state) {
+        cv::Mat render = mr::visualize_detections(detections, image);
+        benchmark::DoNotOptimize(render.data);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_visualize_detections)
+    ->Arg(1)
+    ->Arg(10)
+    ->Arg(100)
+    ->Unit(benchmark::kMillisecond);
+
+
+
+// Arguments: number of detections, image height. The image has a 16:9 aspect
+// ratio. Renders into a preallocated image.
+static void BM_render_detections(benchmark::State& state)
+{
+    const SyntheticOutput output (state.range(0), 0.2f);
+    const cv::Mat image = random_image(state.range(1) * 16 / 9, state.range(1));
+    const std::vector<mr::Detection> detections = mr::get_detections(image.cols,
+            image.rows, output.detections.data(), output.masks.data());
+    cv::Mat render (image.size(), image.type());
+    for (auto _ : state) {
+        image.copyTo(render);
+        mr::render_detections(detections, render);
+        benchmark::DoNotOptimize(render.data);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_render_detections)
+    ->ArgsProduct({{1, 10, 100}, {720, 2160}})
+    ->Unit(benchmark::kMillisecond);
+
+
+
+// Arguments: whether to decode with mr::read_image() instead of cv::imread().
+// Decodes a 20 MP JPEG image.
+static void BM_read_image(benchmark::State& state)
+{
+    static const std::string filename = []() {
+        const std::string f = (stdfs::temp_directory_path() / "maskrcnn_bench_20mp.jpg").string();
+        cv::imwrite(f, random_image(5472, 3648));
+        return f;
+    }();
+    cv::Size original_size;
+    for (auto _ : state) {
+        cv::Mat image = state.range(0) ? mr::read_image(filename, original_size)
+            : cv::imread(filename);
+        benchmark::DoNotOptimize(image.data);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_read_image)
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+
+
+/** Return the filenames of 64 random 1280x720 JPEG images, written to a
+ * temporary directory the first time this is called.
+ */
+static const std::vector<std::string>& batch_images()
+{
+    static const std::vector<std::string> filenames = []() {
+        const stdfs::path directory = stdfs::temp_directory_path() / "maskrcnn_bench_images";
+        stdfs::create_directories(directory);
+        std::vector<std::string> f;
+        for (int i = 0; i < 64; i++) {
+            f.push_back((directory / (std::to_string(i) + ".jpg")).string());
+            cv::imwrite(f.back(), random_image(1280, 720));
+        }
+        return f;
+    }();
+    return filenames;
+}
+
+
+
+// Arguments: decoder threads, writer threads, whether to save visualizations.
+// Inference is replaced by a ReplayBackend with synthetic output so only
+// decoding, postprocessing and writing are measured.
+static void BM_process_batch(benchmark::State& state)
+{
+    const std::vector<std::string>& filenames = batch_images();
+    auto backend = std::make_unique<mr::ReplayBackend>();
+    backend->addSyntheticFrame(10, 0.2f);
+    mr::MaskRCNN network (mr::MaskRCNNConfig(), std::move(backend));
+    if (!network.build()) {
+        state.SkipWithError("Could not build the network");
+        return;
+    }
+    const stdfs::path directory = stdfs::temp_directory_path() / "maskrcnn_bench_output";
+    mr::BatchOptions options;
+    options.output_filename = (directory.parent_path() / "maskrcnn_bench_output.jsonl").string();
+    options.num_decoders = state.range(0);
+    options.num_writers = state.range(1);
+    if (state.range(2)) {
+        options.visualization_directory = directory.string();
+    }
+    for (auto _ : state) {
+        const mr::BatchSummary summary = mr::process_batch(network, filenames, options);
+        if (!summary.written || summary.failed > 0) {
+            state.SkipWithError("Processing the batch failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * filenames.size());
+}
+BENCHMARK(BM_process_batch)
+    ->ArgsProduct({{1, 2, 4}, {1, 2, 4}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+
+
+// Arguments: whether to save visualizations. Reads 32 generated raw 1280x720
+// BGR frames from a file descriptor like the --stream mode of
+// maskrcnn-trt-example does from standard input. Inference is replaced by a
+// ReplayBackend with synthetic output.
+static void BM_process_stream_raw(benchmark::State& state)
+{
+    static const cv::Size frame_size (1280, 720);
+    static const int num_frames = 32;
+    static const std::string filename = []() {
+        const std::string f = (stdfs::temp_directory_path() / "maskrcnn_bench_frames.raw").string();
+        std::ofstream raw (f, std::ios::binary);
+        for (int i = 0; i < num_frames; i++) {
+            const cv::Mat frame = random_image(frame_size.width, frame_size.height);
+            raw.write(reinterpret_cast<const char*>(frame.data), frame.total() * frame.elemSize());
+        }
+        return f;
+    }();
+    auto backend = std::make_unique<mr::ReplayBackend>();
+    backend->addSyntheticFrame(10, 0.2f);
+    mr::MaskRCNN network (mr::MaskRCNNConfig(), std::move(backend));
+    if (!network.build()) {
+        state.SkipWithError("Could not build the network");
+        return;
+    }
+    const stdfs::path directory = stdfs::temp_directory_path() / "maskrcnn_bench_output";
+    mr::BatchOptions options;
+    options.output_filename = (directory.parent_path() / "maskrcnn_bench_output.jsonl").string();
+    if (state.range(0)) {
+        options.visualization_directory = directory.string();
+    }
+    for (auto _ : state) {
+        const int fd = open(filename.c_str(), O_RDONLY);
+        mr::RawFrameSource source (fd, frame_size);
+        const mr::BatchSummary summary = mr::process_stream(network, source, options);
+        close(fd);
+        if (!summary.written || summary.images != num_frames) {
+            state.SkipWithError("Processing the stream failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * num_frames);
+}
+BENCHMARK(BM_process_stream_raw)
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+
+
+/** Return the detections of a synthetic 1280x720 frame with num_objects
+ * non-overlapping 64x64 boxes with box-local masks on a grid, all moved by
+ * (3, 2) pixels per frame.
+ */
+static std::vector<mr::Detection> moving_detections(int num_objects, int frame)
+{
+    std::vector<mr::Detection> detections;
+    for (int i = 0; i < num_objects; i++) {
+        const float x = 16 + 96 * (i % 12) + 3 * frame;
+        const float y = 16 + 96 * (i / 12) + 2 * frame;
+        detections.push_back({1 + i % 3, 0.9f, x, y, x + 64, y + 64,
+                cv::Mat(64, 64, CV_8UC1, cv::Scalar(255)), true, -1});
+    }
+    return detections;
+}
+
+
+
+/** Return whether detections contain exactly one detection overlapping each
+ * object of moving_detections() on frame with the track ID of the object in
+ * track_ids.
+ */
+static bool tracks_match(const std::vector<mr::Detection>& detections,
+                         int                               frame,
+                         const std::vector<int>&           track_ids)
+{
+    const std::vector<mr::Detection> objects = moving_detections(track_ids.size(), frame);
+    std::vector<int> found (objects.size(), 0);
+    for (const auto& d : detections) {
+        // The objects are further apart than their size so a detection can
+        // overlap at most one.
+        const auto overlaps = [&d](const mr::Detection& o) {
+            return std::min(d.x_end, o.x_end) - std::max(d.x_start, o.x_start) > 32
+                && std::min(d.y_end, o.y_end) - std::max(d.y_start, o.y_start) > 32;
+        };
+        const auto it = std::find_if(objects.begin(), objects.end(), overlaps);
+        if (it == objects.end() || d.track_id != track_ids[it - objects.begin()]) {
+            return false;
+        }
+        found[it - objects.begin()]++;
+    }
+    return std::all_of(found.begin(), found.end(), [](int n) { return n == 1; });
+}
+
+
+
+// Arguments: number of objects, keyframe stride. Tracks a 30-frame synthetic
+// sequence, running IoUTracker::update() on keyframes and
+// IoUTracker::predict() on the frames in between. Fails if the track ID of
+// any object changes on any frame.
+static void BM_tracker(benchmark::State& state)
+{
+    static const int num_frames = 30;
+    const int num_objects = state.range(0);
+    const int stride = state.range(1);
+    std::vector<std::vector<mr::Detection>> sequence;
+    for (int f = 0; f < num_frames; f += stride) {
+        sequence.push_back(moving_detections(num_objects, f));
+    }
+    {
+        mr::IoUTracker tracker;
+        std::vector<int> track_ids;
+        for (const auto& d : tracker.update(sequence[0], cv::Size(1280, 720))) {
+            track_ids.push_back(d.track_id);
+        }
+        for (int f = 1; f < num_frames; f++) {
+            const std::vector<mr::Detection> d = f % stride == 0
+                ? tracker.update(sequence[f / stride], cv::Size(1280, 720))
+                : tracker.predict();
+            if (!tracks_match(d, f, track_ids)) {
+                state.SkipWithError("Objects were not kept on their tracks");
+                return;
+            }
+        }
+    }
+    for (auto _ : state) {
+        mr::IoUTracker tracker;
+        for (int f = 0; f < num_frames; f++) {
+            if (f % stride == 0) {
+                const std::vector<mr::Detection> d =
+                    tracker.update(sequence[f / stride], cv::Size(1280, 720));
+                benchmark::DoNotOptimize(d.data());
+            } else {
+                const std::vector<mr::Detection> d = tracker.predict();
+                benchmark::DoNotOptimize(d.data());
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * num_frames);
+}
+BENCHMARK(BM_tracker)
+    ->ArgsProduct({{1, 10, 64}, {1, 2, 5}})
+    ->Unit(benchmark::kMicrosecond);
+
+
+
+// Arguments: image height. The image has a 16:9 aspect ratio. Gates a static
+// frame, which is skipped after the first time.
+static void BM_motion_gate(benchmark::State& state)
+{
+    const cv::Mat image = random_image(state.range(0) * 16 / 9, state.range(0));
+    mr::MotionGateConfig config;
+    config.max_skipped_frames = 0;
+    mr::MotionGate gate (config);
+    for (auto _ : state) {
+        const mr::MotionGate::Decision decision = gate.update(image);
+        benchmark::DoNotOptimize(decision);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["hit_rate"] = gate.stats().hitRate();
+}
+BENCHMARK(BM_motion_gate)
+    ->Arg(480)
+    ->Arg(720)
+    ->Arg(2160)
+    ->Unit(benchmark::kMicrosecond);
+
+
+
+// Arguments: number of detections. Propagates 100x100 box-local masks from a
+// random 1280x720 frame to a copy shifted by (3, 2) pixels. Fails if the flow
+// confidence is too low.
+static void BM_mask_propagation(benchmark::State& state)
+{
+    cv::Mat image;
+    cv::cvtColor(random_image(1280, 720), image, cv::COLOR_BGR2GRAY);
+    cv::Mat next_image (image.size(), image.type(), cv::Scalar(0));
+    image(cv::Rect(0, 0, image.cols - 3, image.rows - 2))
+        .copyTo(next_image(cv::Rect(3, 2, image.cols - 3, image.rows - 2)));
+    std::vector<mr::Detection> keyframe_detections;
+    for (int i = 0; i < state.range(0); i++) {
+        const float x = 20 + 120 * (i % 10);
+        const float y = 20 + 120 * (i / 10);
+        keyframe_detections.push_back({1, 0.9f, x, y, x + 100, y + 100,
+                cv::Mat(100, 100, CV_8UC1, cv::Scalar(255)), true, i});
+    }
+    mr::MaskPropagator propagator;
+    std::vector<mr::Detection> detections;
+    for (auto _ : state) {
+        state.PauseTiming();
+        propagator.setKeyframe(image, keyframe_detections);
+        state.ResumeTiming();
+        if (!propagator.propagate(next_image, detections)) {
+            state.SkipWithError("The flow confidence was too low");
+            break;
+        }
+        benchmark::DoNotOptimize(detections.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_mask_propagation)
+    ->Arg(1)
+    ->Arg(10)
+    ->Arg(50)
+    ->Unit(benchmark::kMillisecond);
+
+
+
+/** The detections of 32 synthetic 1280x720 frames with 10 detections each and
+ * full-image masks.
+ */
+static const std::vector<std::vector<mr::Detection>>& stream_detections()
+{
+    static const std::vector<std::vector<mr::Detection>> frames = []() {
+        const SyntheticOutput output (10, 0.2f);
+        return std::vector<std::vector<mr::Detection>>(32, mr::get_detections(1280, 720,
+                    output.detections.data(), output.masks.data()));
+    }();
+    return frames;
+}
+
+/** Save the masks of stream_detections() as a full-image PNG per mask in
+ * directory, the alternative to a detection stream, and return their total
+ * size in bytes.
+ */
+static uintmax_t write_png_masks(const stdfs::path& directory)
+{
+    uintmax_t size = 0;
+    const std::vector<std::vector<mr::Detection>>& frames = stream_detections();
+    for (size_t f = 0; f < frames.size(); f++) {
+        for (size_t i = 0; i < frames[f].size(); i++) {
+            const stdfs::path filename = directory / (std::to_string(f) + "_" + std::to_string(i) + ".png");
+            cv::imwrite(filename.string(), frames[f][i].mask);
+            size += stdfs::file_size(filename);
+        }
+    }
+    return size;
+}
+
+
+
+// Arguments: 0 to save a PNG per mask, otherwise the mr::MaskEncoding of a
+// detection stream. Writes stream_detections().
+static void BM_detection_storage_write(benchmark::State& state)
+{
+    const stdfs::path directory = stdfs::temp_directory_path() / "maskrcnn_bench_masks";
+    stdfs::create_directories(directory);
+    const std::string filename = (directory / "detections.mrd").string();
+    const std::vector<std::vector<mr::Detection>>& frames = stream_detections();
+    uintmax_t size = 0;
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            size = write_png_masks(directory);
+            continue;
+        }
+        mr::DetectionStreamWriter writer;
+        if (!writer.open(filename, static_cast<mr::MaskEncoding>(state.range(0)))) {
+            state.SkipWithError("Could not open the detection stream");
+            break;
+        }
+        for (size_t f = 0; f < frames.size(); f++) {
+            writer.write(f, cv::Size(1280, 720), frames[f]);
+        }
+        size = writer.bytesWritten();
+    }
+    state.SetItemsProcessed(state.iterations() * frames.size());
+    state.counters["bytes_per_frame"] = static_cast<double>(size) / frames.size();
+}
+BENCHMARK(BM_detection_storage_write)
+    ->Arg(0)
+    ->Arg(static_cast<int>(mr::MaskEncoding::raw))
+    ->Arg(static_cast<int>(mr::MaskEncoding::rle))
+    ->Unit(benchmark::kMillisecond);
+
+
+
+// Arguments: 0 to load a PNG per mask, otherwise the mr::MaskEncoding of a
+// detection stream. Reads all masks of stream_detections().
+static void BM_detection_storage_read(benchmark::State& state)
+{
+    const stdfs::path directory = stdfs::temp_directory_path() / "maskrcnn_bench_masks";
+    stdfs::create_directories(directory);
+    const std::string filename = (directory / "detections.mrd").string();
+    const std::vector<std::vector<mr::Detection>>& frames = stream_detections();
+    if (state.range(0) == 0) {
+        write_png_masks(directory);
+    } else {
+        mr::DetectionStreamWriter writer;
+        writer.open(filename, static_cast<mr::MaskEncoding>(state.range(0)));
+        for (size_t f = 0; f < frames.size(); f++) {
+            writer.write(f, cv::Size(1280, 720), frames[f]);
+        }
+    }
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            for (size_t f = 0; f < frames.size(); f++) {
+                for (size_t i = 0; i < frames[f].size(); i++) {
+                    const cv::Mat mask = cv::imread((directory
+                                / (std::to_string(f) + "_" + std::to_string(i) + ".png")).string(),
+                            cv::IMREAD_GRAYSCALE);
+                    benchmark::DoNotOptimize(mask.data);
+                }
+            }
+            continue;
+        }
+        mr::DetectionStreamReader reader;
+        if (!reader.open(filename) || reader.size() != frames.size()) {
+            state.SkipWithError("Could not read the detection stream");
+            break;
+        }
+        for (size_t f = 0; f < reader.size(); f++) {
+            const mr::DetectionFrameView frame = reader.frame(f);
+            for (size_t i = 0; i < frame.size; i++) {
+                const mr::Detection d = frame.detection(i);
+                benchmark::DoNotOptimize(d.mask.data);
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * frames.size());
+}
+BENCHMARK(BM_detection_storage_read)
+    ->Arg(0)
+    ->Arg(static_cast<int>(mr::MaskEncoding::raw))
+    ->Arg(static_cast<int>(mr::MaskEncoding::rle))
+    ->Unit(benchmark::kMillisecond);
+
+
+
+// A log message operand that is costly to evaluate.
+static std::string log_operand(int64_t i)
+{
+    return "frame " + std::to_string(i);
+}
+
+
+
+// The loop overhead, for comparison with the filtered-out log statements.
+static void BM_log_baseline(benchmark::State& state)
+{
+    int64_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(i++);
+    }
+}
+BENCHMARK(BM_log_baseline);
+
+
+
+// A statement less severe than MR_LOG_COMPILED_SEVERITY, removed by the
+// compiler.
+static void BM_log_compiled_out(benchmark::State& state)
+{
+    int64_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(i++);
+        MR_LOG_IF_REPORTABLE(static_cast<Severity>(MR_LOG_COMPILED_SEVERITY + 1), gLogVerbose)
+            << log_operand(i) << std::endl;
+    }
+}
+BENCHMARK(BM_log_compiled_out);
+
+
+
+// A compiled-in statement filtered out by the runtime severity.
+static void BM_log_runtime_filtered(benchmark::State& state)
+{
+    setReportableSeverity(Severity::kERROR);
+    int64_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(i++);
+        MR_LOG_WARNING << log_operand(i) << std::endl;
+    }
+    setReportableSeverity(Severity::kINFO);
+}
+BENCHMARK(BM_log_runtime_filtered);
+
+
+
+// The same statement through the stream directly, which evaluates the
+// operands before the severity is checked.
+static void BM_log_stream_filtered(benchmark::State& state)
+{
+    setReportableSeverity(Severity::kERROR);
+    int64_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(i++);
+        gLogWarning << log_operand(i) << std::endl;
+    }
+    setReportableSeverity(Severity::kINFO);
+}
+BENCHMARK(BM_log_stream_filtered);
+
+BENCHMARK_MAIN();
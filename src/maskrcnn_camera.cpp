@@ -2,12 +2,105 @@
 // SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
 // SPDX-License-Identifier: Apache-2.0
 
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <thread>
 
 #include <opencv2/highgui.hpp>
 #include <opencv2/videoio.hpp>
 
+#include "maskrcnn_trt/mailbox.hpp"
 #include "maskrcnn_trt/maskrcnn.hpp"
+#include "maskrcnn_trt/stats.hpp"
+#include "maskrcnn_trt/trace.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+/** A captured camera frame.
+ */
+struct Frame {
+    cv::Mat image;
+    Clock::time_point capture_time;
+};
+
+/** A frame together with its detections.
+ */
+struct DetectedFrame {
+    Frame frame;
+    std::vector<mr::Detection> detections;
+    float inference_ms = 0.0f;
+};
+
+/** The statistics of the displayed frames, printed periodically.
+ */
+struct DisplayStats {
+    mr::LatencyHistogram latency;
+    uint64_t displayed = 0;
+    Clock::time_point start = Clock::now();
+
+    void print(const mr::Mailbox<Frame>& frames, const mr::Mailbox<DetectedFrame>& detected)
+    {
+        const mr::LatencySummary l = latency.summary();
+        const float seconds = std::chrono::duration<float>(Clock::now() - start).count();
+        std::cout << "Displayed " << displayed / seconds << " FPS, capture-to-display latency"
+            << " p50 " << l.p50 << " ms, p99 " << l.p99 << " ms, max " << l.max << " ms,"
+            << " dropped " << frames.dropped() << " captured and "
+            << detected.dropped() << " detected frames\n";
+        latency.reset();
+        displayed = 0;
+        start = Clock::now();
+    }
+};
+
+/** Capture frames and post them to frames until stop is set or capturing
+ * fails, in which case failed is also set. Frames the inference thread hasn't
+ * taken yet are replaced so it always gets the latest one.
+ */
+static void capture_loop(cv::VideoCapture& cap, mr::Mailbox<Frame>& frames, std::atomic<bool>& stop,
+        std::atomic<bool>& failed)
+{
+    mr::trace_thread_name("capture");
+    while (!stop) {
+        Frame frame;
+        {
+            MR_TRACE_SPAN("capture");
+            cap.read(frame.image);
+        }
+        frame.capture_time = Clock::now();
+        if (frame.image.empty()) {
+            std::cerr << "Error reading image\n";
+            failed = true;
+            stop = true;
+            break;
+        }
+        frames.post(std::move(frame));
+    }
+    frames.close();
+}
+
+/** Run inference on the latest frame from frames and post the result to
+ * detected until frames is closed.
+ */
+static void inference_loop(mr::MaskRCNN& network, mr::Mailbox<Frame>& frames,
+        mr::Mailbox<DetectedFrame>& detected)
+{
+    mr::trace_thread_name("inference");
+    while (true) {
+        DetectedFrame d;
+        if (!frames.waitTake(d.frame, std::chrono::milliseconds(100))) {
+            if (frames.closed()) {
+                break;
+            }
+            continue;
+        }
+        const auto t_start = Clock::now();
+        d.detections = network.infer(d.frame.image);
+        d.inference_ms = std::chrono::duration<float, std::milli>(Clock::now() - t_start).count();
+        detected.post(std::move(d));
+    }
+    detected.close();
+}
 
 int main(int argc, char** argv) {
     const char *device = "/dev/video0";
@@ -34,30 +127,66 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
-    do {
-        cv::Mat image;
-        cap.read(image);
-        if (image.empty()) {
-            cerr << "Error reading image\n";
-            return EXIT_FAILURE;
-        }
+    // Record a timeline of the camera threads if MASKRCNN_TRACE is set to the
+    // name of the trace file.
+    const char* trace_filename = std::getenv("MASKRCNN_TRACE");
+    if (trace_filename) {
+        mr::trace_thread_name("display");
+        mr::trace_enable();
+    }
 
-        const auto t_start = std::chrono::high_resolution_clock::now();
-        const std::vector<mr::Detection> detections = network.infer(image);
-        const auto t_end = std::chrono::high_resolution_clock::now();
-        const float t = std::chrono::duration<float, std::milli>(t_end - t_start).count();
-        std::cout << "Inference time was " << t << " ms\n";
+    // Capture, inference and display run on separate threads connected by
+    // single-slot mailboxes, so each thread always processes the latest frame
+    // and older frames are dropped instead of queueing up.
+    mr::Mailbox<Frame> frames;
+    mr::Mailbox<DetectedFrame> detected;
+    std::atomic<bool> stop {false};
+    std::atomic<bool> capture_failed {false};
+    std::thread capture_thread (capture_loop, std::ref(cap), std::ref(frames), std::ref(stop),
+            std::ref(capture_failed));
+    std::thread inference_thread (inference_loop, std::ref(network), std::ref(frames),
+            std::ref(detected));
 
-        for (const auto& detection : detections) {
-            std::cout << "  " << detection << "\n";
+    // Display on the main thread since some GUI backends require it.
+    DisplayStats stats;
+    DetectedFrame d;
+    while (!stop) {
+        if (detected.waitTake(d, std::chrono::milliseconds(10))) {
+            std::cout << "Inference time was " << d.inference_ms << " ms\n";
+            for (const auto& detection : d.detections) {
+                std::cout << "  " << detection << "\n";
+            }
+            {
+                MR_TRACE_SPAN("render");
+                // The image isn't needed after this so render on it directly.
+                mr::render_detections(d.detections, d.frame.image);
+                cv::imshow("Mask R-CNN", d.frame.image);
+            }
+            stats.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - d.frame.capture_time).count());
+            stats.displayed++;
+            if (Clock::now() - stats.start >= std::chrono::seconds(5)) {
+                stats.print(frames, detected);
+            }
+        } else if (detected.closed()) {
+            break;
+        }
+        if (cv::waitKey(1) == 'q') {
+            stop = true;
         }
+    }
+    stop = true;
+    capture_thread.join();
+    inference_thread.join();
+    stats.print(frames, detected);
 
-        cv::imshow("Mask R-CNN", visualize_detections(detections, image));
-        if (cv::waitKey(10) == 'q') {
-            break;
+    if (trace_filename) {
+        if (mr::trace_write(trace_filename)) {
+            std::cout << "Saved trace in " << trace_filename << "\n";
+        } else {
+            std::cerr << "Error saving trace in " << trace_filename << "\n";
         }
-    } while (true);
+    }
 
-    return EXIT_SUCCESS;
+    return capture_failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
-
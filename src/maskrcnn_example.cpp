@@ -3,17 +3,175 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
 
 #include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
 
+#include "maskrcnn_trt/batch_processing.hpp"
+#include "maskrcnn_trt/frame_source.hpp"
 #include "maskrcnn_trt/maskrcnn.hpp"
+#include "maskrcnn_trt/preprocessing.hpp"
+#include "maskrcnn_trt/replay_backend.hpp"
+#include "maskrcnn_trt/trace.hpp"
+
+static void print_usage()
+{
+    std::cout << "maskrcnn-trt-example MODEL IMAGE...\n"
+        << "maskrcnn-trt-example MODEL --batch INPUT OUTPUT [OPTION]...\n"
+        << "  Run inference on all images in INPUT, which may be a directory, a glob\n"
+        << "  pattern or a file containing one image filename per line, and write the\n"
+        << "  detections to OUTPUT, one JSON object per image and line.\n"
+        << "maskrcnn-trt-example MODEL --stream INPUT OUTPUT [OPTION]...\n"
+        << "  Run inference on all frames of the video file INPUT, or of raw frames\n"
+        << "  read from standard input if INPUT is -, and write the detections to\n"
+        << "  OUTPUT, one JSON object per frame and line.\n"
+        << "  --raw WxH[:FMT]  The size and pixel format (bgr24 or rgb24, default\n"
+        << "                   bgr24) of the raw frames, required if INPUT is -.\n"
+        << "  --keyframes N    Run inference only on every Nth frame and track the\n"
+        << "                   detections in between (default 1).\n"
+        << "  --adaptive       Lower the keyframe stride when tracking fails.\n"
+        << "  --flow           Propagate the masks between keyframes with optical flow.\n"
+        << "  --motion T       Reuse the previous detections for frames whose mean\n"
+        << "                   absolute difference is below T (in the range 0-255).\n"
+        << "Options:\n"
+        << "  --visualize DIR  Save the detection visualizations in DIR.\n"
+        << "  --decoders N     Decode images on N threads (default 2).\n"
+        << "  --writers N      Write the results on N threads (default 2).\n"
+        << "  --replay         Replay the network outputs of the capture MODEL instead\n"
+        << "                   of running inference, requiring no GPU. A MODEL of\n"
+        << "                   \"synthetic\" replays synthetic outputs.\n";
+}
+
+
+
+/** Process a batch of images or a stream of frames as described in
+ * print_usage().
+ */
+static int batch_main(int argc, char** argv, bool stream)
+{
+    if (argc < 5) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    const std::string model (argv[1]);
+    const std::string input (argv[3]);
+    mr::BatchOptions options;
+    options.output_filename = argv[4];
+    bool replay = false;
+    std::string raw_spec;
+    for (int i = 5; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--visualize") == 0 && has_value) {
+            options.visualization_directory = argv[++i];
+        } else if (strcmp(argv[i], "--decoders") == 0 && has_value) {
+            options.num_decoders = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--writers") == 0 && has_value) {
+            options.num_writers = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--raw") == 0 && has_value && stream) {
+            raw_spec = argv[++i];
+        } else if (strcmp(argv[i], "--keyframes") == 0 && has_value && stream) {
+            options.keyframe_stride = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--adaptive") == 0 && stream) {
+            options.adaptive_keyframes = true;
+        } else if (strcmp(argv[i], "--flow") == 0 && stream) {
+            options.optical_flow = true;
+        } else if (strcmp(argv[i], "--motion") == 0 && has_value && stream) {
+            options.motion_threshold = std::atof(argv[++i]);
+        } else if (strcmp(argv[i], "--replay") == 0) {
+            replay = true;
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Open the input before building the network to fail early.
+    std::vector<std::string> filenames;
+    std::unique_ptr<mr::FrameSource> source;
+    if (!stream) {
+        filenames = mr::collect_image_filenames(input);
+        if (filenames.empty()) {
+            std::cerr << "No images found in " << input << "\n";
+            return EXIT_FAILURE;
+        }
+    } else if (input == "-") {
+        cv::Size size;
+        mr::RawFrameSource::PixelFormat format;
+        if (!mr::parse_raw_frame_spec(raw_spec, size, format)) {
+            std::cerr << "Invalid or missing --raw frame size \"" << raw_spec << "\"\n";
+            return EXIT_FAILURE;
+        }
+        source = std::make_unique<mr::RawFrameSource>(STDIN_FILENO, size, format);
+    } else {
+        auto video = std::make_unique<mr::VideoFrameSource>(input);
+        if (!video->isOpened()) {
+            std::cerr << "Error opening video " << input << "\n";
+            return EXIT_FAILURE;
+        }
+        source = std::move(video);
+    }
+
+    mr::MaskRCNNConfig config;
+    std::unique_ptr<mr::MaskRCNN> network;
+    if (replay) {
+        auto backend = std::make_unique<mr::ReplayBackend>();
+        if (model == "synthetic") {
+            backend->addSyntheticFrame(10, 0.2f);
+        } else {
+            auto capture = std::make_shared<mr::CaptureReader>();
+            if (!capture->open(model)) {
+                std::cerr << "Error opening capture " << model << "\n";
+                return EXIT_FAILURE;
+            }
+            backend->addCapture(capture);
+        }
+        network = std::make_unique<mr::MaskRCNN>(config, std::move(backend));
+    } else {
+        config.model_filename = model;
+        config.serialized_model_filename = config.model_filename + ".bin";
+        network = std::make_unique<mr::MaskRCNN>(config);
+    }
+    if (!network->build()) {
+        return EXIT_FAILURE;
+    }
+
+    const mr::BatchSummary summary = stream
+        ? mr::process_stream(*network, *source, options)
+        : mr::process_batch(*network, filenames, options);
+    std::cout << "Processed " << summary.images << (stream ? " frames" : " images")
+        << " in " << summary.seconds << " s (" << summary.images / summary.seconds
+        << " per second), " << summary.failed << " could not be decoded, inference failed on "
+        << summary.failed_inference << "\n";
+    if (options.motion_threshold > 0.0f) {
+        std::cout << "Skipped inference on " << summary.skipped << " static frames\n";
+    }
+    if (!summary.written) {
+        std::cerr << "Error writing the detections to " << options.output_filename << "\n";
+        return EXIT_FAILURE;
+    }
+    if (summary.source_failed) {
+        std::cerr << "Error reading the frames, the detections in "
+            << options.output_filename << " are incomplete\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "Saved detections in " << options.output_filename << "\n";
+    return EXIT_SUCCESS;
+}
+
+
 
 int main(int argc, char** argv) {
     // Ensure the correct number of arguments was supplied.
     if (argc < 3) {
-        std::cout << "maskrcnn-trt-example MODEL IMAGE...\n";
+        print_usage();
         return EXIT_FAILURE;
     }
+    if (strcmp(argv[2], "--batch") == 0 || strcmp(argv[2], "--stream") == 0) {
+        return batch_main(argc, argv, strcmp(argv[2], "--stream") == 0);
+    }
 
     // Setup the network configuration struct.
     // mr::MaskRCNNConfig::model_filename is
@@ -37,16 +195,36 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
+    // Record a timeline of the processing of the images if MASKRCNN_TRACE is
+    // set to the name of the trace file. The trace can be opened in
+    // chrome://tracing or https://ui.perfetto.dev.
+    const char* trace_filename = std::getenv("MASKRCNN_TRACE");
+    if (trace_filename) {
+        mr::trace_enable();
+    }
+
     // Run inference on each input image.
     for (int i = 2; i < argc; i ++) {
         // Read the input image.
         const std::string filename (argv[i]);
-        const cv::Mat image = cv::imread(filename);
+        // Large JPEG images are decoded at a reduced resolution since they
+        // would be downscaled by the network anyway.
+        cv::Mat image;
+        cv::Size original_size;
+        {
+            MR_TRACE_SPAN("imread");
+            image = mr::read_image(filename, original_size);
+        }
+        if (image.empty()) {
+            std::cerr << "Error reading " << filename << "\n\n";
+            continue;
+        }
 
         // Time the inference.
         const auto t_start = std::chrono::high_resolution_clock::now();
         // Pass the image through the network and get the detections.
-        const std::vector<mr::Detection> detections = network.infer(image);
+        // The detections are in the coordinates of the full-resolution image.
+        const std::vector<mr::Detection> detections = network.infer(image, true, original_size);
         const auto t_end = std::chrono::high_resolution_clock::now();
         const float t = std::chrono::duration<float, std::milli>(t_end - t_start).count();
         std::cout << "Inference time for " << argv[i] << " was " << t << " ms\n";
@@ -56,9 +234,18 @@ int main(int argc, char** argv) {
             std::cout << "  " << detection << "\n";
         }
 
-        // Visualize the detections and save them to an image file.
+        // Visualize the detections on the full-resolution image and save them
+        // to an image file.
+        if (image.size() != original_size) {
+            cv::resize(image, image, original_size);
+        }
         const std::string vis_filename = filename + ".detections.png";
-        if (cv::imwrite(vis_filename, visualize_detections(detections, image))) {
+        bool vis_saved = false;
+        {
+            MR_TRACE_SPAN("render");
+            vis_saved = cv::imwrite(vis_filename, visualize_detections(detections, image));
+        }
+        if (vis_saved) {
             std::cout << "Saved detection visualization in " << vis_filename << "\n";
         } else {
             std::cerr << "Error saving detection visualization in " << vis_filename << "\n";
@@ -66,6 +253,14 @@ int main(int argc, char** argv) {
         std::cout << "\n";
     }
 
+    if (trace_filename) {
+        if (mr::trace_write(trace_filename)) {
+            std::cout << "Saved trace in " << trace_filename << "\n";
+        } else {
+            std::cerr << "Error saving trace in " << trace_filename << "\n";
+        }
+    }
+
     return EXIT_SUCCESS;
 }
 
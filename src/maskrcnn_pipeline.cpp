@@ -0,0 +1,162 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include "maskrcnn_trt/maskrcnn_pipeline.hpp"
+#include "maskrcnn_trt/trace.hpp"
+
+namespace mr {
+    MaskRCNNPipelineBackend::MaskRCNNPipelineBackend(const MaskRCNN& network,
+                                                     int             num_slots,
+                                                     bool            in_bgr_order)
+        : slots_(std::max(num_slots, 1)), in_bgr_order_(in_bgr_order)
+    {
+        for (auto& slot : slots_) {
+            slot.network = network.clone();
+        }
+    }
+
+
+
+    bool MaskRCNNPipelineBackend::isValid() const
+    {
+        for (const auto& slot : slots_) {
+            if (!slot.network) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+
+    size_t MaskRCNNPipelineBackend::numSlots() const
+    {
+        return slots_.size();
+    }
+
+
+
+    void MaskRCNNPipelineBackend::preprocess(size_t slot, const cv::Mat& rgb_image)
+    {
+        MR_TRACE_SPAN("pipeline_preprocess");
+        Slot& s = slots_[slot];
+        MaskRCNN& network = *s.network;
+        s.start = std::chrono::steady_clock::now();
+        // The frame ID counter is shared with all clones so the frames get
+        // the same unique IDs in captures as with MaskRCNN::infer().
+        network.frame_id_ = network.next_frame_id_->fetch_add(1);
+        {
+            MR_TIME_STAGE(*network.stats_, InferenceStage::preprocess);
+            network.preprocessInput(rgb_image, 0, in_bgr_order_);
+        }
+        s.input_size = rgb_image.size();
+    }
+
+
+
+    bool MaskRCNNPipelineBackend::launch(size_t slot)
+    {
+        MR_TRACE_SPAN("pipeline_launch");
+        Slot& s = slots_[slot];
+        MaskRCNN& network = *s.network;
+        s.launch = std::chrono::steady_clock::now();
+        if (!network.backend_->enqueue(1)) {
+            network.counters_->failed_executions.add();
+            return false;
+        }
+        network.counters_->bytes_to_device.add(MaskRCNNConfig::model_input_volume * sizeof(float));
+        return true;
+    }
+
+
+
+    bool MaskRCNNPipelineBackend::synchronize(size_t slot)
+    {
+        MR_TRACE_SPAN("pipeline_synchronize");
+        Slot& s = slots_[slot];
+        MaskRCNN& network = *s.network;
+        if (!network.backend_->synchronize()) {
+            network.counters_->failed_executions.add();
+            return false;
+        }
+#ifdef MR_ENABLE_STATS
+        // The copies are queued together with the execution so they can't be
+        // timed separately and are included in the execute stage.
+        network.stats_->record(InferenceStage::execute, std::chrono::steady_clock::now() - s.launch);
+#endif
+        network.counters_->bytes_to_host.add(sizeof(float)
+                * (MaskRCNNConfig::model_detection_volume + MaskRCNNConfig::model_mask_volume));
+        return true;
+    }
+
+
+
+    std::vector<Detection> MaskRCNNPipelineBackend::postprocess(size_t slot)
+    {
+        MR_TRACE_SPAN("pipeline_postprocess");
+        Slot& s = slots_[slot];
+        MaskRCNN& network = *s.network;
+        if (network.capture_writer_) {
+            network.captureOutput({s.input_size});
+        }
+        network.stats_->addFrames(1);
+        network.counters_->frames.add(1);
+        std::vector<Detection> detections = std::move(network.postprocessOutput({s.input_size}).front());
+#ifdef MR_ENABLE_STATS
+        // Including the time the frame waited in the pipeline.
+        network.stats_->record(InferenceStage::total, std::chrono::steady_clock::now() - s.start);
+#endif
+        return detections;
+    }
+
+
+
+    MaskRCNNPipeline::MaskRCNNPipeline(const MaskRCNN& network,
+                                       int             depth,
+                                       bool            in_bgr_order)
+        : network_(network), depth_(depth), in_bgr_order_(in_bgr_order)
+    {
+    }
+
+
+
+    bool MaskRCNNPipeline::build()
+    {
+        // Destroy any previous pipeline before the backend it uses.
+        pipeline_.reset();
+        backend_ = std::make_unique<MaskRCNNPipelineBackend>(network_, depth_, in_bgr_order_);
+        if (!backend_->isValid()) {
+            backend_.reset();
+            return false;
+        }
+        pipeline_ = std::make_unique<Pipeline<cv::Mat, std::vector<Detection>>>(*backend_);
+        return true;
+    }
+
+
+
+    uint64_t MaskRCNNPipeline::submit(const cv::Mat& rgb_image)
+    {
+        if (!pipeline_) {
+            MR_LOG_ERROR << "Error: The pipeline must be built using build() before running submit()"
+                << std::endl;
+            return invalid_frame_id;
+        }
+        return pipeline_->submit(rgb_image);
+    }
+
+
+
+    bool MaskRCNNPipeline::poll(Result& result)
+    {
+        return pipeline_ && pipeline_->poll(result);
+    }
+
+
+
+    bool MaskRCNNPipeline::wait(Result& result)
+    {
+        return pipeline_ && pipeline_->wait(result);
+    }
+} // namespace mr
@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include "maskrcnn_trt/maskrcnn_pool.hpp"
+
+namespace mr {
+    MaskRCNNPool::MaskRCNNPool(const MaskRCNNConfig& config, int num_contexts)
+        : config_(config), num_contexts_(std::max(num_contexts, 1))
+    {
+    }
+
+
+
+    MaskRCNNPool::MaskRCNNPool(const MaskRCNNConfig&             config,
+                               int                               num_contexts,
+                               std::unique_ptr<InferenceBackend> backend)
+        : config_(config), num_contexts_(std::max(num_contexts, 1)), backend_(std::move(backend))
+    {
+    }
+
+
+
+    bool MaskRCNNPool::build()
+    {
+        std::vector<std::unique_ptr<MaskRCNN>> networks;
+        networks.reserve(num_contexts_);
+        // Build the engine only once.
+        networks.push_back(backend_
+                ? std::make_unique<MaskRCNN>(config_, std::move(backend_))
+                : std::make_unique<MaskRCNN>(config_));
+        if (!networks.front()->build()) {
+            return false;
+        }
+        // Create the remaining execution contexts from the same engine.
+        for (int i = 1; i < num_contexts_; i++) {
+            std::unique_ptr<MaskRCNN> network = networks.front()->clone();
+            if (!network) {
+                return false;
+            }
+            networks.push_back(std::move(network));
+        }
+        pool_ = std::make_unique<ResourcePool<MaskRCNN>>(std::move(networks));
+        return true;
+    }
+
+
+
+    std::vector<Detection> MaskRCNNPool::infer(const cv::Mat& rgb_image,
+                                               bool           in_bgr_order,
+                                               cv::Size       original_size)
+    {
+        if (!pool_) {
+            MR_LOG_ERROR << "Error: The pool must be built using build() before running infer()"
+                << std::endl;
+            return std::vector<Detection>();
+        }
+        return pool_->acquire()->infer(rgb_image, in_bgr_order, original_size);
+    }
+
+
+
+    std::vector<std::vector<Detection>> MaskRCNNPool::infer(
+            const std::vector<cv::Mat>&  rgb_images,
+            bool                         in_bgr_order,
+            const std::vector<cv::Size>& original_sizes)
+    {
+        if (!pool_) {
+            MR_LOG_ERROR << "Error: The pool must be built using build() before running infer()"
+                << std::endl;
+            return std::vector<std::vector<Detection>>();
+        }
+        return pool_->acquire()->infer(rgb_images, in_bgr_order, original_sizes);
+    }
+
+
+
+    size_t MaskRCNNPool::size() const
+    {
+        return pool_ ? pool_->size() : 0;
+    }
+} // namespace mr
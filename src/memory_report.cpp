@@ -0,0 +1,39 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <iomanip>
+
+#include "maskrcnn_trt/memory_report.hpp"
+
+namespace mr {
+    /** Return bytes in MiB.
+     */
+    static double to_mib(size_t bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+
+
+    std::ostream& operator<<(std::ostream& os, const MemoryReport& r)
+    {
+        const std::ios_base::fmtflags flags = os.flags();
+        os << std::fixed << std::setprecision(2);
+        for (const auto& b : r.bindings) {
+            os << (b.is_input ? "input  " : "output ") << b.name
+                << ": host " << to_mib(b.host_bytes) << " MiB, device "
+                << to_mib(b.device_bytes) << " MiB\n";
+        }
+        os << "buffers: host " << to_mib(r.host_buffer_bytes) << " MiB, device "
+            << to_mib(r.device_buffer_bytes) << " MiB\n"
+            << "peak temporaries (estimate): " << to_mib(r.peak_temporary_bytes_estimate) << " MiB\n"
+            << "peak masks: " << to_mib(r.peak_mask_bytes) << " MiB";
+        if (r.mask_bytes_limit > 0) {
+            os << " (limit " << to_mib(r.mask_bytes_limit) << " MiB, "
+                << r.degraded_frames << " degraded frames)";
+        }
+        os.flags(flags);
+        return os;
+    }
+} // namespace mr
@@ -0,0 +1,137 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <sstream>
+
+#include "maskrcnn_trt/metrics.hpp"
+
+namespace mr {
+    uint64_t ShardedCounter::value() const
+    {
+        uint64_t sum = 0;
+        for (const auto& shard : shards_) {
+            sum += shard.value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+
+
+    void ShardedCounter::reset()
+    {
+        for (auto& shard : shards_) {
+            shard.value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+
+
+    size_t ShardedCounter::shardIndex()
+    {
+        static std::atomic<size_t> next_index {0};
+        thread_local const size_t index
+            = next_index.fetch_add(1, std::memory_order_relaxed) % num_shards;
+        return index;
+    }
+
+
+
+    InferenceMetrics InferenceCounters::snapshot() const
+    {
+        InferenceMetrics m;
+        m.frames = frames.value();
+        m.failed_executions = failed_executions.value();
+        m.detections = detections.value();
+        m.last_frame_detections = last_frame_detections.load(std::memory_order_relaxed);
+        m.masks_decoded = masks_decoded.value();
+        m.bytes_to_device = bytes_to_device.value();
+        m.bytes_to_host = bytes_to_host.value();
+        m.peak_temporary_bytes_estimate = peak_temporary_bytes_estimate.load(std::memory_order_relaxed);
+        m.peak_mask_bytes = peak_mask_bytes.load(std::memory_order_relaxed);
+        m.degraded_frames = degraded_frames.value();
+        return m;
+    }
+
+
+
+    void InferenceCounters::reset()
+    {
+        frames.reset();
+        failed_executions.reset();
+        detections.reset();
+        last_frame_detections.store(0, std::memory_order_relaxed);
+        masks_decoded.reset();
+        bytes_to_device.reset();
+        bytes_to_host.reset();
+        peak_temporary_bytes_estimate.store(0, std::memory_order_relaxed);
+        peak_mask_bytes.store(0, std::memory_order_relaxed);
+        degraded_frames.reset();
+    }
+
+
+
+    static void write_metric(std::ostream&      os,
+                             const char*        name,
+                             const char*        type,
+                             const char*        help,
+                             uint64_t           value)
+    {
+        os << "# HELP maskrcnn_" << name << " " << help << "\n"
+            << "# TYPE maskrcnn_" << name << " " << type << "\n"
+            << "maskrcnn_" << name << " " << value << "\n";
+    }
+
+
+
+    std::string to_prometheus(const InferenceMetrics& metrics)
+    {
+        std::ostringstream os;
+        write_metric(os, "frames_total", "counter",
+                "Images inference was run on.", metrics.frames);
+        write_metric(os, "failed_executions_total", "counter",
+                "Failed network executions.", metrics.failed_executions);
+        write_metric(os, "detections_total", "counter",
+                "Detections over all images.", metrics.detections);
+        write_metric(os, "last_frame_detections", "gauge",
+                "Detections in the last image.", metrics.last_frame_detections);
+        write_metric(os, "masks_decoded_total", "counter",
+                "Detection masks decoded.", metrics.masks_decoded);
+        write_metric(os, "host_to_device_bytes_total", "counter",
+                "Bytes copied from the host to the device.", metrics.bytes_to_device);
+        write_metric(os, "device_to_host_bytes_total", "counter",
+                "Bytes copied from the device to the host.", metrics.bytes_to_host);
+        write_metric(os, "peak_temporary_bytes_estimate", "gauge",
+                "Estimated peak bytes of the temporaries of a single inference.",
+                metrics.peak_temporary_bytes_estimate);
+        write_metric(os, "peak_mask_bytes", "gauge",
+                "Peak bytes of the masks returned by a single inference.", metrics.peak_mask_bytes);
+        write_metric(os, "degraded_frames_total", "counter",
+                "Images whose masks were degraded to respect the mask byte limit.", metrics.degraded_frames);
+
+        // Quantiles are exported as gauges since the histograms don't keep the
+        // sum a Prometheus summary requires.
+        static const std::pair<const char*, double LatencySummary::*> quantiles[] = {
+            {"0.5", &LatencySummary::p50},
+            {"0.9", &LatencySummary::p90},
+            {"0.99", &LatencySummary::p99},
+            {"1", &LatencySummary::max},
+        };
+        os << "# HELP maskrcnn_stage_latency_seconds Latency quantiles of each inference stage.\n"
+            << "# TYPE maskrcnn_stage_latency_seconds gauge\n";
+        for (size_t i = 0; i < metrics.stats.stages.size(); i++) {
+            const char* stage = stage_name(static_cast<InferenceStage>(i));
+            for (const auto& q : quantiles) {
+                os << "maskrcnn_stage_latency_seconds{stage=\"" << stage << "\",quantile=\""
+                    << q.first << "\"} " << metrics.stats.stages[i].*q.second / 1000.0 << "\n";
+            }
+        }
+        os << "# HELP maskrcnn_stage_samples_total Latency samples recorded for each inference stage.\n"
+            << "# TYPE maskrcnn_stage_samples_total counter\n";
+        for (size_t i = 0; i < metrics.stats.stages.size(); i++) {
+            os << "maskrcnn_stage_samples_total{stage=\"" << stage_name(static_cast<InferenceStage>(i))
+                << "\"} " << metrics.stats.stages[i].count << "\n";
+        }
+        return os.str();
+    }
+} // namespace mr
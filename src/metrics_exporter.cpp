@@ -0,0 +1,133 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "maskrcnn_trt/logger.hpp"
+#include "maskrcnn_trt/metrics_exporter.hpp"
+
+namespace mr {
+    FileMetricsSink::FileMetricsSink(const std::string& filename)
+        : filename_(filename)
+    {
+    }
+
+
+
+    bool FileMetricsSink::write(const std::string& text)
+    {
+        const std::string tmp_filename = filename_ + ".tmp";
+        {
+            std::ofstream f (tmp_filename, std::ios::binary | std::ios::trunc);
+            f << text;
+            if (!f.good()) {
+                return false;
+            }
+        }
+        return std::rename(tmp_filename.c_str(), filename_.c_str()) == 0;
+    }
+
+
+
+    UnixSocketMetricsSink::UnixSocketMetricsSink(const std::string& socket_path)
+        : socket_path_(socket_path)
+    {
+    }
+
+
+
+    bool UnixSocketMetricsSink::write(const std::string& text)
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (socket_path_.size() >= sizeof(address.sun_path)) {
+            return false;
+        }
+        std::strncpy(address.sun_path, socket_path_.c_str(), sizeof(address.sun_path) - 1);
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return false;
+        }
+        bool success = connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        size_t written = 0;
+        while (success && written < text.size()) {
+            // MSG_NOSIGNAL avoids SIGPIPE if the reader has gone away.
+            const ssize_t n = send(fd, text.data() + written, text.size() - written, MSG_NOSIGNAL);
+            if (n < 0) {
+                success = false;
+            } else {
+                written += n;
+            }
+        }
+        close(fd);
+        return success;
+    }
+
+
+
+    MetricsExporter::MetricsExporter(const MaskRCNN&              network,
+                                     std::unique_ptr<MetricsSink> sink,
+                                     std::chrono::milliseconds    interval)
+        : MetricsExporter([&network]() { return network.metrics(); }, std::move(sink), interval)
+    {
+    }
+
+
+
+    MetricsExporter::MetricsExporter(MetricsSource                source,
+                                     std::unique_ptr<MetricsSink> sink,
+                                     std::chrono::milliseconds    interval)
+        : source_(std::move(source)), sink_(std::move(sink)), interval_(interval)
+    {
+        thread_ = std::thread(&MetricsExporter::run, this);
+    }
+
+
+
+    MetricsExporter::~MetricsExporter()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+        exportNow();
+    }
+
+
+
+    bool MetricsExporter::exportNow()
+    {
+        const std::string text = to_prometheus(source_());
+        std::lock_guard<std::mutex> lock (sink_mutex_);
+        return sink_->write(text);
+    }
+
+
+
+    void MetricsExporter::run()
+    {
+        bool exported = true;
+        std::unique_lock<std::mutex> lock (mutex_);
+        while (!cv_.wait_for(lock, interval_, [this] { return stop_; })) {
+            lock.unlock();
+            // Only warn when exporting starts failing to avoid flooding the
+            // log.
+            const bool previously_exported = exported;
+            exported = exportNow();
+            if (previously_exported && !exported) {
+                MR_LOG_WARNING << "Warning: Could not export metrics" << std::endl;
+            }
+            lock.lock();
+        }
+    }
+} // namespace mr
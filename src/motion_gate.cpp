@@ -0,0 +1,108 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+#include "maskrcnn_trt/motion_gate.hpp"
+#include "maskrcnn_trt/trace.hpp"
+
+namespace mr {
+    double MotionGateStats::hitRate() const
+    {
+        return frames > 0 ? static_cast<double>(skipped) / frames : 0.0;
+    }
+
+
+
+    MotionGate::MotionGate(const MotionGateConfig& config)
+        : config_(config)
+    {
+        config_.width = std::max(config_.width, 1);
+    }
+
+
+
+    MotionGate::Decision MotionGate::update(const cv::Mat& image)
+    {
+        MR_TRACE_SPAN("motion_gate");
+        cv::Mat small_image = downscale(image);
+        const float s = difference(small_image, reference_);
+        stats_.frames++;
+        stats_.last_score = s;
+        Decision decision = Decision::infer;
+        if (s >= 0.0f && s < config_.threshold) {
+            if (config_.max_skipped_frames <= 0 || skipped_frames_ < config_.max_skipped_frames) {
+                skipped_frames_++;
+                stats_.skipped++;
+                return Decision::skip;
+            }
+            decision = Decision::refresh;
+            stats_.refreshes++;
+        }
+        reference_ = small_image;
+        skipped_frames_ = 0;
+        return decision;
+    }
+
+
+
+    float MotionGate::score(const cv::Mat& image) const
+    {
+        return difference(downscale(image), reference_);
+    }
+
+
+
+    const MotionGateStats& MotionGate::stats() const
+    {
+        return stats_;
+    }
+
+
+
+    void MotionGate::invalidateReference()
+    {
+        reference_ = cv::Mat();
+        skipped_frames_ = 0;
+    }
+
+
+
+    void MotionGate::reset()
+    {
+        invalidateReference();
+        stats_ = MotionGateStats();
+    }
+
+
+
+    cv::Mat MotionGate::downscale(const cv::Mat& image) const
+    {
+        if (image.empty()) {
+            return cv::Mat();
+        }
+        // Area interpolation averages out sensor noise and has vectorized
+        // paths for integer scale factors.
+        const int width = std::min(config_.width, image.cols);
+        const int height = std::max<int>(std::lround(static_cast<double>(image.rows) * width / image.cols), 1);
+        cv::Mat small_image;
+        cv::resize(image, small_image, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+        return small_image;
+    }
+
+
+
+    float MotionGate::difference(const cv::Mat& small_image, const cv::Mat& reference) const
+    {
+        if (small_image.empty() || reference.size() != small_image.size()
+                || reference.type() != small_image.type()) {
+            return -1.0f;
+        }
+        const double sum = cv::norm(small_image, reference, cv::NORM_L1);
+        return sum / (small_image.total() * small_image.channels());
+    }
+} // namespace mr
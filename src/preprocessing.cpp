@@ -0,0 +1,239 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <vector>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "maskrcnn_trt/preprocessing.hpp"
+#include "maskrcnn_trt/maskrcnn_config.hpp"
+
+namespace mr {
+    void preprocess_image(const cv::Mat& image,
+                          float*         input_buffer,
+                          bool           in_bgr_order)
+    {
+        const int net_channels = MaskRCNNConfig::model_input_shape[0];
+        const int net_height = MaskRCNNConfig::model_input_shape[1];
+        const int net_width = MaskRCNNConfig::model_input_shape[2];
+        const int net_type = CV_8UC(net_channels);
+        // Ensure the input image has the same pixel type as the network.
+        assert(image.type() == net_type);
+        // This is the image that will be passed to the network. The zero
+        // initialization is important for padding purposes.
+        cv::Mat net_image (net_height, net_width, net_type, cv::Scalar(0));
+
+        // Find the dimensions that image must be resized to so that its
+        // maximum dimension is the same as the net_width (which should be the
+        // same as net_height) while keeping the aspect ratio.
+        const int input_max_dim = std::max(image.rows, image.cols);
+        const double scaling_factor = (double) net_width / input_max_dim;
+        const int input_new_width = image.cols * scaling_factor;
+        const int input_new_height = image.rows * scaling_factor;
+
+        // The coordinates in net_image where image will be copied.
+        const int x_start = (net_width - input_new_width) / 2;
+        const int y_start = (net_height - input_new_height) / 2;
+        const int x_end = x_start + input_new_width;
+        const int y_end = y_start + input_new_height;
+
+        // Get a view of the center of the net_image where the resized image
+        // will be copied into.
+        cv::Mat centre_image
+            = net_image(cv::Range(y_start, y_end), cv::Range(x_start, x_end));
+
+        // Resize the input image into the centre of the network image.
+        cv::resize(image, centre_image, centre_image.size());
+
+        // The channels are not interleaved in the input buffer. Split them
+        // and convert each to float, subtracting its bias, directly into its
+        // plane of the input buffer. Both are vectorized by OpenCV. The
+        // channel order is changed from BGR to RGB by reversing the planes.
+        cv::Mat channels[MaskRCNNConfig::model_input_shape[0]];
+        cv::split(net_image, channels);
+        const size_t num_pixels = net_image.total();
+        for (int c = 0; c < net_channels; c++) {
+            cv::Mat plane (net_height, net_width, CV_32FC1, input_buffer + c * num_pixels);
+            const cv::Mat& channel = in_bgr_order ? channels[net_channels - 1 - c] : channels[c];
+            channel.convertTo(plane, CV_32F, 1.0, -MaskRCNNConfig::network_bias[c]);
+        }
+    }
+
+
+
+    /** Return the value of the EXIF orientation tag in the payload of an
+     * APP1 segment, or 1 (no transformation) if it doesn't contain one.
+     */
+    static int exif_orientation(const std::vector<uint8_t>& app1)
+    {
+        // The payload starts with "Exif\0\0" followed by a TIFF header.
+        static const uint8_t exif_id[] = {'E', 'x', 'i', 'f', 0, 0};
+        if (app1.size() < sizeof(exif_id) + 8
+                || !std::equal(std::begin(exif_id), std::end(exif_id), app1.begin())) {
+            return 1;
+        }
+        const uint8_t* tiff = app1.data() + sizeof(exif_id);
+        const size_t tiff_size = app1.size() - sizeof(exif_id);
+        // The byte order is II for little-endian and MM for big-endian.
+        const bool little_endian = tiff[0] == 'I';
+        const auto read_u16 = [&](size_t offset) -> uint32_t {
+            return little_endian ? tiff[offset] | (tiff[offset + 1] << 8)
+                : (tiff[offset] << 8) | tiff[offset + 1];
+        };
+        const auto read_u32 = [&](size_t offset) -> uint32_t {
+            return little_endian ? read_u16(offset) | (read_u16(offset + 2) << 16)
+                : (read_u16(offset) << 16) | read_u16(offset + 2);
+        };
+        if ((tiff[0] != 'I' && tiff[0] != 'M') || tiff[1] != tiff[0] || read_u16(2) != 42) {
+            return 1;
+        }
+        // Search the entries of the first image file directory.
+        const size_t ifd = read_u32(4);
+        if (ifd + 2 > tiff_size) {
+            return 1;
+        }
+        const size_t num_entries = read_u16(ifd);
+        constexpr size_t entry_size = 12;
+        constexpr uint32_t orientation_tag = 0x0112;
+        constexpr uint32_t short_type = 3;
+        for (size_t i = 0; i < num_entries; i++) {
+            const size_t entry = ifd + 2 + i * entry_size;
+            if (entry + entry_size > tiff_size) {
+                break;
+            }
+            if (read_u16(entry) == orientation_tag && read_u16(entry + 2) == short_type) {
+                const int orientation = read_u16(entry + 8);
+                return orientation >= 1 && orientation <= 8 ? orientation : 1;
+            }
+        }
+        return 1;
+    }
+
+
+
+    /** Read the dimensions and EXIF orientation of a JPEG image from its
+     * header. Return false if the file isn't a JPEG image or its header can't
+     * be read.
+     */
+    static bool read_jpeg_header(const std::string& filename, cv::Size& size, int& orientation)
+    {
+        orientation = 1;
+        std::ifstream f (filename, std::ios::binary);
+        const auto read_u8 = [&f]() { return static_cast<uint8_t>(f.get()); };
+        const auto read_u16 = [&]() { const uint16_t high = read_u8(); return (high << 8) | read_u8(); };
+        // Start of image marker.
+        if (read_u8() != 0xFF || read_u8() != 0xD8) {
+            return false;
+        }
+        while (f.good()) {
+            // Markers start with one or more 0xFF bytes.
+            if (read_u8() != 0xFF) {
+                return false;
+            }
+            uint8_t marker = read_u8();
+            while (marker == 0xFF && f.good()) {
+                marker = read_u8();
+            }
+            // Markers without a payload.
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+                continue;
+            }
+            // End of image or start of scan before a frame header.
+            if (marker == 0xD9 || marker == 0xDA) {
+                return false;
+            }
+            const uint16_t length = read_u16();
+            // Start of frame markers, except DHT, JPG and DAC which share the
+            // range. The EXIF APP1 segment must precede it.
+            if (marker >= 0xC0 && marker <= 0xCF
+                    && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+                read_u8(); // Sample precision.
+                const int height = read_u16();
+                const int width = read_u16();
+                size = cv::Size(width, height);
+                return f.good();
+            }
+            if (length < 2) {
+                return false;
+            }
+            if (marker == 0xE1) {
+                std::vector<uint8_t> app1 (length - 2);
+                f.read(reinterpret_cast<char*>(app1.data()), app1.size());
+                if (f.good() && orientation == 1) {
+                    orientation = exif_orientation(app1);
+                }
+            } else {
+                f.seekg(length - 2, std::ios::cur);
+            }
+        }
+        return false;
+    }
+
+
+
+    cv::Size read_jpeg_size(const std::string& filename)
+    {
+        cv::Size size;
+        int orientation;
+        return read_jpeg_header(filename, size, orientation) ? size : cv::Size();
+    }
+
+
+
+    int read_jpeg_orientation(const std::string& filename)
+    {
+        cv::Size size;
+        int orientation;
+        return read_jpeg_header(filename, size, orientation) ? orientation : 1;
+    }
+
+
+
+    int jpeg_reduction_factor(cv::Size size)
+    {
+        const int net_size = std::max(MaskRCNNConfig::model_input_shape[1],
+                MaskRCNNConfig::model_input_shape[2]);
+        const int max_size = std::max(size.width, size.height);
+        for (int factor = 8; factor > 1; factor /= 2) {
+            // libjpeg rounds the scaled dimensions up.
+            if ((max_size + factor - 1) / factor >= net_size) {
+                return factor;
+            }
+        }
+        return 1;
+    }
+
+
+
+    cv::Mat read_image(const std::string& filename, cv::Size& original_size)
+    {
+        cv::Size jpeg_size;
+        int orientation = 1;
+        if (!read_jpeg_header(filename, jpeg_size, orientation)) {
+            jpeg_size = cv::Size();
+        }
+        const int factor = jpeg_size.empty() ? 1 : jpeg_reduction_factor(jpeg_size);
+        int flags = cv::IMREAD_COLOR;
+        switch (factor) {
+            case 2: flags = cv::IMREAD_REDUCED_COLOR_2; break;
+            case 4: flags = cv::IMREAD_REDUCED_COLOR_4; break;
+            case 8: flags = cv::IMREAD_REDUCED_COLOR_8; break;
+        }
+        cv::Mat image = cv::imread(filename, flags);
+        original_size = image.size();
+        if (factor > 1 && !image.empty()) {
+            original_size = jpeg_size;
+            // cv::imread() applies the EXIF orientation. Orientations 5 to 8
+            // involve a 90 degree rotation, swapping the dimensions.
+            if (orientation >= 5) {
+                std::swap(original_size.width, original_size.height);
+            }
+        }
+        return image;
+    }
+} // namespace mr
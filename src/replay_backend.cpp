@@ -0,0 +1,286 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <thread>
+
+#include "maskrcnn_trt/replay_backend.hpp"
+#include "maskrcnn_trt/maskrcnn_config.hpp"
+
+namespace mr {
+    void generate_synthetic_output(int      num_detections,
+                                   float    box_size,
+                                   uint32_t seed,
+                                   float*   detection_buffer,
+                                   float*   mask_buffer)
+    {
+        constexpr int mask_side = 2 * MaskRCNNConfig::mask_pool_size;
+        constexpr int mask_area = mask_side * mask_side;
+        std::fill(detection_buffer, detection_buffer + MaskRCNNConfig::model_detection_volume, 0.0f);
+        std::fill(mask_buffer, mask_buffer + MaskRCNNConfig::model_mask_volume, 0.0f);
+        num_detections = std::clamp(num_detections, 0, MaskRCNNConfig::detection_max_instances);
+        box_size = std::clamp(box_size, 1e-3f, 1.0f);
+
+        std::mt19937 rng (seed);
+        std::uniform_int_distribution<int> class_distribution (1, MaskRCNNConfig::num_classes - 1);
+        std::uniform_real_distribution<float> confidence_distribution (MaskRCNNConfig::detection_min_confidence, 1.0f);
+        std::uniform_real_distribution<float> position_distribution (0.0f, 1.0f - box_size);
+        for (int d = 0; d < num_detections; d++) {
+            // The raw detection layout is y_start, x_start, y_end, x_end,
+            // class_id, confidence in normalized network input coordinates.
+            float* raw_detection = detection_buffer + d * MaskRCNNConfig::model_detection_shape[1];
+            const float x = position_distribution(rng);
+            const float y = position_distribution(rng);
+            const int class_id = class_distribution(rng);
+            raw_detection[0] = y;
+            raw_detection[1] = x;
+            raw_detection[2] = y + box_size;
+            raw_detection[3] = x + box_size;
+            raw_detection[4] = class_id;
+            raw_detection[5] = confidence_distribution(rng);
+            // Only the mask of the detected class is used.
+            float* raw_mask = mask_buffer + (d * MaskRCNNConfig::num_classes + class_id) * mask_area;
+            const float centre = (mask_side - 1) / 2.0f;
+            for (int i = 0; i < mask_side; i++) {
+                for (int j = 0; j < mask_side; j++) {
+                    const float r = std::hypot(i - centre, j - centre) / centre;
+                    raw_mask[i * mask_side + j] = std::clamp(1.5f - r, 0.0f, 1.0f);
+                }
+            }
+        }
+    }
+
+
+
+    ReplayBackend::ReplayBackend(int max_batch_size)
+        : max_batch_size_(std::max(max_batch_size, 1)),
+          frames_(std::make_shared<std::vector<Frame>>()),
+          input_buffer_(max_batch_size_ * MaskRCNNConfig::model_input_volume, 0.0f),
+          detection_buffer_(max_batch_size_ * MaskRCNNConfig::model_detection_volume, 0.0f),
+          mask_buffer_(max_batch_size_ * MaskRCNNConfig::model_mask_volume, 0.0f)
+    {
+    }
+
+
+
+    void ReplayBackend::addFrame(const float* detection_buffer, const float* mask_buffer)
+    {
+        // Store both tensors in a single owned buffer.
+        auto data = std::make_shared<std::vector<float>>(
+                MaskRCNNConfig::model_detection_volume + MaskRCNNConfig::model_mask_volume);
+        std::copy(detection_buffer, detection_buffer + MaskRCNNConfig::model_detection_volume,
+                data->begin());
+        std::copy(mask_buffer, mask_buffer + MaskRCNNConfig::model_mask_volume,
+                data->begin() + MaskRCNNConfig::model_detection_volume);
+        mutableFrames().push_back({data->data(), data->data() + MaskRCNNConfig::model_detection_volume, data});
+    }
+
+
+
+    void ReplayBackend::addSyntheticFrame(int num_detections, float box_size, uint32_t seed)
+    {
+        auto data = std::make_shared<std::vector<float>>(
+                MaskRCNNConfig::model_detection_volume + MaskRCNNConfig::model_mask_volume);
+        float* detection_buffer = data->data();
+        float* mask_buffer = data->data() + MaskRCNNConfig::model_detection_volume;
+        generate_synthetic_output(num_detections, box_size, seed, detection_buffer, mask_buffer);
+        mutableFrames().push_back({detection_buffer, mask_buffer, data});
+    }
+
+
+
+    void ReplayBackend::addCapture(std::shared_ptr<const CaptureReader> capture)
+    {
+        std::vector<Frame>& frames = mutableFrames();
+        for (size_t i = 0; i < capture->size(); i++) {
+            const CaptureRecord record = capture->record(i);
+            frames.push_back({record.detection_buffer, record.mask_buffer, capture});
+        }
+    }
+
+
+
+    size_t ReplayBackend::numFrames() const
+    {
+        return frames_->size();
+    }
+
+
+
+    void ReplayBackend::setLatency(LatencyModel latency)
+    {
+        latency_ = latency;
+    }
+
+
+
+    int ReplayBackend::maxBatchSize() const
+    {
+        return max_batch_size_;
+    }
+
+
+
+    int ReplayBackend::numBindings() const
+    {
+        return 3;
+    }
+
+
+
+    std::string ReplayBackend::bindingName(int index) const
+    {
+        return index == 0 ? MaskRCNNConfig::model_input : MaskRCNNConfig::model_outputs[index - 1];
+    }
+
+
+
+    bool ReplayBackend::bindingIsInput(int index) const
+    {
+        return index == 0;
+    }
+
+
+
+    std::vector<int> ReplayBackend::bindingShape(int index) const
+    {
+        switch (index) {
+            case 0:
+                return std::vector<int>(std::begin(MaskRCNNConfig::model_input_shape),
+                        std::end(MaskRCNNConfig::model_input_shape));
+            case 1:
+                return std::vector<int>(std::begin(MaskRCNNConfig::model_detection_shape),
+                        std::end(MaskRCNNConfig::model_detection_shape));
+            default:
+                return std::vector<int>(std::begin(MaskRCNNConfig::model_mask_shape),
+                        std::end(MaskRCNNConfig::model_mask_shape));
+        }
+    }
+
+
+
+    void* ReplayBackend::hostBuffer(const std::string& tensor_name) const
+    {
+        if (tensor_name == MaskRCNNConfig::model_input) {
+            return input_buffer_.data();
+        } else if (tensor_name == MaskRCNNConfig::model_outputs[0]) {
+            return detection_buffer_.data();
+        } else if (tensor_name == MaskRCNNConfig::model_outputs[1]) {
+            return mask_buffer_.data();
+        }
+        return nullptr;
+    }
+
+
+
+    void* ReplayBackend::deviceBuffer(const std::string&) const
+    {
+        return nullptr;
+    }
+
+
+
+    bool ReplayBackend::copyInputToDevice(int)
+    {
+        return true;
+    }
+
+
+
+    bool ReplayBackend::execute(int batch_size)
+    {
+        std::this_thread::sleep_for(latency(batch_size));
+        writeOutput(batch_size);
+        return true;
+    }
+
+
+
+    bool ReplayBackend::copyOutputToHost(int)
+    {
+        return true;
+    }
+
+
+
+    bool ReplayBackend::enqueue(int batch_size)
+    {
+        // Simulate a device running in parallel with the host by only
+        // producing the output once the latency has elapsed.
+        enqueue_end_ = std::chrono::steady_clock::now() + latency(batch_size);
+        enqueued_batch_size_ = batch_size;
+        return true;
+    }
+
+
+
+    bool ReplayBackend::synchronize()
+    {
+        if (enqueued_batch_size_ > 0) {
+            std::this_thread::sleep_until(enqueue_end_);
+            writeOutput(enqueued_batch_size_);
+            enqueued_batch_size_ = 0;
+        }
+        return true;
+    }
+
+
+
+    std::vector<BindingMemory> ReplayBackend::memoryUsage() const
+    {
+        return {
+            {MaskRCNNConfig::model_input, true, input_buffer_.size() * sizeof(float), 0},
+            {MaskRCNNConfig::model_outputs[0], false, detection_buffer_.size() * sizeof(float), 0},
+            {MaskRCNNConfig::model_outputs[1], false, mask_buffer_.size() * sizeof(float), 0},
+        };
+    }
+
+
+
+    std::unique_ptr<InferenceBackend> ReplayBackend::clone() const
+    {
+        std::unique_ptr<ReplayBackend> backend = std::make_unique<ReplayBackend>(max_batch_size_);
+        backend->latency_ = latency_;
+        backend->frames_ = frames_;
+        return backend;
+    }
+
+
+
+    std::vector<ReplayBackend::Frame>& ReplayBackend::mutableFrames()
+    {
+        // Clones may be reading the shared frames concurrently.
+        if (frames_.use_count() > 1) {
+            frames_ = std::make_shared<std::vector<Frame>>(*frames_);
+        }
+        return *frames_;
+    }
+
+
+
+    void ReplayBackend::writeOutput(int batch_size)
+    {
+        if (frames_->empty()) {
+            return;
+        }
+        batch_size = std::min(batch_size, max_batch_size_);
+        for (int i = 0; i < batch_size; i++) {
+            const Frame& frame = (*frames_)[next_frame_];
+            next_frame_ = (next_frame_ + 1) % frames_->size();
+            std::copy(frame.detection_buffer, frame.detection_buffer + MaskRCNNConfig::model_detection_volume,
+                    detection_buffer_.begin() + i * MaskRCNNConfig::model_detection_volume);
+            std::copy(frame.mask_buffer, frame.mask_buffer + MaskRCNNConfig::model_mask_volume,
+                    mask_buffer_.begin() + i * MaskRCNNConfig::model_mask_volume);
+        }
+    }
+
+
+
+    std::chrono::microseconds ReplayBackend::latency(int batch_size) const
+    {
+        return latency_ ? latency_(batch_size) : std::chrono::microseconds(0);
+    }
+} // namespace mr
@@ -0,0 +1,124 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <vector>
+
+#include "maskrcnn_trt/stats.hpp"
+
+namespace mr {
+    LatencyHistogram::LatencyHistogram()
+    {
+        reset();
+    }
+
+
+
+    LatencySummary LatencyHistogram::summary() const
+    {
+        // Take a snapshot of the counts so that the total matches.
+        std::vector<uint64_t> counts (num_buckets);
+        uint64_t count = 0;
+        for (size_t i = 0; i < num_buckets; i++) {
+            counts[i] = counts_[i].load(std::memory_order_relaxed);
+            count += counts[i];
+        }
+        LatencySummary s;
+        s.count = count;
+        if (count == 0) {
+            return s;
+        }
+        const double percentiles[3] = {0.50, 0.90, 0.99};
+        double* values[3] = {&s.p50, &s.p90, &s.p99};
+        uint64_t cumulative = 0;
+        int p = 0;
+        for (size_t i = 0; i < num_buckets && p < 3; i++) {
+            cumulative += counts[i];
+            while (p < 3 && cumulative >= percentiles[p] * count) {
+                *values[p] = bucketValue(i) / 1e6;
+                p++;
+            }
+        }
+        s.max = max_.load(std::memory_order_relaxed) / 1e6;
+        // The bucket midpoints may slightly exceed the true maximum.
+        s.p50 = std::min(s.p50, s.max);
+        s.p90 = std::min(s.p90, s.max);
+        s.p99 = std::min(s.p99, s.max);
+        return s;
+    }
+
+
+
+    void LatencyHistogram::reset()
+    {
+        for (auto& c : counts_) {
+            c.store(0, std::memory_order_relaxed);
+        }
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+
+
+    uint64_t LatencyHistogram::bucketValue(size_t index)
+    {
+        if (index < sub_bucket_count) {
+            return index;
+        }
+        const size_t shift = (index - sub_bucket_count) / half_sub_bucket_count + 1;
+        const uint64_t sub_bucket = (index - sub_bucket_count) % half_sub_bucket_count + half_sub_bucket_count;
+        const uint64_t lower = sub_bucket << shift;
+        return lower + ((uint64_t) 1 << shift) / 2;
+    }
+
+
+
+    const char* stage_name(InferenceStage stage)
+    {
+        switch (stage) {
+            case InferenceStage::preprocess: return "preprocess";
+            case InferenceStage::copy_to_device: return "copy_to_device";
+            case InferenceStage::execute: return "execute";
+            case InferenceStage::copy_to_host: return "copy_to_host";
+            case InferenceStage::detection_decode: return "detection_decode";
+            case InferenceStage::mask_decode: return "mask_decode";
+            case InferenceStage::total: return "total";
+            default: return "unknown";
+        }
+    }
+
+
+
+    std::ostream& operator<<(std::ostream& os, const InferenceStats& s)
+    {
+        os << s.frames << " frames, latency in ms (p50/p90/p99/max):";
+        for (size_t i = 0; i < s.stages.size(); i++) {
+            const LatencySummary& l = s.stages[i];
+            os << "\n  " << stage_name(static_cast<InferenceStage>(i))
+                << ": " << l.p50 << "/" << l.p90 << "/" << l.p99 << "/" << l.max
+                << " (" << l.count << " samples)";
+        }
+        return os;
+    }
+
+
+
+    InferenceStats StageStats::snapshot() const
+    {
+        InferenceStats s;
+        s.frames = frames_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < histograms_.size(); i++) {
+            s.stages[i] = histograms_[i].summary();
+        }
+        return s;
+    }
+
+
+
+    void StageStats::reset()
+    {
+        for (auto& h : histograms_) {
+            h.reset();
+        }
+        frames_.store(0, std::memory_order_relaxed);
+    }
+} // namespace mr
@@ -0,0 +1,146 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "maskrcnn_trt/maskrcnn.hpp"
+#include "maskrcnn_trt/temporal_maskrcnn.hpp"
+#include "maskrcnn_trt/trace.hpp"
+
+namespace mr {
+    TemporalMaskRCNN::TemporalMaskRCNN(MaskRCNN& network, const KeyframeConfig& config)
+        : network_(network), config_(config), tracker_(config.tracker),
+        gate_(config.motion), propagator_(config.flow), stride_(std::max(config.stride, 1))
+    {
+        config_.stride = stride_;
+        config_.min_stride = std::clamp(config_.min_stride, 1, config_.stride);
+    }
+
+
+
+    std::vector<Detection> TemporalMaskRCNN::process(const cv::Mat& rgb_image, bool in_bgr_order)
+    {
+        last_failed_ = false;
+        if (config_.motion_gate) {
+            const MotionGate::Decision decision = gate_.update(rgb_image);
+            if (decision == MotionGate::Decision::skip && !force_keyframe_) {
+                last_was_keyframe_ = false;
+                return last_detections_;
+            }
+            if (decision == MotionGate::Decision::refresh) {
+                force_keyframe_ = true;
+            }
+        }
+        cv::Mat gray_image;
+        if (config_.optical_flow) {
+            cv::cvtColor(rgb_image, gray_image, in_bgr_order ? cv::COLOR_BGR2GRAY : cv::COLOR_RGB2GRAY);
+        }
+        last_was_keyframe_ = force_keyframe_ || frames_since_keyframe_ + 1 >= stride_;
+        if (!last_was_keyframe_) {
+            MR_TRACE_SPAN("track");
+            if (!config_.optical_flow) {
+                frames_since_keyframe_++;
+                last_detections_ = tracker_.predict();
+                return last_detections_;
+            }
+            if (propagator_.propagate(gray_image, last_detections_)) {
+                frames_since_keyframe_++;
+                tracker_.advance();
+                return last_detections_;
+            }
+            flow_fallbacks_++;
+            last_was_keyframe_ = true;
+        }
+        // Only the batch version of infer() tells failures apart from frames
+        // without detections.
+        std::vector<std::vector<Detection>> batch_detections
+            = network_.infer(std::vector<cv::Mat>{rgb_image}, in_bgr_order);
+        if (batch_detections.empty()) {
+            last_failed_ = true;
+            force_keyframe_ = true;
+            // The failed frame became the gate's reference, don't skip the
+            // following frames because they resemble it.
+            gate_.invalidateReference();
+            return std::vector<Detection>();
+        }
+        force_keyframe_ = false;
+        frames_since_keyframe_ = 0;
+        MR_TRACE_SPAN("track");
+        // All detections of the first keyframe after construction or reset()
+        // start new tracks, which says nothing about how well the tracker
+        // follows the scene.
+        const bool had_tracks = tracker_.numTracks() > 0;
+        last_detections_ = tracker_.update(std::move(batch_detections.front()), rgb_image.size());
+        if (config_.optical_flow) {
+            propagator_.setKeyframe(gray_image, last_detections_);
+        }
+        if (config_.adaptive && had_tracks) {
+            adaptStride();
+        }
+        return last_detections_;
+    }
+
+
+
+    bool TemporalMaskRCNN::lastWasKeyframe() const
+    {
+        return last_was_keyframe_;
+    }
+
+
+
+    bool TemporalMaskRCNN::lastFailed() const
+    {
+        return last_failed_;
+    }
+
+
+
+    int TemporalMaskRCNN::currentStride() const
+    {
+        return stride_;
+    }
+
+
+
+    const MotionGateStats& TemporalMaskRCNN::motionGateStats() const
+    {
+        return gate_.stats();
+    }
+
+
+
+    size_t TemporalMaskRCNN::flowFallbacks() const
+    {
+        return flow_fallbacks_;
+    }
+
+
+
+    void TemporalMaskRCNN::reset()
+    {
+        tracker_.reset();
+        gate_.reset();
+        last_detections_.clear();
+        stride_ = config_.stride;
+        frames_since_keyframe_ = 0;
+        force_keyframe_ = true;
+    }
+
+
+
+    void TemporalMaskRCNN::adaptStride()
+    {
+        const IoUTracker::UpdateStats& s = tracker_.lastUpdate();
+        const size_t total = s.matched + s.created + s.missed;
+        const size_t unmatched = s.created + s.missed;
+        if (total > 0 && unmatched > config_.max_unmatched_fraction * total) {
+            stride_ = std::max(stride_ / 2, config_.min_stride);
+        } else {
+            stride_ = std::min(stride_ + 1, config_.stride);
+        }
+    }
+} // namespace mr
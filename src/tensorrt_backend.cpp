@@ -0,0 +1,160 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include "maskrcnn_trt/tensorrt_backend.hpp"
+
+namespace mr {
+    std::unique_ptr<TensorRTBackend> TensorRTBackend::create(
+            std::shared_ptr<nvinfer1::ICudaEngine> engine,
+            int                                    max_batch_size,
+            HostAllocation                         host_allocation)
+    {
+        if (!engine) {
+            return nullptr;
+        }
+        std::unique_ptr<TensorRTBackend> backend (new TensorRTBackend(engine, max_batch_size, host_allocation));
+        backend->context_ = NVUniquePtr<nvinfer1::IExecutionContext>(engine->createExecutionContext());
+        if (!backend->context_) {
+            return nullptr;
+        }
+        // Create the host/device buffer manager.
+        backend->buffer_manager_ = std::make_unique<samplesCommon::BufferManager>(
+                engine, max_batch_size, nullptr, host_allocation);
+        if (cudaStreamCreate(&backend->stream_) != cudaSuccess) {
+            backend->stream_ = nullptr;
+            return nullptr;
+        }
+        return backend;
+    }
+
+
+
+    TensorRTBackend::TensorRTBackend(std::shared_ptr<nvinfer1::ICudaEngine> engine,
+                                     int                                    max_batch_size,
+                                     HostAllocation                         host_allocation)
+        : engine_(engine), max_batch_size_(max_batch_size), host_allocation_(host_allocation)
+    {
+    }
+
+
+
+    TensorRTBackend::~TensorRTBackend()
+    {
+        if (stream_) {
+            cudaStreamDestroy(stream_);
+        }
+    }
+
+
+
+    int TensorRTBackend::maxBatchSize() const
+    {
+        return max_batch_size_;
+    }
+
+
+
+    int TensorRTBackend::numBindings() const
+    {
+        return engine_->getNbBindings();
+    }
+
+
+
+    std::string TensorRTBackend::bindingName(int index) const
+    {
+        return engine_->getBindingName(index);
+    }
+
+
+
+    bool TensorRTBackend::bindingIsInput(int index) const
+    {
+        return engine_->bindingIsInput(index);
+    }
+
+
+
+    std::vector<int> TensorRTBackend::bindingShape(int index) const
+    {
+        const nvinfer1::Dims dims = engine_->getBindingDimensions(index);
+        return std::vector<int>(dims.d, dims.d + dims.nbDims);
+    }
+
+
+
+    void* TensorRTBackend::hostBuffer(const std::string& tensor_name) const
+    {
+        return buffer_manager_->getHostBuffer(tensor_name);
+    }
+
+
+
+    void* TensorRTBackend::deviceBuffer(const std::string& tensor_name) const
+    {
+        return buffer_manager_->getDeviceBuffer(tensor_name);
+    }
+
+
+
+    bool TensorRTBackend::copyInputToDevice(int batch_size)
+    {
+        return buffer_manager_->copyInputToDevice(batch_size);
+    }
+
+
+
+    bool TensorRTBackend::execute(int batch_size)
+    {
+        return context_->execute(batch_size, buffer_manager_->getDeviceBindings().data());
+    }
+
+
+
+    bool TensorRTBackend::copyOutputToHost(int batch_size)
+    {
+        return buffer_manager_->copyOutputToHost(batch_size);
+    }
+
+
+
+    bool TensorRTBackend::enqueue(int batch_size)
+    {
+        if (!buffer_manager_->copyInputToDeviceAsync(stream_, batch_size)) {
+            return false;
+        }
+        const bool status = context_->enqueue(batch_size,
+                buffer_manager_->getDeviceBindings().data(), stream_, nullptr);
+        if (!status) {
+            return false;
+        }
+        return buffer_manager_->copyOutputToHostAsync(stream_, batch_size);
+    }
+
+
+
+    bool TensorRTBackend::synchronize()
+    {
+        return cudaStreamSynchronize(stream_) == cudaSuccess;
+    }
+
+
+
+    std::vector<BindingMemory> TensorRTBackend::memoryUsage() const
+    {
+        std::vector<BindingMemory> usage;
+        for (int i = 0; i < numBindings(); i++) {
+            usage.push_back({bindingName(i), bindingIsInput(i),
+                    buffer_manager_->hostBytes(i), buffer_manager_->deviceBytes(i)});
+        }
+        return usage;
+    }
+
+
+
+    std::unique_ptr<InferenceBackend> TensorRTBackend::clone() const
+    {
+        return create(engine_, max_batch_size_, host_allocation_);
+    }
+} // namespace mr
@@ -0,0 +1,221 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+
+#include "maskrcnn_trt/trace.hpp"
+
+namespace mr {
+    /** A single span. The fields are atomic so that trace_write() can read
+     * them while the owning thread overwrites them.
+     */
+    struct TraceEvent {
+        std::atomic<const char*> name {nullptr};
+        std::atomic<int64_t> start {0};
+        std::atomic<int64_t> end {0};
+    };
+
+
+
+    /** The ring buffer of a single thread. Only the owning thread writes
+     * events. Writing event i first increments claimed_ to i + 1, then writes
+     * the event and finally increments published_ to i + 1. A reader that
+     * copied events below published_ and then sees claimed_ can tell which of
+     * them may have been overwritten while copying.
+     */
+    struct ThreadTrace {
+        ThreadTrace(int id, size_t capacity)
+            : id(id), capacity(capacity), events(new TraceEvent[capacity])
+        {
+        }
+
+        const int id;
+        const size_t capacity;
+        std::unique_ptr<TraceEvent[]> events;
+        std::atomic<uint64_t> claimed {0};
+        std::atomic<uint64_t> published {0};
+        /** Events before this index were discarded by trace_clear().
+         */
+        std::atomic<uint64_t> first {0};
+        /** Protected by the registry mutex.
+         */
+        std::string name;
+    };
+
+
+
+    /** All ring buffers ever created. They are kept after their thread exits
+     * so that its spans can still be written.
+     */
+    struct TraceRegistry {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<ThreadTrace>> threads;
+        size_t capacity = 65536;
+    };
+
+    static TraceRegistry& trace_registry()
+    {
+        static TraceRegistry registry;
+        return registry;
+    }
+
+    static const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+    static thread_local std::shared_ptr<ThreadTrace> thread_trace;
+
+    static ThreadTrace& local_trace()
+    {
+        if (!thread_trace) {
+            TraceRegistry& registry = trace_registry();
+            std::lock_guard<std::mutex> lock (registry.mutex);
+            thread_trace = std::make_shared<ThreadTrace>(registry.threads.size(), registry.capacity);
+            registry.threads.push_back(thread_trace);
+        }
+        return *thread_trace;
+    }
+
+    static void write_json_string(std::ostream& os, const char* s)
+    {
+        os << '"';
+        for (; *s; s++) {
+            if (*s == '"' || *s == '\\') {
+                os << '\\' << *s;
+            } else if (static_cast<unsigned char>(*s) >= 0x20) {
+                os << *s;
+            }
+        }
+        os << '"';
+    }
+
+
+
+    namespace detail {
+        std::atomic<bool> trace_enabled {false};
+
+
+
+        int64_t trace_now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - trace_epoch).count();
+        }
+
+
+
+        void trace_record(const char* name, int64_t start_ns, int64_t end_ns)
+        {
+            ThreadTrace& t = local_trace();
+            const uint64_t i = t.published.load(std::memory_order_relaxed);
+            t.claimed.store(i + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            TraceEvent& e = t.events[i % t.capacity];
+            e.name.store(name, std::memory_order_relaxed);
+            e.start.store(start_ns, std::memory_order_relaxed);
+            e.end.store(end_ns, std::memory_order_relaxed);
+            t.published.store(i + 1, std::memory_order_release);
+        }
+    } // namespace detail
+
+
+
+    void trace_enable(size_t events_per_thread)
+    {
+        {
+            TraceRegistry& registry = trace_registry();
+            std::lock_guard<std::mutex> lock (registry.mutex);
+            registry.capacity = std::max(events_per_thread, static_cast<size_t>(1));
+        }
+        detail::trace_enabled.store(true, std::memory_order_relaxed);
+    }
+
+
+
+    void trace_disable()
+    {
+        detail::trace_enabled.store(false, std::memory_order_relaxed);
+    }
+
+
+
+    void trace_clear()
+    {
+        TraceRegistry& registry = trace_registry();
+        std::lock_guard<std::mutex> lock (registry.mutex);
+        for (const auto& t : registry.threads) {
+            t->first.store(t->published.load(std::memory_order_acquire), std::memory_order_relaxed);
+        }
+    }
+
+
+
+    void trace_thread_name(const std::string& name)
+    {
+        ThreadTrace& t = local_trace();
+        std::lock_guard<std::mutex> lock (trace_registry().mutex);
+        t.name = name;
+    }
+
+
+
+    bool trace_write(const std::string& filename)
+    {
+        std::ofstream f (filename);
+        if (!f.good()) {
+            return false;
+        }
+        const pid_t pid = getpid();
+        f << std::fixed << std::setprecision(3);
+        f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first_event = true;
+
+        TraceRegistry& registry = trace_registry();
+        std::lock_guard<std::mutex> lock (registry.mutex);
+        std::vector<std::pair<const char*, std::pair<int64_t, int64_t>>> events;
+        for (const auto& t : registry.threads) {
+            // Copy the events published so far.
+            const uint64_t end = t->published.load(std::memory_order_acquire);
+            uint64_t begin = std::max(t->first.load(std::memory_order_relaxed),
+                    end > t->capacity ? end - t->capacity : 0);
+            events.clear();
+            for (uint64_t i = begin; i < end; i++) {
+                const TraceEvent& e = t->events[i % t->capacity];
+                events.push_back({e.name.load(std::memory_order_relaxed),
+                        {e.start.load(std::memory_order_relaxed), e.end.load(std::memory_order_relaxed)}});
+            }
+            // Drop the events the thread may have overwritten while they were
+            // being copied.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t claimed = t->claimed.load(std::memory_order_relaxed);
+            const uint64_t valid_begin = claimed > t->capacity ? claimed - t->capacity : 0;
+            const size_t skip = valid_begin > begin ? std::min<uint64_t>(valid_begin - begin, events.size()) : 0;
+
+            if (!t->name.empty()) {
+                f << (first_event ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":"
+                    << pid << ",\"tid\":" << t->id << ",\"args\":{\"name\":";
+                write_json_string(f, t->name.c_str());
+                f << "}}";
+                first_event = false;
+            }
+            for (size_t i = skip; i < events.size(); i++) {
+                const auto& e = events[i];
+                f << (first_event ? "" : ",") << "\n{\"name\":";
+                write_json_string(f, e.first);
+                f << ",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << t->id
+                    << ",\"ts\":" << e.second.first / 1000.0
+                    << ",\"dur\":" << (e.second.second - e.second.first) / 1000.0 << "}";
+                first_event = false;
+            }
+        }
+        f << "\n]}\n";
+        return f.good();
+    }
+} // namespace mr
@@ -0,0 +1,286 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+#include <opencv2/imgproc.hpp>
+
+#include "maskrcnn_trt/tracker.hpp"
+
+namespace mr {
+    /** The standard deviation of the initial velocity of a track in pixels
+     * per frame.
+     */
+    static constexpr float initial_velocity_std = 10.0f;
+
+
+
+    /** Return the intersection over union of the bounding boxes of two
+     * detections.
+     */
+    static float box_iou(const Detection& a, const Detection& b)
+    {
+        const float width = std::min(a.x_end, b.x_end) - std::max(a.x_start, b.x_start);
+        const float height = std::min(a.y_end, b.y_end) - std::max(a.y_start, b.y_start);
+        if (width <= 0.0f || height <= 0.0f) {
+            return 0.0f;
+        }
+        const float intersection = width * height;
+        const float area_a = (a.x_end - a.x_start) * (a.y_end - a.y_start);
+        const float area_b = (b.x_end - b.x_start) * (b.y_end - b.y_start);
+        return intersection / (area_a + area_b - intersection);
+    }
+
+
+
+    /** Return the centre x, centre y, width and height of the bounding box of
+     * a detection.
+     */
+    static std::array<float, 4> box_state(const Detection& d)
+    {
+        return {(d.x_start + d.x_end) / 2.0f, (d.y_start + d.y_end) / 2.0f,
+            d.x_end - d.x_start, d.y_end - d.y_start};
+    }
+
+
+
+    void IoUTracker::Filter::predict(float process_variance)
+    {
+        position += velocity;
+        // P = F P F^T + Q for F = [1 1; 0 1] and the discrete white noise
+        // acceleration model Q = q [1/4 1/2; 1/2 1].
+        const std::array<float, 4> q = p;
+        p[0] = q[0] + q[1] + q[2] + q[3] + process_variance / 4.0f;
+        p[1] = q[1] + q[3] + process_variance / 2.0f;
+        p[2] = q[2] + q[3] + process_variance / 2.0f;
+        p[3] = q[3] + process_variance;
+    }
+
+
+
+    void IoUTracker::Filter::update(float measurement, float measurement_variance)
+    {
+        const float s = p[0] + measurement_variance;
+        const float k0 = p[0] / s;
+        const float k1 = p[2] / s;
+        const float innovation = measurement - position;
+        position += k0 * innovation;
+        velocity += k1 * innovation;
+        const std::array<float, 4> q = p;
+        p[0] = (1.0f - k0) * q[0];
+        p[1] = (1.0f - k0) * q[1];
+        p[2] = q[2] - k1 * q[0];
+        p[3] = q[3] - k1 * q[1];
+    }
+
+
+
+    IoUTracker::IoUTracker(const TrackerConfig& config)
+        : config_(config)
+    {
+    }
+
+
+
+    std::vector<Detection> IoUTracker::update(std::vector<Detection> detections,
+                                              cv::Size               image_size)
+    {
+        image_size_ = image_size;
+        predictTracks();
+        // Gather all candidate matches and greedily accept them in order of
+        // decreasing IoU. Ties are broken by track and detection order so the
+        // result is deterministic.
+        std::vector<std::tuple<float, size_t, size_t>> candidates;
+        for (size_t t = 0; t < tracks_.size(); t++) {
+            Detection predicted = tracks_[t].keyframe_detection;
+            const std::array<float, 4> s = {tracks_[t].filters[0].position,
+                tracks_[t].filters[1].position, tracks_[t].filters[2].position,
+                tracks_[t].filters[3].position};
+            predicted.x_start = s[0] - s[2] / 2.0f;
+            predicted.y_start = s[1] - s[3] / 2.0f;
+            predicted.x_end = s[0] + s[2] / 2.0f;
+            predicted.y_end = s[1] + s[3] / 2.0f;
+            for (size_t d = 0; d < detections.size(); d++) {
+                if (detections[d].class_id != predicted.class_id) {
+                    continue;
+                }
+                const float iou = box_iou(predicted, detections[d]);
+                if (iou >= config_.iou_threshold) {
+                    candidates.emplace_back(iou, t, d);
+                }
+            }
+        }
+        std::stable_sort(candidates.begin(), candidates.end(),
+                [](const auto& a, const auto& b) { return std::get<0>(a) > std::get<0>(b); });
+
+        last_update_ = UpdateStats();
+        std::vector<bool> track_matched (tracks_.size(), false);
+        std::vector<bool> detection_matched (detections.size(), false);
+        const float measurement_variance = config_.measurement_noise * config_.measurement_noise;
+        for (const auto& c : candidates) {
+            const size_t t = std::get<1>(c);
+            const size_t d = std::get<2>(c);
+            if (track_matched[t] || detection_matched[d]) {
+                continue;
+            }
+            track_matched[t] = true;
+            detection_matched[d] = true;
+            Track& track = tracks_[t];
+            const std::array<float, 4> s = box_state(detections[d]);
+            for (size_t i = 0; i < s.size(); i++) {
+                track.filters[i].update(s[i], measurement_variance);
+            }
+            detections[d].track_id = track.id;
+            track.keyframe_detection = detections[d];
+            track.missed_keyframes = 0;
+            last_update_.matched++;
+        }
+
+        // Remove the tracks that have been missed for too long.
+        std::vector<Track> tracks;
+        tracks.reserve(tracks_.size() + detections.size());
+        for (size_t t = 0; t < tracks_.size(); t++) {
+            if (!track_matched[t]) {
+                last_update_.missed++;
+                if (++tracks_[t].missed_keyframes > config_.max_missed_keyframes) {
+                    continue;
+                }
+            }
+            tracks.push_back(std::move(tracks_[t]));
+        }
+        // Start new tracks from the unmatched detections.
+        for (size_t d = 0; d < detections.size(); d++) {
+            if (!detection_matched[d]) {
+                detections[d].track_id = next_id_;
+                tracks.push_back(createTrack(detections[d]));
+                last_update_.created++;
+            }
+        }
+        tracks_ = std::move(tracks);
+        return detections;
+    }
+
+
+
+    std::vector<Detection> IoUTracker::predict()
+    {
+        predictTracks();
+        std::vector<Detection> detections;
+        for (const auto& track : tracks_) {
+            if (track.missed_keyframes > 0) {
+                continue;
+            }
+            Detection d = predictedDetection(track);
+            if (d.x_end > d.x_start && d.y_end > d.y_start) {
+                detections.push_back(std::move(d));
+            }
+        }
+        return detections;
+    }
+
+
+
+    void IoUTracker::advance()
+    {
+        predictTracks();
+    }
+
+
+
+    void IoUTracker::reset()
+    {
+        tracks_.clear();
+        last_update_ = UpdateStats();
+    }
+
+
+
+    size_t IoUTracker::numTracks() const
+    {
+        return tracks_.size();
+    }
+
+
+
+    const IoUTracker::UpdateStats& IoUTracker::lastUpdate() const
+    {
+        return last_update_;
+    }
+
+
+
+    IoUTracker::Track IoUTracker::createTrack(const Detection& detection)
+    {
+        Track track;
+        track.id = next_id_++;
+        const std::array<float, 4> s = box_state(detection);
+        const float measurement_variance = config_.measurement_noise * config_.measurement_noise;
+        for (size_t i = 0; i < s.size(); i++) {
+            track.filters[i].position = s[i];
+            track.filters[i].velocity = 0.0f;
+            track.filters[i].p = {measurement_variance, 0.0f,
+                0.0f, initial_velocity_std * initial_velocity_std};
+        }
+        track.keyframe_detection = detection;
+        return track;
+    }
+
+
+
+    void IoUTracker::predictTracks()
+    {
+        const float process_variance = config_.process_noise * config_.process_noise;
+        for (auto& track : tracks_) {
+            for (auto& filter : track.filters) {
+                filter.predict(process_variance);
+            }
+        }
+    }
+
+
+
+    Detection IoUTracker::predictedDetection(const Track& track) const
+    {
+        const Detection& kd = track.keyframe_detection;
+        Detection d = kd;
+        d.mask = cv::Mat();
+        // The predicted box, rounded to whole pixels since masks are.
+        const float cx = track.filters[0].position;
+        const float cy = track.filters[1].position;
+        const float w = std::max(track.filters[2].position, 1.0f);
+        const float h = std::max(track.filters[3].position, 1.0f);
+        const cv::Rect box (std::floor(cx - w / 2.0f), std::floor(cy - h / 2.0f),
+                std::round(w), std::round(h));
+        const cv::Rect visible = box & cv::Rect(cv::Point(0, 0), image_size_);
+        d.x_start = visible.x;
+        d.y_start = visible.y;
+        d.x_end = visible.x + visible.width;
+        d.y_end = visible.y + visible.height;
+        if (visible.empty() || kd.mask.empty()) {
+            return d;
+        }
+        // The part of the keyframe mask inside its bounding box, see
+        // get_detection_masks().
+        const cv::Mat box_mask = kd.box_local_mask ? kd.mask
+            : kd.mask(cv::Rect(kd.x_start, kd.y_start, kd.x_end - kd.x_start, kd.y_end - kd.y_start)
+                    & cv::Rect(cv::Point(0, 0), kd.mask.size()));
+        if (box_mask.empty()) {
+            return d;
+        }
+        cv::Mat scaled_mask = box_mask;
+        if (box_mask.size() != box.size()) {
+            cv::resize(box_mask, scaled_mask, box.size());
+        }
+        const cv::Mat visible_mask = scaled_mask(visible - box.tl());
+        if (kd.box_local_mask) {
+            d.mask = visible.size() == box.size() ? visible_mask : visible_mask.clone();
+        } else {
+            d.mask = cv::Mat(image_size_, CV_8UC1, cv::Scalar(0));
+            visible_mask.copyTo(d.mask(visible));
+        }
+        return d;
+    }
+} // namespace mr
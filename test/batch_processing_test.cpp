@@ -0,0 +1,154 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <thread>
+
+#include "maskrcnn_trt/batch_processing.hpp"
+#include "maskrcnn_trt/filesystem.hpp"
+#include "test.hpp"
+
+static constexpr int num_images = 200;
+
+
+
+/** Return whether image i fails to decode.
+ */
+static bool decode_fails(int i)
+{
+    return i % 7 == 3;
+}
+
+
+
+/** A decoder sleeping for a random time so that images finish decoding out
+ * of order. The filenames are the image indices and image i has i + 1 rows.
+ */
+static cv::Mat mock_decode(const std::string& filename, cv::Size& size)
+{
+    const int i = std::stoi(filename);
+    std::mt19937 rng (i);
+    std::this_thread::sleep_for(std::chrono::microseconds(rng() % 2000));
+    if (decode_fails(i)) {
+        size = cv::Size();
+        return cv::Mat();
+    }
+    size = cv::Size(2, i + 1);
+    return cv::Mat(i + 1, 2, CV_8UC1);
+}
+
+
+
+static std::vector<std::string> image_filenames()
+{
+    std::vector<std::string> filenames;
+    for (int i = 0; i < num_images; i++) {
+        filenames.push_back(std::to_string(i));
+    }
+    return filenames;
+}
+
+
+
+/** Images must be returned in order although the decoder threads finish them
+ * out of order and reuse the slots of consumed images.
+ */
+static void test_prefetch_order()
+{
+    for (const size_t max_ahead : {1, 3, 16}) {
+        mr::ImagePrefetcher prefetcher (image_filenames(), 4, max_ahead, mock_decode);
+        mr::DecodedImage decoded;
+        int i = 0;
+        bool ordered = true;
+        while (prefetcher.next(decoded)) {
+            ordered = ordered && decoded.filename == std::to_string(i)
+                && decoded.image.empty() == decode_fails(i)
+                && (decode_fails(i) || decoded.image.rows == i + 1)
+                && decoded.original_size == (decode_fails(i) ? cv::Size() : cv::Size(2, i + 1));
+            if (i % 10 == 0) {
+                // Let the decoders fill all slots.
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+            i++;
+        }
+        MR_CHECK(ordered);
+        MR_CHECK(i == num_images);
+        MR_CHECK(!prefetcher.next(decoded));
+    }
+}
+
+
+
+/** Destroying a prefetcher before consuming all images must not hang.
+ */
+static void test_prefetch_stop()
+{
+    mr::ImagePrefetcher prefetcher (image_filenames(), 4, 3, mock_decode);
+    mr::DecodedImage decoded;
+    MR_CHECK(prefetcher.next(decoded));
+    MR_CHECK(decoded.filename == "0");
+}
+
+
+
+/** Decode images ahead, pass them through several writer threads and check
+ * the output lines are in input order with decode errors reported through
+ * addError().
+ */
+static void test_write_order()
+{
+    const std::string filename
+        = (stdfs::temp_directory_path() / "maskrcnn_batch_processing_test.jsonl").string();
+    {
+        mr::ResultWriter writer;
+        MR_CHECK(writer.open(filename, 4, 3));
+        mr::ImagePrefetcher prefetcher (image_filenames(), 4, 8, mock_decode);
+        mr::DecodedImage decoded;
+        while (prefetcher.next(decoded)) {
+            if (decoded.image.empty()) {
+                writer.addError(decoded.filename, "could not decode image");
+                continue;
+            }
+            // Vary the number of detections, and so the formatting time, so
+            // the writer threads finish out of order.
+            const int i = std::stoi(decoded.filename);
+            std::vector<mr::Detection> detections ((i * 37) % 50);
+            for (auto& d : detections) {
+                d.class_id = 1 + i % 80;
+            }
+            writer.add(decoded.filename, decoded.original_size, std::move(detections));
+        }
+        MR_CHECK(writer.close());
+    }
+
+    std::ifstream file (filename);
+    std::string line;
+    int i = 0;
+    bool ordered = true;
+    while (std::getline(file, line)) {
+        const std::string prefix = "{\"frame\":" + std::to_string(i)
+            + ",\"image\":\"" + std::to_string(i) + "\",";
+        const bool error = line.find("\"error\":\"could not decode image\"") != std::string::npos;
+        const bool has_detections = line.find("\"detections\":[") != std::string::npos;
+        ordered = ordered && line.compare(0, prefix.size(), prefix) == 0
+            && error == decode_fails(i) && has_detections != decode_fails(i)
+            && (decode_fails(i) || line.find("\"height\":" + std::to_string(i + 1)) != std::string::npos);
+        i++;
+    }
+    MR_CHECK(ordered);
+    MR_CHECK(i == num_images);
+    std::remove(filename.c_str());
+}
+
+
+
+int main()
+{
+    test_prefetch_order();
+    test_prefetch_stop();
+    test_write_order();
+    return mr_test::result();
+}
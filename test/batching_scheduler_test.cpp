@@ -0,0 +1,173 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+#include "maskrcnn_trt/batching_scheduler.hpp"
+#include "test.hpp"
+
+using namespace std::chrono_literals;
+
+/** The simulated latency of a batch of batch_size images. Like a GPU, larger
+ * batches take longer but have a lower latency per image.
+ */
+static std::chrono::microseconds mock_latency(size_t batch_size)
+{
+    return 400us + batch_size * 100us;
+}
+
+
+
+/** A mock backend returning a single detection per image whose class ID is
+ * the number of rows of the image after mock_latency(). Throws on images with
+ * a single row.
+ */
+static std::vector<std::vector<mr::Detection>> mock_infer(const std::vector<cv::Mat>& images)
+{
+    std::this_thread::sleep_for(mock_latency(images.size()));
+    std::vector<std::vector<mr::Detection>> detections;
+    for (const auto& image : images) {
+        if (image.rows == 1) {
+            throw std::runtime_error("mock inference error");
+        }
+        mr::Detection d;
+        d.class_id = image.rows;
+        detections.push_back({d});
+    }
+    return detections;
+}
+
+
+
+/** Submit from several threads and check each image gets its own result,
+ * that no batch exceeds the maximum size and that images queued while a batch
+ * is running are batched together.
+ */
+static void test_concurrent_submit()
+{
+    constexpr int max_batch_size = 4;
+    std::atomic<int> max_seen {0};
+    mr::BatchingScheduler scheduler (
+            [&max_seen](const std::vector<cv::Mat>& images) {
+                int seen = max_seen;
+                while (static_cast<int>(images.size()) > seen
+                        && !max_seen.compare_exchange_weak(seen, images.size())) {
+                }
+                return mock_infer(images);
+            }, max_batch_size, 2000us);
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong {0};
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([&scheduler, &wrong, t]() {
+            for (int i = 0; i < 50; i++) {
+                const int rows = 2 + t * 50 + i;
+                const std::vector<mr::Detection> d = scheduler.submit(cv::Mat(rows, 1, CV_8UC1)).get();
+                if (d.size() != 1 || d[0].class_id != rows) {
+                    wrong++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    MR_CHECK(wrong == 0);
+    MR_CHECK(max_seen <= max_batch_size);
+    const mr::BatchingScheduler::Stats stats = scheduler.stats();
+    uint64_t images = 0;
+    uint64_t batches = 0;
+    for (size_t i = 0; i < stats.batch_size_histogram.size(); i++) {
+        images += i * stats.batch_size_histogram[i];
+        batches += stats.batch_size_histogram[i];
+    }
+    MR_CHECK(images == 8 * 50);
+    // With 8 submitting threads and a single dispatcher the queue fills up
+    // while each batch is running so most batches are full.
+    MR_CHECK(stats.batch_size_histogram[max_batch_size] > batches / 2);
+    MR_CHECK(stats.queue_depth == 0);
+}
+
+
+
+/** An exception thrown by the inference function must reach the futures of
+ * its batch and the scheduler must keep working afterwards.
+ */
+static void test_inference_exception()
+{
+    mr::BatchingScheduler scheduler (mock_infer, 1, 100us);
+    std::future<std::vector<mr::Detection>> failed = scheduler.submit(cv::Mat(1, 1, CV_8UC1));
+    bool thrown = false;
+    try {
+        failed.get();
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    MR_CHECK(thrown);
+    std::future<std::vector<mr::Detection>> next = scheduler.submit(cv::Mat(3, 1, CV_8UC1));
+    MR_CHECK(next.wait_for(5s) == std::future_status::ready);
+    const std::vector<mr::Detection> d = next.get();
+    MR_CHECK(d.size() == 1 && d[0].class_id == 3);
+}
+
+
+
+/** A partial batch must be dispatched once its deadline expires.
+ */
+static void test_deadline()
+{
+    mr::BatchingScheduler scheduler (mock_infer, 8, 50000us);
+    std::future<std::vector<mr::Detection>> f = scheduler.submit(cv::Mat(5, 1, CV_8UC1));
+    MR_CHECK(f.wait_for(5s) == std::future_status::ready);
+    MR_CHECK(scheduler.stats().batch_size_histogram[1] == 1);
+
+    // Images submitted within the delay of each other are dispatched
+    // together without waiting for a full batch.
+    std::future<std::vector<mr::Detection>> f1 = scheduler.submit(cv::Mat(3, 1, CV_8UC1));
+    std::future<std::vector<mr::Detection>> f2 = scheduler.submit(cv::Mat(4, 1, CV_8UC1));
+    MR_CHECK(f1.wait_for(5s) == std::future_status::ready);
+    MR_CHECK(f2.wait_for(5s) == std::future_status::ready);
+    const mr::BatchingScheduler::Stats stats = scheduler.stats();
+    MR_CHECK(stats.batch_size_histogram[1] == 1);
+    MR_CHECK(stats.batch_size_histogram[2] == 1);
+}
+
+
+
+/** Images submitted after shutdown() must fail immediately while images
+ * submitted before it are still dispatched.
+ */
+static void test_submit_after_shutdown()
+{
+    mr::BatchingScheduler scheduler (mock_infer, 4, 100000us);
+    std::future<std::vector<mr::Detection>> before = scheduler.submit(cv::Mat(4, 1, CV_8UC1));
+    scheduler.shutdown();
+    MR_CHECK(before.wait_for(0s) == std::future_status::ready);
+    const std::vector<mr::Detection> d = before.get();
+    MR_CHECK(d.size() == 1 && d[0].class_id == 4);
+
+    std::future<std::vector<mr::Detection>> after = scheduler.submit(cv::Mat(4, 1, CV_8UC1));
+    MR_CHECK(after.wait_for(5s) == std::future_status::ready);
+    bool thrown = false;
+    try {
+        after.get();
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    MR_CHECK(thrown);
+    // Shutting down again is a no-op.
+    scheduler.shutdown();
+}
+
+
+
+int main()
+{
+    test_concurrent_submit();
+    test_inference_exception();
+    test_deadline();
+    test_submit_after_shutdown();
+    return mr_test::result();
+}
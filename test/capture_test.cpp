@@ -0,0 +1,211 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "maskrcnn_trt/capture.hpp"
+#include "maskrcnn_trt/filesystem.hpp"
+#include "maskrcnn_trt/maskrcnn_config.hpp"
+#include "test.hpp"
+
+static constexpr int num_frames = 3;
+
+/** The size of the header at the start of both capture files.
+ */
+static constexpr size_t header_size = 64;
+
+
+
+/** Return the output buffers of frame f, which differ in every element
+ * checked by read_frames_match().
+ */
+static void frame_buffers(int f, std::vector<float>& detections, std::vector<float>& masks)
+{
+    detections.assign(mr::MaskRCNNConfig::model_detection_volume, 0.0f);
+    masks.assign(mr::MaskRCNNConfig::model_mask_volume, 0.0f);
+    for (size_t i = 0; i < detections.size(); i++) {
+        detections[i] = f + 0.001f * i;
+    }
+    masks.front() = f + 0.5f;
+    masks[masks.size() / 2] = f + 0.25f;
+    masks.back() = f + 0.75f;
+}
+
+
+
+/** Write num_frames frames to a new capture.
+ */
+static void write_capture(const std::string& filename)
+{
+    std::remove(filename.c_str());
+    std::remove((filename + ".idx").c_str());
+    mr::CaptureWriter writer;
+    MR_CHECK(writer.open(filename));
+    std::vector<float> detections;
+    std::vector<float> masks;
+    for (int f = 0; f < num_frames; f++) {
+        frame_buffers(f, detections, masks);
+        MR_CHECK(writer.write(10 + f, cv::Size(640 + f, 480), f == 1, detections.data(), masks.data()));
+    }
+}
+
+
+
+/** Return whether the first n records of reader contain the frames written
+ * by write_capture().
+ */
+static bool read_frames_match(const mr::CaptureReader& reader, size_t n)
+{
+    std::vector<float> detections;
+    std::vector<float> masks;
+    for (size_t f = 0; f < n; f++) {
+        frame_buffers(f, detections, masks);
+        const mr::CaptureRecord record = reader.record(f);
+        if (record.metadata.frame_id != 10 + f
+                || record.metadata.image_width != 640 + (int) f
+                || record.metadata.image_height != 480
+                || record.metadata.triggered != (f == 1)
+                || memcmp(record.detection_buffer, detections.data(), detections.size() * sizeof(float)) != 0
+                || record.mask_buffer[0] != masks.front()
+                || record.mask_buffer[masks.size() / 2] != masks[masks.size() / 2]
+                || record.mask_buffer[masks.size() - 1] != masks.back()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+/** Overwrite the offset of index entry i.
+ */
+static void set_entry_offset(const std::string& filename, size_t i, uint64_t offset)
+{
+    const int fd = open((filename + ".idx").c_str(), O_WRONLY);
+    MR_CHECK(fd >= 0);
+    const off_t position = header_size + i * sizeof(mr::CaptureIndexEntry)
+        + offsetof(mr::CaptureIndexEntry, offset);
+    MR_CHECK(pwrite(fd, &offset, sizeof(offset), position) == sizeof(offset));
+    close(fd);
+}
+
+
+
+static void test_round_trip()
+{
+    const std::string filename = (stdfs::temp_directory_path() / "maskrcnn_capture_test.cap").string();
+    write_capture(filename);
+    mr::CaptureReader reader;
+    MR_CHECK(reader.open(filename));
+    MR_CHECK(reader.size() == num_frames);
+    MR_CHECK(read_frames_match(reader, reader.size()));
+
+    // Reopening appends to the existing capture.
+    {
+        mr::CaptureWriter writer;
+        MR_CHECK(writer.open(filename));
+        std::vector<float> detections;
+        std::vector<float> masks;
+        frame_buffers(num_frames, detections, masks);
+        MR_CHECK(writer.write(10 + num_frames, cv::Size(640 + num_frames, 480), false,
+                    detections.data(), masks.data()));
+    }
+    MR_CHECK(reader.open(filename));
+    MR_CHECK(reader.size() == num_frames + 1);
+    MR_CHECK(read_frames_match(reader, reader.size()));
+    reader.close();
+    std::remove(filename.c_str());
+    std::remove((filename + ".idx").c_str());
+}
+
+
+
+static void test_truncated()
+{
+    const std::string filename = (stdfs::temp_directory_path() / "maskrcnn_capture_test.cap").string();
+    mr::CaptureReader reader;
+    // A partial trailing index entry is ignored.
+    write_capture(filename);
+    stdfs::resize_file(filename + ".idx", stdfs::file_size(filename + ".idx") - 1);
+    MR_CHECK(reader.open(filename));
+    MR_CHECK(reader.size() == num_frames - 1);
+    MR_CHECK(read_frames_match(reader, reader.size()));
+    // Records whose data is incomplete are ignored.
+    write_capture(filename);
+    stdfs::resize_file(filename, stdfs::file_size(filename) - 1);
+    MR_CHECK(reader.open(filename));
+    MR_CHECK(reader.size() == num_frames - 1);
+    MR_CHECK(read_frames_match(reader, reader.size()));
+    reader.close();
+    std::remove(filename.c_str());
+    std::remove((filename + ".idx").c_str());
+}
+
+
+
+static void test_corrupt_index()
+{
+    const std::string filename = (stdfs::temp_directory_path() / "maskrcnn_capture_test.cap").string();
+    write_capture(filename);
+    const uint64_t data_size = stdfs::file_size(filename);
+    const std::vector<uint64_t> offsets {
+        // Inside the header.
+        0,
+        // Not a multiple of the record alignment.
+        header_size + 4,
+        // Past the end of the data file, followed by valid entries.
+        data_size,
+        // Overflows when adding the record size.
+        UINT64_MAX - 63,
+    };
+    mr::CaptureReader reader;
+    for (const uint64_t offset : offsets) {
+        write_capture(filename);
+        set_entry_offset(filename, 0, offset);
+        MR_CHECK(!reader.open(filename));
+        MR_CHECK(reader.size() == 0);
+    }
+    std::remove(filename.c_str());
+    std::remove((filename + ".idx").c_str());
+}
+
+
+
+static void test_reopen_writer()
+{
+    const std::string filename = (stdfs::temp_directory_path() / "maskrcnn_capture_test.cap").string();
+    const size_t num_fds = std::distance(stdfs::directory_iterator("/proc/self/fd"),
+            stdfs::directory_iterator());
+    {
+        mr::CaptureWriter writer;
+        for (int i = 0; i < 4; i++) {
+            MR_CHECK(writer.open(filename));
+        }
+        // Opening a second capture closes the first one.
+        MR_CHECK(std::distance(stdfs::directory_iterator("/proc/self/fd"),
+                    stdfs::directory_iterator()) == (long) num_fds + 2);
+    }
+    MR_CHECK(std::distance(stdfs::directory_iterator("/proc/self/fd"),
+                stdfs::directory_iterator()) == (long) num_fds);
+    std::remove(filename.c_str());
+    std::remove((filename + ".idx").c_str());
+}
+
+
+
+int main()
+{
+    test_round_trip();
+    test_truncated();
+    test_corrupt_index();
+    test_reopen_writer();
+    return mr_test::result();
+}
@@ -0,0 +1,193 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "maskrcnn_trt/detection_stream.hpp"
+#include "maskrcnn_trt/filesystem.hpp"
+#include "test.hpp"
+
+static const cv::Size image_size (64, 48);
+
+/** The offset of the mask entry of the first detection of the first record
+ * from the start of the file, after the file and frame headers.
+ */
+static constexpr size_t first_mask_entry = 64 + 64;
+
+
+
+/** Return a detection with a box-local mask containing a filled rectangle.
+ */
+static mr::Detection make_detection(int i)
+{
+    mr::Detection d;
+    d.class_id = i + 1;
+    d.confidence = 0.5f + 0.1f * i;
+    d.x_start = 4 * i;
+    d.y_start = 3 * i;
+    d.x_end = d.x_start + 9 + i;
+    d.y_end = d.y_start + 7;
+    d.mask = cv::Mat(7, 9 + i, CV_8UC1);
+    for (int y = 0; y < d.mask.rows; y++) {
+        for (int x = 0; x < d.mask.cols; x++) {
+            d.mask.ptr<uint8_t>(y)[x] = x > i && y > 1 && y < 5 ? 255 : 0;
+        }
+    }
+    d.box_local_mask = true;
+    d.track_id = 10 + i;
+    return d;
+}
+
+
+
+static bool masks_equal(const cv::Mat& a, const cv::Mat& b)
+{
+    if (a.rows != b.rows || a.cols != b.cols) {
+        return false;
+    }
+    for (int y = 0; y < a.rows; y++) {
+        if (memcmp(a.ptr<uint8_t>(y), b.ptr<uint8_t>(y), a.cols) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+static std::vector<char> read_file(const std::string& filename)
+{
+    std::ifstream file (filename, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+
+
+static void write_file(const std::string& filename, const std::vector<char>& data)
+{
+    std::ofstream file (filename, std::ios::binary);
+    file.write(data.data(), data.size());
+}
+
+
+
+/** Overwrite the value at offset in data.
+ */
+template<typename T>
+static void poke(std::vector<char>& data, size_t offset, T value)
+{
+    memcpy(data.data() + offset, &value, sizeof(value));
+}
+
+
+
+static void test_round_trip()
+{
+    const std::string filename
+        = (stdfs::temp_directory_path() / "maskrcnn_detection_stream_test.bin").string();
+    for (const auto encoding : {mr::MaskEncoding::raw, mr::MaskEncoding::rle}) {
+        std::vector<mr::Detection> detections;
+        for (int i = 0; i < 3; i++) {
+            detections.push_back(make_detection(i));
+        }
+        mr::DetectionStreamWriter writer;
+        MR_CHECK(writer.open(filename, encoding));
+        MR_CHECK(writer.write(7, image_size, detections));
+        MR_CHECK(writer.write(8, image_size, {}));
+        const uint64_t bytes = writer.bytesWritten();
+        writer.close();
+
+        // A trailing incomplete record is ignored.
+        std::vector<char> data = read_file(filename);
+        MR_CHECK(data.size() == bytes);
+        data.resize(data.size() + 80, 0);
+        poke<uint64_t>(data, bytes + 8, 128);
+        write_file(filename, data);
+
+        mr::DetectionStreamReader reader;
+        MR_CHECK(reader.open(filename));
+        MR_CHECK(reader.size() == 2);
+        if (reader.size() != 2) {
+            continue;
+        }
+        const mr::DetectionFrameView view = reader.frame(0);
+        MR_CHECK(view.frame == 7);
+        MR_CHECK(view.image_size == image_size);
+        MR_CHECK(view.size == detections.size());
+        for (size_t i = 0; i < view.size && i < detections.size(); i++) {
+            const mr::Detection d = view.detection(i);
+            MR_CHECK(d.class_id == detections[i].class_id);
+            MR_CHECK(d.confidence == detections[i].confidence);
+            MR_CHECK(d.x_start == detections[i].x_start);
+            MR_CHECK(d.y_end == detections[i].y_end);
+            MR_CHECK(d.track_id == detections[i].track_id);
+            MR_CHECK(d.box_local_mask);
+            MR_CHECK(masks_equal(d.mask, detections[i].mask));
+        }
+        MR_CHECK(reader.frame(1).frame == 8);
+        MR_CHECK(reader.frame(1).size == 0);
+    }
+    std::remove(filename.c_str());
+}
+
+
+
+static void test_invalid_masks()
+{
+    const std::string filename
+        = (stdfs::temp_directory_path() / "maskrcnn_detection_stream_test.bin").string();
+    const std::string corrupt_filename
+        = (stdfs::temp_directory_path() / "maskrcnn_detection_stream_test_corrupt.bin").string();
+    for (const auto encoding : {mr::MaskEncoding::raw, mr::MaskEncoding::rle}) {
+        mr::DetectionStreamWriter writer;
+        MR_CHECK(writer.open(filename, encoding));
+        MR_CHECK(writer.write(0, image_size, {make_detection(0)}));
+        writer.close();
+        const std::vector<char> data = read_file(filename);
+        mr::DetectionStreamReader reader;
+        MR_CHECK(reader.open(filename));
+
+        // The offsets of the fields of the mask entry.
+        const size_t width = first_mask_entry + 4;
+        const size_t height = first_mask_entry + 8;
+        const size_t offset = first_mask_entry + 16;
+        const size_t size = first_mask_entry + 24;
+        std::vector<std::vector<char>> corrupt (6, data);
+        poke<uint32_t>(corrupt[0], first_mask_entry, 3);
+        poke<int32_t>(corrupt[1], width, -9);
+        poke<int32_t>(corrupt[2], height, -7);
+        poke<uint64_t>(corrupt[3], offset, 1u << 20);
+        poke<uint64_t>(corrupt[4], size, 1u << 20);
+        poke<uint64_t>(corrupt[5], offset, 0);
+        if (encoding == mr::MaskEncoding::raw) {
+            // A raw mask must contain exactly width * height bytes.
+            corrupt.push_back(data);
+            poke<int32_t>(corrupt.back(), width, 10);
+        } else {
+            // RLE masks consist of whole run lengths.
+            corrupt.push_back(data);
+            poke<uint64_t>(corrupt.back(), size, 3);
+        }
+        for (const auto& c : corrupt) {
+            write_file(corrupt_filename, c);
+            MR_CHECK(!reader.open(corrupt_filename));
+            MR_CHECK(reader.size() == 0);
+        }
+    }
+    std::remove(filename.c_str());
+    std::remove(corrupt_filename.c_str());
+}
+
+
+
+int main()
+{
+    test_round_trip();
+    test_invalid_masks();
+    return mr_test::result();
+}
@@ -0,0 +1,122 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "maskrcnn_trt/filesystem.hpp"
+#include "maskrcnn_trt/frame_source.hpp"
+#include "test.hpp"
+
+static const cv::Size frame_size (7, 5);
+static const size_t frame_bytes = 3 * frame_size.area();
+
+
+
+/** Return byte i of frame f, unique enough to detect reordered or shifted
+ * frames.
+ */
+static uint8_t frame_byte(int f, size_t i)
+{
+    return (31 * f + i) % 251;
+}
+
+
+
+/** Write num_frames raw frames followed by partial_bytes bytes of another
+ * frame to filename.
+ */
+static void write_raw_frames(const std::string& filename, int num_frames, size_t partial_bytes)
+{
+    std::ofstream file (filename, std::ios::binary);
+    for (int f = 0; f <= num_frames; f++) {
+        const size_t bytes = f < num_frames ? frame_bytes : partial_bytes;
+        for (size_t i = 0; i < bytes; i++) {
+            file.put(frame_byte(f, i));
+        }
+    }
+}
+
+
+
+static void test_read_frames()
+{
+    const std::string filename
+        = (stdfs::temp_directory_path() / "maskrcnn_frame_source_test.raw").string();
+    constexpr int num_frames = 4;
+    for (const size_t partial_bytes : {size_t(0), frame_bytes / 2}) {
+        write_raw_frames(filename, num_frames, partial_bytes);
+        const int fd = open(filename.c_str(), O_RDONLY);
+        MR_CHECK(fd >= 0);
+        mr::RawFrameSource source (fd, frame_size, mr::RawFrameSource::PixelFormat::rgb24);
+        MR_CHECK(!source.bgrOrder());
+        std::vector<cv::Mat> frames;
+        cv::Mat frame;
+        while (source.read(frame)) {
+            frames.push_back(frame);
+        }
+        // The partial frame is ignored and isn't an error.
+        MR_CHECK(frame.empty());
+        MR_CHECK(!source.failed());
+        MR_CHECK(frames.size() == num_frames);
+        // Each frame has its own buffer so earlier frames are still intact.
+        for (size_t f = 0; f < frames.size(); f++) {
+            MR_CHECK(frames[f].size() == frame_size);
+            MR_CHECK(frames[f].type() == CV_8UC3);
+            bool equal = frames[f].isContinuous();
+            for (size_t i = 0; equal && i < frame_bytes; i++) {
+                equal = frames[f].data[i] == frame_byte(f, i);
+            }
+            MR_CHECK(equal);
+        }
+        close(fd);
+    }
+    std::remove(filename.c_str());
+}
+
+
+
+static void test_read_error()
+{
+    // Reading from a directory fails with EISDIR.
+    const int fd = open(stdfs::temp_directory_path().c_str(), O_RDONLY);
+    MR_CHECK(fd >= 0);
+    mr::RawFrameSource source (fd, frame_size);
+    cv::Mat frame;
+    MR_CHECK(!source.read(frame));
+    MR_CHECK(frame.empty());
+    MR_CHECK(source.failed());
+    close(fd);
+}
+
+
+
+static void test_parse_raw_frame_spec()
+{
+    cv::Size size;
+    mr::RawFrameSource::PixelFormat format = mr::RawFrameSource::PixelFormat::rgb24;
+    MR_CHECK(mr::parse_raw_frame_spec("1280x720", size, format));
+    MR_CHECK(size == cv::Size(1280, 720));
+    MR_CHECK(format == mr::RawFrameSource::PixelFormat::bgr24);
+    MR_CHECK(mr::parse_raw_frame_spec("640x480:rgb24", size, format));
+    MR_CHECK(size == cv::Size(640, 480));
+    MR_CHECK(format == mr::RawFrameSource::PixelFormat::rgb24);
+    MR_CHECK(!mr::parse_raw_frame_spec("640", size, format));
+    MR_CHECK(!mr::parse_raw_frame_spec("0x480", size, format));
+    MR_CHECK(!mr::parse_raw_frame_spec("640x480:yuv420p", size, format));
+}
+
+
+
+int main()
+{
+    test_read_frames();
+    test_read_error();
+    test_parse_raw_frame_spec();
+    return mr_test::result();
+}
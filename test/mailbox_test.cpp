@@ -0,0 +1,136 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <array>
+#include <thread>
+
+#include "maskrcnn_trt/mailbox.hpp"
+#include "test.hpp"
+
+using namespace std::chrono_literals;
+
+/** A value large enough that a torn read would mix elements of different
+ * posts.
+ */
+typedef std::array<uint64_t, 32> Value;
+
+static Value make_value(uint64_t n)
+{
+    Value v;
+    v.fill(n);
+    return v;
+}
+
+static bool consistent(const Value& v)
+{
+    for (const uint64_t x : v) {
+        if (x != v[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+/** Only the latest posted value can be taken and each value only once.
+ */
+static void test_latest_value()
+{
+    mr::Mailbox<Value> mailbox;
+    Value v;
+    MR_CHECK(!mailbox.tryTake(v));
+    mailbox.post(make_value(1));
+    mailbox.post(make_value(2));
+    mailbox.post(make_value(3));
+    MR_CHECK(mailbox.tryTake(v));
+    MR_CHECK(v == make_value(3));
+    MR_CHECK(!mailbox.tryTake(v));
+    MR_CHECK(mailbox.dropped() == 2);
+    mailbox.post(make_value(4));
+    MR_CHECK(mailbox.waitTake(v, 1s));
+    MR_CHECK(v == make_value(4));
+    MR_CHECK(!mailbox.waitTake(v, 1ms));
+    MR_CHECK(mailbox.dropped() == 2);
+}
+
+
+
+/** Post from one thread while taking from another. Taken values must never
+ * be torn, duplicated or older than a previously taken one and every posted
+ * value must be either taken or dropped.
+ */
+static void test_stress()
+{
+    constexpr uint64_t num_values = 200000;
+    mr::Mailbox<Value> mailbox;
+    std::thread producer ([&mailbox]() {
+        for (uint64_t n = 1; n <= num_values; n++) {
+            mailbox.post(make_value(n));
+            if (n % 1000 == 0) {
+                // Let the consumer block in waitTake() now and then.
+                std::this_thread::sleep_for(100us);
+            }
+        }
+    });
+    uint64_t taken = 0;
+    uint64_t last = 0;
+    bool torn = false;
+    bool out_of_order = false;
+    Value v;
+    while (last < num_values) {
+        const bool took = taken % 2 ? mailbox.tryTake(v) : mailbox.waitTake(v, 1s);
+        if (!took) {
+            continue;
+        }
+        taken++;
+        torn = torn || !consistent(v);
+        out_of_order = out_of_order || v[0] <= last;
+        last = v[0];
+    }
+    producer.join();
+    MR_CHECK(!torn);
+    MR_CHECK(!out_of_order);
+    MR_CHECK(!mailbox.tryTake(v));
+    MR_CHECK(taken > 1);
+    MR_CHECK(mailbox.dropped() == num_values - taken);
+}
+
+
+
+/** close() must wake up a consumer blocked in waitTake().
+ */
+static void test_close()
+{
+    mr::Mailbox<Value> mailbox;
+    bool took = true;
+    std::chrono::steady_clock::duration waited;
+    std::thread consumer ([&]() {
+        const auto start = std::chrono::steady_clock::now();
+        Value v;
+        took = mailbox.waitTake(v, 60s);
+        waited = std::chrono::steady_clock::now() - start;
+    });
+    std::this_thread::sleep_for(50ms);
+    mailbox.close();
+    consumer.join();
+    MR_CHECK(!took);
+    MR_CHECK(waited < 30s);
+    MR_CHECK(mailbox.closed());
+    // Closing doesn't discard posted values.
+    Value v;
+    mailbox.post(make_value(5));
+    MR_CHECK(mailbox.waitTake(v, 0s));
+    MR_CHECK(v == make_value(5));
+}
+
+
+
+int main()
+{
+    test_latest_value();
+    test_stress();
+    test_close();
+    return mr_test::result();
+}
@@ -0,0 +1,207 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cmath>
+#include <random>
+
+#include <opencv2/imgproc.hpp>
+
+#include "maskrcnn_trt/mask_propagation.hpp"
+#include "test.hpp"
+
+static const cv::Size image_size (160, 120);
+static const cv::Point shift (3, 2);
+static const cv::Rect box (50, 40, 40, 30);
+
+/** Return a smooth random CV_8UC1 texture, bilinearly interpolated from random
+ * values on a grid with a spacing of a few pixels so that it has plenty of
+ * corners to track.
+ */
+static cv::Mat make_texture(cv::Size size, uint32_t seed)
+{
+    constexpr int spacing = 4;
+    const int grid_width = size.width / spacing + 2;
+    const int grid_height = size.height / spacing + 2;
+    std::mt19937 rng (seed);
+    std::uniform_int_distribution<int> distribution (20, 235);
+    std::vector<int> grid (grid_width * grid_height);
+    for (auto& v : grid) {
+        v = distribution(rng);
+    }
+    cv::Mat texture (size, CV_8UC1);
+    for (int y = 0; y < size.height; y++) {
+        uint8_t* row = texture.ptr<uint8_t>(y);
+        const int gy = y / spacing;
+        const float fy = static_cast<float>(y % spacing) / spacing;
+        for (int x = 0; x < size.width; x++) {
+            const int gx = x / spacing;
+            const float fx = static_cast<float>(x % spacing) / spacing;
+            const float top = (1 - fx) * grid[gy * grid_width + gx] + fx * grid[gy * grid_width + gx + 1];
+            const float bottom = (1 - fx) * grid[(gy + 1) * grid_width + gx]
+                + fx * grid[(gy + 1) * grid_width + gx + 1];
+            row[x] = std::lround((1 - fy) * top + fy * bottom);
+        }
+    }
+    return texture;
+}
+
+
+
+/** Return the frame showing the part of texture at offset from its centre,
+ * so that the content of the frame at offset o moves by o - p relative to
+ * the frame at offset p.
+ */
+static cv::Mat make_frame(const cv::Mat& texture, cv::Point offset)
+{
+    const cv::Point origin ((texture.cols - image_size.width) / 2 - offset.x,
+            (texture.rows - image_size.height) / 2 - offset.y);
+    return texture(cv::Rect(origin, image_size)).clone();
+}
+
+
+
+/** Return a detection covering box with a box-local elliptical mask.
+ */
+static mr::Detection make_detection()
+{
+    mr::Detection d;
+    d.class_id = 1;
+    d.confidence = 0.9f;
+    d.x_start = box.x;
+    d.y_start = box.y;
+    d.x_end = box.x + box.width;
+    d.y_end = box.y + box.height;
+    d.mask = cv::Mat(box.size(), CV_8UC1);
+    for (int y = 0; y < box.height; y++) {
+        for (int x = 0; x < box.width; x++) {
+            const float ex = (x + 0.5f - box.width / 2.0f) / (box.width / 2.0f);
+            const float ey = (y + 0.5f - box.height / 2.0f) / (box.height / 2.0f);
+            d.mask.ptr<uint8_t>(y)[x] = ex * ex + ey * ey <= 1.0f ? 255 : 0;
+        }
+    }
+    d.box_local_mask = true;
+    d.track_id = 7;
+    return d;
+}
+
+
+
+/** Return the mask thresholded like the masks of MaskPropagator.
+ */
+static cv::Mat binarize(const cv::Mat& mask)
+{
+    cv::Mat binary;
+    cv::threshold(mask, binary, 127, 255, cv::THRESH_BINARY);
+    return binary;
+}
+
+
+
+/** Return whether a and b differ by at most tolerance pixels.
+ */
+static bool near(float a, float b, float tolerance = 1.0f)
+{
+    return std::fabs(a - b) <= tolerance;
+}
+
+
+
+/** The mask and box must move by the known offset of the frame.
+ */
+static void test_shift()
+{
+    const cv::Mat texture = make_texture(cv::Size(200, 160), 1);
+    const mr::Detection keyframe_detection = make_detection();
+    mr::MaskPropagator propagator;
+    propagator.setKeyframe(make_frame(texture, cv::Point(0, 0)), {keyframe_detection});
+    for (int i = 1; i <= 3; i++) {
+        std::vector<mr::Detection> detections;
+        MR_CHECK(propagator.propagate(make_frame(texture, cv::Point(i * shift.x, i * shift.y)), detections));
+        MR_CHECK(propagator.lastConfidence() >= 0.5f);
+        MR_CHECK(detections.size() == 1);
+        if (detections.size() != 1) {
+            return;
+        }
+        const mr::Detection& d = detections.front();
+        MR_CHECK(d.class_id == keyframe_detection.class_id);
+        MR_CHECK(d.track_id == keyframe_detection.track_id);
+        MR_CHECK(d.box_local_mask);
+        MR_CHECK(near(d.x_start, box.x + i * shift.x));
+        MR_CHECK(near(d.y_start, box.y + i * shift.y));
+        MR_CHECK(near(d.x_end, box.x + box.width + i * shift.x));
+        MR_CHECK(near(d.y_end, box.y + box.height + i * shift.y));
+        MR_CHECK(d.mask.cols == d.x_end - d.x_start);
+        MR_CHECK(d.mask.rows == d.y_end - d.y_start);
+        // The shape of the mask is kept.
+        const double area = cv::countNonZero(binarize(d.mask));
+        const double keyframe_area = cv::countNonZero(keyframe_detection.mask);
+        MR_CHECK(std::fabs(area - keyframe_area) < 0.05 * keyframe_area);
+    }
+}
+
+
+
+/** Full-image masks must be returned as full-image masks.
+ */
+static void test_full_image_mask()
+{
+    const cv::Mat texture = make_texture(cv::Size(200, 160), 2);
+    mr::Detection keyframe_detection = make_detection();
+    cv::Mat mask (image_size, CV_8UC1, cv::Scalar(0));
+    keyframe_detection.mask.copyTo(mask(box));
+    keyframe_detection.mask = mask;
+    keyframe_detection.box_local_mask = false;
+    mr::MaskPropagator propagator;
+    propagator.setKeyframe(make_frame(texture, cv::Point(0, 0)), {keyframe_detection});
+    std::vector<mr::Detection> detections;
+    MR_CHECK(propagator.propagate(make_frame(texture, shift), detections));
+    MR_CHECK(detections.size() == 1);
+    if (detections.size() != 1) {
+        return;
+    }
+    const mr::Detection& d = detections.front();
+    MR_CHECK(!d.box_local_mask);
+    MR_CHECK(d.mask.size() == image_size);
+    MR_CHECK(near(d.x_start, box.x + shift.x));
+    MR_CHECK(near(d.y_start, box.y + shift.y));
+    const cv::Rect mask_box = cv::boundingRect(binarize(d.mask));
+    MR_CHECK(near(mask_box.x, d.x_start) && near(mask_box.y, d.y_start));
+}
+
+
+
+/** If the features are lost propagate() must fail without changing the
+ * detections or the state of the propagator.
+ */
+static void test_lost_features()
+{
+    const cv::Mat texture = make_texture(cv::Size(200, 160), 3);
+    mr::MaskPropagator propagator;
+    propagator.setKeyframe(make_frame(texture, cv::Point(0, 0)), {make_detection()});
+    // An unrelated frame, as after a scene cut.
+    const cv::Mat other = make_frame(make_texture(cv::Size(200, 160), 4), cv::Point(0, 0));
+    std::vector<mr::Detection> detections (2);
+    detections[0].class_id = 42;
+    MR_CHECK(!propagator.propagate(other, detections));
+    MR_CHECK(propagator.lastConfidence() < mr::MaskPropagationConfig().min_confidence);
+    MR_CHECK(detections.size() == 2 && detections[0].class_id == 42);
+
+    // The keyframe is still the reference so the shift is measured from it.
+    MR_CHECK(propagator.propagate(make_frame(texture, shift), detections));
+    MR_CHECK(detections.size() == 1);
+    if (detections.size() == 1) {
+        MR_CHECK(near(detections[0].x_start, box.x + shift.x));
+        MR_CHECK(near(detections[0].y_start, box.y + shift.y));
+    }
+}
+
+
+
+int main()
+{
+    test_shift();
+    test_full_image_mask();
+    test_lost_features();
+    return mr_test::result();
+}
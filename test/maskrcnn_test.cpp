@@ -0,0 +1,198 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <vector>
+
+#include "maskrcnn_trt/maskrcnn.hpp"
+#include "maskrcnn_trt/preprocessing.hpp"
+#include "maskrcnn_trt/replay_backend.hpp"
+#include "test.hpp"
+
+static constexpr int batch_size = 3;
+
+/** The number of synthetic detections of the frame replayed for each image of
+ * the batch, different so that mixing up the images changes the detections.
+ */
+static const int num_detections[batch_size] = {2, 5, 9};
+static const float box_sizes[batch_size] = {0.5f, 0.3f, 0.2f};
+
+/** The images of the batch, with different aspect ratios so that the
+ * detections depend on the size they're computed for.
+ */
+static const cv::Size image_sizes[batch_size] = {{640, 480}, {300, 600}, {1000, 200}};
+
+
+
+/** The synthetic output tensors of the frame replayed for image i.
+ */
+struct SyntheticFrame {
+    std::vector<float> detections;
+    std::vector<float> masks;
+
+    explicit SyntheticFrame(int i)
+        : detections(mr::MaskRCNNConfig::model_detection_volume),
+          masks(mr::MaskRCNNConfig::model_mask_volume)
+    {
+        mr::generate_synthetic_output(num_detections[i], box_sizes[i], i,
+                detections.data(), masks.data());
+    }
+};
+
+
+
+static std::vector<cv::Mat> make_images()
+{
+    std::vector<cv::Mat> images;
+    for (int i = 0; i < batch_size; i++) {
+        images.emplace_back(image_sizes[i], CV_8UC3, cv::Scalar(40 * i, 20 + 40 * i, 80));
+    }
+    return images;
+}
+
+
+
+/** Return whether the detections a and b are identical, including their masks.
+ */
+static bool same_detections(const std::vector<mr::Detection>& a, const std::vector<mr::Detection>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].class_id != b[i].class_id
+                || a[i].confidence != b[i].confidence
+                || a[i].x_start != b[i].x_start || a[i].y_start != b[i].y_start
+                || a[i].x_end != b[i].x_end || a[i].y_end != b[i].y_end
+                || a[i].box_local_mask != b[i].box_local_mask
+                || a[i].mask.size() != b[i].mask.size()) {
+            return false;
+        }
+        if (!a[i].mask.empty() && cv::norm(a[i].mask, b[i].mask, cv::NORM_INF) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+/** Return whether all detections are inside an image of the given size and
+ * have full-image masks.
+ */
+static bool inside_image(const std::vector<mr::Detection>& detections, cv::Size size)
+{
+    for (const auto& d : detections) {
+        if (d.x_start < 0 || d.y_start < 0 || d.x_end > size.width || d.y_end > size.height
+                || d.box_local_mask || d.mask.size() != size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+/** Each image of the batch must be preprocessed into its own slice of the
+ * input buffer and get the detections of its own slice of the output buffers,
+ * mapped to its own size.
+ */
+static void test_batch_infer()
+{
+    auto backend = std::make_unique<mr::ReplayBackend>(batch_size);
+    for (int i = 0; i < batch_size; i++) {
+        const SyntheticFrame frame (i);
+        backend->addFrame(frame.detections.data(), frame.masks.data());
+    }
+    const mr::ReplayBackend* replay = backend.get();
+    mr::MaskRCNNConfig config;
+    config.max_batch_size = batch_size;
+    mr::MaskRCNN network (config, std::move(backend));
+    MR_CHECK(network.build());
+
+    // The detections of the last image are computed for twice its size, as
+    // if it had been decoded at a reduced resolution.
+    const std::vector<cv::Mat> images = make_images();
+    std::vector<cv::Size> sizes (image_sizes, image_sizes + batch_size);
+    sizes.back() = cv::Size(2 * sizes.back().width, 2 * sizes.back().height);
+    const std::vector<std::vector<mr::Detection>> batch_detections
+        = network.infer(images, true, {cv::Size(), cv::Size(), sizes.back()});
+    MR_CHECK(batch_detections.size() == batch_size);
+    if (batch_detections.size() != batch_size) {
+        return;
+    }
+
+    const float* input_buffer
+        = static_cast<const float*>(replay->hostBuffer(mr::MaskRCNNConfig::model_input));
+    std::vector<float> expected_input (mr::MaskRCNNConfig::model_input_volume);
+    size_t num_expected = 0;
+    for (int i = 0; i < batch_size; i++) {
+        mr::preprocess_image(images[i], expected_input.data());
+        MR_CHECK(std::equal(expected_input.begin(), expected_input.end(),
+                    input_buffer + i * mr::MaskRCNNConfig::model_input_volume));
+
+        const SyntheticFrame frame (i);
+        const std::vector<mr::Detection> expected = mr::get_detections(
+                sizes[i].width, sizes[i].height, frame.detections.data(), frame.masks.data());
+        // Boxes outside the image after letterboxing are discarded.
+        MR_CHECK(!expected.empty() && expected.size() <= static_cast<size_t>(num_detections[i]));
+        num_expected += expected.size();
+        MR_CHECK(same_detections(batch_detections[i], expected));
+        MR_CHECK(inside_image(batch_detections[i], sizes[i]));
+    }
+    MR_CHECK(network.metrics().frames == batch_size);
+    MR_CHECK(network.metrics().detections == num_expected);
+}
+
+
+
+/** get_batch_detections() must decode each image from its own slice of the
+ * output buffers.
+ */
+static void test_get_batch_detections()
+{
+    std::vector<float> detection_buffer;
+    std::vector<float> mask_buffer;
+    for (int i = 0; i < batch_size; i++) {
+        const SyntheticFrame frame (i);
+        detection_buffer.insert(detection_buffer.end(), frame.detections.begin(), frame.detections.end());
+        mask_buffer.insert(mask_buffer.end(), frame.masks.begin(), frame.masks.end());
+    }
+    const std::vector<cv::Size> sizes (image_sizes, image_sizes + batch_size);
+    const std::vector<std::vector<mr::Detection>> batch_detections
+        = mr::get_batch_detections(sizes, detection_buffer.data(), mask_buffer.data());
+    MR_CHECK(batch_detections.size() == batch_size);
+    for (size_t i = 0; i < batch_detections.size(); i++) {
+        const SyntheticFrame frame (i);
+        MR_CHECK(same_detections(batch_detections[i], mr::get_detections(sizes[i].width,
+                        sizes[i].height, frame.detections.data(), frame.masks.data())));
+        MR_CHECK(inside_image(batch_detections[i], sizes[i]));
+    }
+}
+
+
+
+/** Batches larger than MaskRCNNConfig::max_batch_size must be rejected.
+ */
+static void test_batch_too_large()
+{
+    auto backend = std::make_unique<mr::ReplayBackend>(batch_size);
+    backend->addSyntheticFrame(1, 0.5f);
+    mr::MaskRCNNConfig config;
+    config.max_batch_size = batch_size - 1;
+    mr::MaskRCNN network (config, std::move(backend));
+    MR_CHECK(network.build());
+    MR_CHECK(network.infer(make_images()).empty());
+    MR_CHECK(network.infer(cv::Mat(480, 640, CV_8UC3, cv::Scalar(0, 0, 0))).size() == 1);
+}
+
+
+
+int main()
+{
+    test_batch_infer();
+    test_get_batch_detections();
+    test_batch_too_large();
+    return mr_test::result();
+}
@@ -0,0 +1,134 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include "maskrcnn_trt/motion_gate.hpp"
+#include "test.hpp"
+
+using Decision = mr::MotionGate::Decision;
+
+/** Return a textured CV_8UC3 image whose pixels are offset by brightness.
+ */
+static cv::Mat make_image(int width, int height, int brightness = 0)
+{
+    cv::Mat image (height, width, CV_8UC3);
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = image.ptr<uint8_t>(y);
+        for (int x = 0; x < 3 * width; x++) {
+            row[x] = (7 * x + 13 * y) % 200 + brightness;
+        }
+    }
+    return image;
+}
+
+
+
+static void test_static_frames()
+{
+    mr::MotionGateConfig config;
+    config.max_skipped_frames = 0;
+    mr::MotionGate gate (config);
+    const cv::Mat image = make_image(256, 192);
+    // The first frame has no reference.
+    MR_CHECK(gate.update(image) == Decision::infer);
+    MR_CHECK(gate.stats().last_score < 0.0f);
+    for (int i = 0; i < 9; i++) {
+        MR_CHECK(gate.update(image.clone()) == Decision::skip);
+    }
+    MR_CHECK(gate.stats().last_score == 0.0f);
+    MR_CHECK(gate.stats().frames == 10);
+    MR_CHECK(gate.stats().skipped == 9);
+    MR_CHECK(gate.stats().refreshes == 0);
+    MR_CHECK(gate.stats().hitRate() == 0.9);
+}
+
+
+
+static void test_changed_frames()
+{
+    mr::MotionGate gate;
+    MR_CHECK(gate.update(make_image(256, 192)) == Decision::infer);
+    // A change below the threshold is skipped.
+    MR_CHECK(gate.update(make_image(256, 192, 1)) == Decision::skip);
+    MR_CHECK(gate.stats().last_score == 1.0f);
+    // A change above the threshold runs inference and the frame becomes the
+    // reference.
+    MR_CHECK(gate.score(make_image(256, 192, 10)) == 10.0f);
+    MR_CHECK(gate.update(make_image(256, 192, 10)) == Decision::infer);
+    MR_CHECK(gate.stats().last_score == 10.0f);
+    MR_CHECK(gate.update(make_image(256, 192, 10)) == Decision::skip);
+    // Slow changes accumulate until they exceed the threshold.
+    MR_CHECK(gate.update(make_image(256, 192, 11)) == Decision::skip);
+    MR_CHECK(gate.update(make_image(256, 192, 12)) == Decision::infer);
+    MR_CHECK(gate.stats().frames == 6);
+    MR_CHECK(gate.stats().skipped == 3);
+    MR_CHECK(gate.stats().hitRate() == 0.5);
+}
+
+
+
+static void test_refresh()
+{
+    mr::MotionGateConfig config;
+    config.max_skipped_frames = 3;
+    mr::MotionGate gate (config);
+    const cv::Mat image = make_image(128, 96);
+    MR_CHECK(gate.update(image) == Decision::infer);
+    for (int cycle = 0; cycle < 2; cycle++) {
+        for (int i = 0; i < config.max_skipped_frames; i++) {
+            MR_CHECK(gate.update(image) == Decision::skip);
+        }
+        MR_CHECK(gate.update(image) == Decision::refresh);
+    }
+    MR_CHECK(gate.stats().frames == 9);
+    MR_CHECK(gate.stats().skipped == 6);
+    MR_CHECK(gate.stats().refreshes == 2);
+}
+
+
+
+static void test_size_change()
+{
+    mr::MotionGateConfig config;
+    config.max_skipped_frames = 0;
+    mr::MotionGate gate (config);
+    MR_CHECK(gate.update(make_image(256, 192)) == Decision::infer);
+    // The same content at a different aspect ratio isn't comparable.
+    MR_CHECK(gate.score(make_image(256, 128)) < 0.0f);
+    MR_CHECK(gate.update(make_image(256, 128)) == Decision::infer);
+    MR_CHECK(gate.update(make_image(256, 128)) == Decision::skip);
+    MR_CHECK(gate.update(make_image(256, 192)) == Decision::infer);
+    // An empty frame is never skipped either.
+    MR_CHECK(gate.update(cv::Mat()) == Decision::infer);
+    MR_CHECK(gate.stats().skipped == 1);
+}
+
+
+
+static void test_reset()
+{
+    mr::MotionGate gate;
+    const cv::Mat image = make_image(128, 96);
+    MR_CHECK(gate.update(image) == Decision::infer);
+    MR_CHECK(gate.update(image) == Decision::skip);
+    gate.invalidateReference();
+    MR_CHECK(gate.update(image) == Decision::infer);
+    MR_CHECK(gate.stats().frames == 3);
+    MR_CHECK(gate.stats().skipped == 1);
+    gate.reset();
+    MR_CHECK(gate.stats().frames == 0);
+    MR_CHECK(gate.stats().hitRate() == 0.0);
+    MR_CHECK(gate.update(image) == Decision::infer);
+}
+
+
+
+int main()
+{
+    test_static_frames();
+    test_changed_frames();
+    test_refresh();
+    test_size_change();
+    test_reset();
+    return mr_test::result();
+}
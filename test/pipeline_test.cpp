@@ -0,0 +1,255 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "maskrcnn_trt/filesystem.hpp"
+#include "maskrcnn_trt/maskrcnn_pipeline.hpp"
+#include "maskrcnn_trt/pipeline.hpp"
+#include "maskrcnn_trt/replay_backend.hpp"
+#include "test.hpp"
+
+using namespace std::chrono_literals;
+
+static constexpr std::chrono::milliseconds preprocess_latency = 5ms;
+static constexpr std::chrono::milliseconds device_latency = 5ms;
+static constexpr std::chrono::milliseconds postprocess_latency = 5ms;
+
+
+
+/** A backend whose stages only sleep. The device work started by launch()
+ * runs concurrently with the host and the output of a frame is its input
+ * multiplied by 10. Launching fails for inputs divisible by fail_every if
+ * it's positive.
+ */
+class MockBackend : public mr::PipelineBackend<int, int> {
+    public:
+        MockBackend(size_t num_slots, int fail_every = 0)
+            : slots_(num_slots), fail_every_(fail_every)
+        {
+        }
+
+        size_t numSlots() const override
+        {
+            return slots_.size();
+        }
+
+        void preprocess(size_t slot, const int& input) override
+        {
+            enter(slot);
+            std::this_thread::sleep_for(preprocess_latency);
+            slots_[slot].value = input;
+        }
+
+        bool launch(size_t slot) override
+        {
+            Slot& s = slots_[slot];
+            s.device_end = std::chrono::steady_clock::now() + device_latency;
+            if (fail_every_ > 0 && s.value % fail_every_ == 0) {
+                // postprocess() isn't called for frames that failed.
+                leave(slot);
+                return false;
+            }
+            return true;
+        }
+
+        bool synchronize(size_t slot) override
+        {
+            std::this_thread::sleep_until(slots_[slot].device_end);
+            return true;
+        }
+
+        int postprocess(size_t slot) override
+        {
+            std::this_thread::sleep_for(postprocess_latency);
+            const int output = 10 * slots_[slot].value;
+            leave(slot);
+            return output;
+        }
+
+        /** Return the maximum number of frames that were in flight at once.
+         */
+        int maxInFlight() const
+        {
+            return max_in_flight_;
+        }
+
+        /** Return whether a slot was ever used by two frames at once.
+         */
+        bool slotReused() const
+        {
+            return slot_reused_;
+        }
+
+    private:
+        struct Slot {
+            int value = 0;
+            std::chrono::steady_clock::time_point device_end;
+            std::atomic<bool> busy {false};
+        };
+
+        std::vector<Slot> slots_;
+        int fail_every_;
+        std::atomic<int> in_flight_ {0};
+        std::atomic<int> max_in_flight_ {0};
+        std::atomic<bool> slot_reused_ {false};
+
+        void enter(size_t slot)
+        {
+            if (slots_[slot].busy.exchange(true)) {
+                slot_reused_ = true;
+            }
+            const int n = ++in_flight_;
+            int max = max_in_flight_;
+            while (n > max && !max_in_flight_.compare_exchange_weak(max, n)) {
+            }
+        }
+
+        void leave(size_t slot)
+        {
+            in_flight_--;
+            slots_[slot].busy = false;
+        }
+};
+
+
+
+/** Results must be returned in submission order and the stages of successive
+ * frames must overlap.
+ */
+static void test_order_and_overlap()
+{
+    constexpr int num_frames = 30;
+    MockBackend backend (3);
+    std::vector<mr::Pipeline<int, int>::Result> results;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        mr::Pipeline<int, int> pipeline (backend);
+        for (int i = 0; i < num_frames; i++) {
+            MR_CHECK(pipeline.submit(i) == static_cast<uint64_t>(i));
+            mr::Pipeline<int, int>::Result result;
+            while (pipeline.poll(result)) {
+                results.push_back(std::move(result));
+            }
+        }
+        mr::Pipeline<int, int>::Result result;
+        while (pipeline.wait(result)) {
+            results.push_back(std::move(result));
+        }
+        MR_CHECK(pipeline.inFlight() == 0);
+    }
+    const auto duration = std::chrono::steady_clock::now() - start;
+
+    MR_CHECK(results.size() == num_frames);
+    bool ordered = true;
+    for (size_t i = 0; i < results.size(); i++) {
+        ordered = ordered && results[i].frame_id == i && results[i].success
+            && results[i].output == 10 * static_cast<int>(i);
+    }
+    MR_CHECK(ordered);
+    MR_CHECK(!backend.slotReused());
+    MR_CHECK(backend.maxInFlight() >= 2);
+    // Running the stages back to back would take num_frames times the sum of
+    // the latencies, with perfect overlap only about a third of that.
+    const auto serial = num_frames * (preprocess_latency + device_latency + postprocess_latency);
+    MR_CHECK(duration < 0.8 * serial);
+}
+
+
+
+/** Frames that fail to launch must be reported unsuccessful and in order.
+ */
+static void test_failed_launch()
+{
+    constexpr int num_frames = 12;
+    MockBackend backend (2, 4);
+    mr::Pipeline<int, int> pipeline (backend);
+    for (int i = 0; i < num_frames; i++) {
+        pipeline.submit(i);
+    }
+    mr::Pipeline<int, int>::Result result;
+    int i = 0;
+    bool ordered = true;
+    while (pipeline.wait(result)) {
+        const bool fails = i % 4 == 0;
+        ordered = ordered && result.frame_id == static_cast<uint64_t>(i) && result.success != fails
+            && (fails || result.output == 10 * i);
+        i++;
+    }
+    MR_CHECK(ordered);
+    MR_CHECK(i == num_frames);
+}
+
+
+
+/** MaskRCNNPipeline must assign frame IDs and record metrics and captures
+ * shared with the network like MaskRCNN::infer().
+ */
+static void test_maskrcnn_pipeline()
+{
+    const std::string capture_filename
+        = (stdfs::temp_directory_path() / "maskrcnn_pipeline_test.cap").string();
+    std::remove(capture_filename.c_str());
+    std::remove((capture_filename + ".idx").c_str());
+    constexpr int num_frames = 6;
+    auto backend = std::make_unique<mr::ReplayBackend>();
+    backend->addSyntheticFrame(3, 0.2f);
+    backend->setLatency([](int) { return std::chrono::microseconds(2000); });
+    mr::MaskRCNNConfig config;
+    config.capture_filename = capture_filename;
+    config.capture_interval = 1;
+    mr::MaskRCNN network (config, std::move(backend));
+    MR_CHECK(network.build());
+    const cv::Mat image (480, 640, CV_8UC3, cv::Scalar(0, 0, 0));
+    const std::vector<mr::Detection> detections = network.infer(image);
+    {
+        mr::MaskRCNNPipeline pipeline (network, 3);
+        MR_CHECK(pipeline.build());
+        for (int i = 0; i < num_frames; i++) {
+            MR_CHECK(pipeline.submit(image) == static_cast<uint64_t>(i));
+        }
+        mr::MaskRCNNPipeline::Result result;
+        int i = 0;
+        while (pipeline.wait(result)) {
+            MR_CHECK(result.frame_id == static_cast<uint64_t>(i));
+            MR_CHECK(result.success);
+            MR_CHECK(result.output.size() == detections.size());
+            i++;
+        }
+        MR_CHECK(i == num_frames);
+    }
+    MR_CHECK(network.metrics().frames == num_frames + 1);
+    MR_CHECK(network.metrics().detections == (num_frames + 1) * detections.size());
+
+    // Every frame was captured with a unique ID following the one of the
+    // frame run through infer().
+    mr::CaptureReader reader;
+    MR_CHECK(reader.open(capture_filename));
+    MR_CHECK(reader.size() == num_frames + 1);
+    std::vector<uint64_t> frame_ids;
+    for (size_t r = 0; r < reader.size(); r++) {
+        frame_ids.push_back(reader.record(r).metadata.frame_id);
+    }
+    std::sort(frame_ids.begin(), frame_ids.end());
+    for (size_t r = 0; r < frame_ids.size(); r++) {
+        MR_CHECK(frame_ids[r] == r);
+    }
+    reader.close();
+    std::remove(capture_filename.c_str());
+    std::remove((capture_filename + ".idx").c_str());
+}
+
+
+
+int main()
+{
+    test_order_and_overlap();
+    test_failed_launch();
+    test_maskrcnn_pipeline();
+    return mr_test::result();
+}
@@ -0,0 +1,128 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "maskrcnn_trt/filesystem.hpp"
+#include "maskrcnn_trt/preprocessing.hpp"
+#include "test.hpp"
+
+static const std::string filename
+    = (stdfs::temp_directory_path() / "maskrcnn_preprocessing_test.jpg").string();
+
+
+
+/** Append a JPEG segment with a marker and payload to data.
+ */
+static void append_segment(std::vector<uint8_t>& data, uint8_t marker, const std::vector<uint8_t>& payload)
+{
+    const size_t length = payload.size() + 2;
+    data.insert(data.end(), {0xFF, marker, static_cast<uint8_t>(length >> 8),
+            static_cast<uint8_t>(length & 0xFF)});
+    data.insert(data.end(), payload.begin(), payload.end());
+}
+
+
+
+/** Return an APP1 payload containing only an EXIF orientation tag.
+ */
+static std::vector<uint8_t> exif_payload(int orientation, bool little_endian)
+{
+    std::vector<uint8_t> p = {'E', 'x', 'i', 'f', 0, 0};
+    const auto u16 = [&](uint16_t v) {
+        if (little_endian) {
+            p.insert(p.end(), {static_cast<uint8_t>(v & 0xFF), static_cast<uint8_t>(v >> 8)});
+        } else {
+            p.insert(p.end(), {static_cast<uint8_t>(v >> 8), static_cast<uint8_t>(v & 0xFF)});
+        }
+    };
+    const auto u32 = [&](uint32_t v) {
+        if (little_endian) {
+            u16(v & 0xFFFF);
+            u16(v >> 16);
+        } else {
+            u16(v >> 16);
+            u16(v & 0xFFFF);
+        }
+    };
+    p.push_back(little_endian ? 'I' : 'M');
+    p.push_back(little_endian ? 'I' : 'M');
+    u16(42);
+    u32(8);
+    // An IFD with an unrelated ImageDescription entry before the orientation.
+    u16(2);
+    u16(0x010E); u16(2); u32(4); u32(0);
+    u16(0x0112); u16(3); u32(1); u16(orientation); u16(0);
+    u32(0);
+    return p;
+}
+
+
+
+/** Write the header of a JPEG image of the given size, with an APP1 segment
+ * if app1 isn't empty.
+ */
+static void write_jpeg_header(int width, int height, const std::vector<uint8_t>& app1)
+{
+    std::vector<uint8_t> data = {0xFF, 0xD8};
+    // An unrelated APP0 segment.
+    append_segment(data, 0xE0, {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0});
+    if (!app1.empty()) {
+        append_segment(data, 0xE1, app1);
+    }
+    append_segment(data, 0xC0, {8, static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height & 0xFF),
+            static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width & 0xFF), 3,
+            1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1});
+    std::ofstream f (filename, std::ios::binary);
+    f.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+
+
+static void test_jpeg_size()
+{
+    write_jpeg_header(4032, 3024, {});
+    MR_CHECK(mr::read_jpeg_size(filename) == cv::Size(4032, 3024));
+    MR_CHECK(mr::read_jpeg_orientation(filename) == 1);
+
+    std::ofstream (filename, std::ios::binary) << "not a JPEG image";
+    MR_CHECK(mr::read_jpeg_size(filename).empty());
+    MR_CHECK(mr::read_jpeg_orientation(filename) == 1);
+    MR_CHECK(mr::read_jpeg_size(filename + ".missing").empty());
+}
+
+
+
+static void test_jpeg_orientation()
+{
+    for (const bool little_endian : {true, false}) {
+        for (int orientation = 1; orientation <= 8; orientation++) {
+            // Nearly square so the orientation can't be guessed from the
+            // aspect ratio.
+            write_jpeg_header(2049, 2048, exif_payload(orientation, little_endian));
+            MR_CHECK(mr::read_jpeg_size(filename) == cv::Size(2049, 2048));
+            MR_CHECK(mr::read_jpeg_orientation(filename) == orientation);
+        }
+    }
+    // Invalid values and truncated EXIF data are ignored.
+    write_jpeg_header(640, 480, exif_payload(9, true));
+    MR_CHECK(mr::read_jpeg_orientation(filename) == 1);
+    std::vector<uint8_t> truncated = exif_payload(6, false);
+    truncated.resize(20);
+    write_jpeg_header(640, 480, truncated);
+    MR_CHECK(mr::read_jpeg_orientation(filename) == 1);
+    MR_CHECK(mr::read_jpeg_size(filename) == cv::Size(640, 480));
+}
+
+
+
+int main()
+{
+    test_jpeg_size();
+    test_jpeg_orientation();
+    std::remove(filename.c_str());
+    return mr_test::result();
+}
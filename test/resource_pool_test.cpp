@@ -0,0 +1,160 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <atomic>
+#include <thread>
+
+#include "maskrcnn_trt/maskrcnn_pool.hpp"
+#include "maskrcnn_trt/replay_backend.hpp"
+#include "maskrcnn_trt/resource_pool.hpp"
+#include "test.hpp"
+
+static constexpr int num_threads = 8;
+
+
+
+/** Pop and push indices concurrently, checking no index is ever held by two
+ * threads and that all indices are in the list afterwards.
+ */
+static void test_free_list()
+{
+    constexpr uint32_t capacity = 4;
+    mr::FreeList list (capacity);
+    std::atomic<int> owners[capacity] = {};
+    std::atomic<int> errors {0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 200000; i++) {
+                uint32_t index;
+                if (!list.tryPop(index)) {
+                    continue;
+                }
+                if (index >= capacity || owners[index].exchange(1) != 0) {
+                    errors++;
+                    continue;
+                }
+                owners[index] = 0;
+                list.push(index);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    MR_CHECK(errors == 0);
+    bool popped[capacity] = {};
+    uint32_t index;
+    uint32_t count = 0;
+    while (list.tryPop(index)) {
+        MR_CHECK(index < capacity && !popped[index]);
+        popped[index] = true;
+        count++;
+    }
+    MR_CHECK(count == capacity);
+}
+
+
+
+/** A resource recording how many leases currently hold it.
+ */
+struct MockResource {
+    std::atomic<int> users {0};
+    uint64_t uses = 0;
+};
+
+/** Acquire and release resources from more threads than resources, mixing
+ * blocking and non-blocking acquisition, and check that each resource is
+ * only ever leased once at a time.
+ */
+static void test_resource_pool()
+{
+    constexpr int num_resources = 3;
+    constexpr int iterations = 100000;
+    std::vector<std::unique_ptr<MockResource>> resources;
+    for (int i = 0; i < num_resources; i++) {
+        resources.push_back(std::make_unique<MockResource>());
+    }
+    mr::ResourcePool<MockResource> pool (std::move(resources));
+    std::atomic<int> errors {0};
+    std::atomic<uint64_t> leases {0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < iterations; i++) {
+                mr::ResourcePool<MockResource>::Lease lease = (i + t) % 4 == 0
+                    ? pool.tryAcquire() : pool.acquire();
+                if (!lease) {
+                    continue;
+                }
+                if (++lease->users != 1) {
+                    errors++;
+                }
+                lease->uses++;
+                leases++;
+                lease->users--;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    MR_CHECK(errors == 0);
+    // All resources must be available again.
+    std::vector<mr::ResourcePool<MockResource>::Lease> held;
+    uint64_t uses = 0;
+    for (int i = 0; i < num_resources; i++) {
+        held.push_back(pool.tryAcquire());
+        MR_CHECK(held.back());
+        if (held.back()) {
+            uses += held.back()->uses;
+        }
+    }
+    MR_CHECK(!pool.tryAcquire());
+    MR_CHECK(uses == leases);
+}
+
+
+
+/** Run inference concurrently on a pool whose contexts replay synthetic
+ * outputs and check every thread gets the same detections as a single
+ * network.
+ */
+static void test_maskrcnn_pool()
+{
+    auto backend = std::make_unique<mr::ReplayBackend>();
+    backend->addSyntheticFrame(10, 0.2f);
+    backend->setLatency([](int) { return std::chrono::microseconds(200); });
+    mr::MaskRCNNPool pool (mr::MaskRCNNConfig(), 3, std::move(backend));
+    MR_CHECK(pool.build());
+    MR_CHECK(pool.size() == 3);
+    const cv::Mat image (480, 640, CV_8UC3, cv::Scalar(0, 0, 0));
+    const size_t expected = pool.infer(image).size();
+    MR_CHECK(expected > 0);
+    std::atomic<int> errors {0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 20; i++) {
+                if (pool.infer(image).size() != expected) {
+                    errors++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    MR_CHECK(errors == 0);
+}
+
+
+
+int main()
+{
+    test_free_list();
+    test_resource_pool();
+    test_maskrcnn_pool();
+    return mr_test::result();
+}
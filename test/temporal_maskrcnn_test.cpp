@@ -0,0 +1,194 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <vector>
+
+#include "maskrcnn_trt/maskrcnn.hpp"
+#include "maskrcnn_trt/replay_backend.hpp"
+#include "maskrcnn_trt/temporal_maskrcnn.hpp"
+#include "test.hpp"
+
+static constexpr int num_detections = 5;
+
+
+
+/** Return a network replaying one synthetic frame per element of seeds in
+ * turn. Frames with the same seed contain the same detections so the tracker
+ * matches all of them while frames with different seeds have nothing in
+ * common. The network isn't built so that inference fails until build() is
+ * called.
+ */
+static std::unique_ptr<mr::MaskRCNN> make_network(const std::vector<uint32_t>& seeds)
+{
+    auto backend = std::make_unique<mr::ReplayBackend>();
+    for (const uint32_t seed : seeds) {
+        backend->addSyntheticFrame(num_detections, 0.2f, seed);
+    }
+    return std::make_unique<mr::MaskRCNN>(mr::MaskRCNNConfig(), std::move(backend));
+}
+
+
+
+static cv::Mat make_image()
+{
+    return cv::Mat(480, 640, CV_8UC3, cv::Scalar(0, 0, 0));
+}
+
+
+
+/** Return whether all detections are tracked.
+ */
+static bool all_tracked(const std::vector<mr::Detection>& detections)
+{
+    for (const auto& d : detections) {
+        if (d.track_id < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+/** Inference must run every stride frames and the tracker must carry the
+ * detections in between.
+ */
+static void test_keyframe_cadence()
+{
+    std::unique_ptr<mr::MaskRCNN> network = make_network({1});
+    MR_CHECK(network->build());
+    mr::KeyframeConfig config;
+    config.stride = 3;
+    mr::TemporalMaskRCNN temporal (*network, config);
+    const cv::Mat image = make_image();
+    bool cadence = true;
+    bool tracked = true;
+    for (int i = 0; i < 10; i++) {
+        const std::vector<mr::Detection> detections = temporal.process(image);
+        cadence = cadence && temporal.lastWasKeyframe() == (i % 3 == 0) && !temporal.lastFailed();
+        tracked = tracked && detections.size() == num_detections && all_tracked(detections);
+    }
+    MR_CHECK(cadence);
+    MR_CHECK(tracked);
+    MR_CHECK(network->metrics().frames == 4);
+    MR_CHECK(temporal.currentStride() == 3);
+
+    // reset() makes the next frame a keyframe.
+    temporal.reset();
+    temporal.process(image);
+    MR_CHECK(temporal.lastWasKeyframe());
+    MR_CHECK(network->metrics().frames == 5);
+}
+
+
+
+/** Return the stride after each of the first num_keyframes keyframes.
+ */
+static std::vector<int> keyframe_strides(mr::TemporalMaskRCNN& temporal, size_t num_keyframes)
+{
+    const cv::Mat image = make_image();
+    std::vector<int> strides;
+    for (int i = 0; i < 100 && strides.size() < num_keyframes; i++) {
+        temporal.process(image);
+        if (temporal.lastWasKeyframe()) {
+            strides.push_back(temporal.currentStride());
+        }
+    }
+    return strides;
+}
+
+
+
+/** The stride must halve when the scene changes between keyframes, grow back
+ * while it doesn't and be left unchanged by the first keyframe, whose
+ * detections all start new tracks.
+ */
+static void test_adaptive_stride()
+{
+    mr::KeyframeConfig config;
+    config.stride = 4;
+    config.adaptive = true;
+    {
+        std::unique_ptr<mr::MaskRCNN> network = make_network({1});
+        MR_CHECK(network->build());
+        mr::TemporalMaskRCNN temporal (*network, config);
+        MR_CHECK(keyframe_strides(temporal, 4) == std::vector<int>({4, 4, 4, 4}));
+        // Also after a reset.
+        temporal.reset();
+        MR_CHECK(keyframe_strides(temporal, 2) == std::vector<int>({4, 4}));
+    }
+    {
+        // The tracks of a previous scene are only removed after being missed
+        // on TrackerConfig::max_missed_keyframes + 1 keyframes, which also
+        // count as unmatched.
+        std::unique_ptr<mr::MaskRCNN> network = make_network({1, 2, 3, 3, 3, 3, 1});
+        MR_CHECK(network->build());
+        mr::TemporalMaskRCNN temporal (*network, config);
+        MR_CHECK(keyframe_strides(temporal, 7) == std::vector<int>({4, 2, 1, 1, 2, 3, 1}));
+    }
+}
+
+
+
+/** Frames where inference fails must have no detections and be followed by
+ * keyframes until inference succeeds.
+ */
+static void test_failed_inference()
+{
+    std::unique_ptr<mr::MaskRCNN> network = make_network({1});
+    mr::KeyframeConfig config;
+    config.stride = 3;
+    mr::TemporalMaskRCNN temporal (*network, config);
+    const cv::Mat image = make_image();
+    for (int i = 0; i < 2; i++) {
+        MR_CHECK(temporal.process(image).empty());
+        MR_CHECK(temporal.lastWasKeyframe());
+        MR_CHECK(temporal.lastFailed());
+    }
+
+    MR_CHECK(network->build());
+    MR_CHECK(temporal.process(image).size() == num_detections);
+    MR_CHECK(temporal.lastWasKeyframe());
+    MR_CHECK(!temporal.lastFailed());
+    MR_CHECK(temporal.process(image).size() == num_detections);
+    MR_CHECK(!temporal.lastWasKeyframe());
+    MR_CHECK(!temporal.lastFailed());
+}
+
+
+
+/** A frame resembling one on which inference failed must not be skipped by
+ * the motion gate, since there are no detections to return for it.
+ */
+static void test_motion_gate_after_failure()
+{
+    std::unique_ptr<mr::MaskRCNN> network = make_network({1});
+    mr::KeyframeConfig config;
+    config.motion_gate = true;
+    mr::TemporalMaskRCNN temporal (*network, config);
+    const cv::Mat image = make_image();
+    MR_CHECK(temporal.process(image).empty());
+    MR_CHECK(temporal.lastFailed());
+
+    MR_CHECK(network->build());
+    MR_CHECK(temporal.process(image).size() == num_detections);
+    MR_CHECK(temporal.lastWasKeyframe());
+    MR_CHECK(!temporal.lastFailed());
+    // Now the gate can skip the static frames.
+    MR_CHECK(temporal.process(image).size() == num_detections);
+    MR_CHECK(!temporal.lastWasKeyframe());
+    MR_CHECK(temporal.motionGateStats().skipped == 1);
+    MR_CHECK(network->metrics().frames == 1);
+}
+
+
+
+int main()
+{
+    test_keyframe_cadence();
+    test_adaptive_stride();
+    test_failed_inference();
+    test_motion_gate_after_failure();
+    return mr_test::result();
+}
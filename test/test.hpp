@@ -0,0 +1,39 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+// A minimal test harness. Each test executable returns EXIT_FAILURE if any
+// check failed. Checks are evaluated in release builds too, unlike assert().
+
+#ifndef __TEST_HPP
+#define __TEST_HPP
+
+#include <cstdlib>
+#include <iostream>
+
+namespace mr_test {
+    inline int& failures()
+    {
+        static int f = 0;
+        return f;
+    }
+
+    inline int result()
+    {
+        if (failures() > 0) {
+            std::cerr << failures() << " check(s) failed\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+} // namespace mr_test
+
+#define MR_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition "\n"; \
+            mr_test::failures()++; \
+        } \
+    } while (0)
+
+#endif // __TEST_HPP
@@ -0,0 +1,210 @@
+// SPDX-FileCopyrightText: 2021 Smart Robotics Lab, Imperial College London
+// SPDX-FileCopyrightText: 2021 Sotiris Papatheodorou
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cmath>
+#include <vector>
+
+#include "maskrcnn_trt/tracker.hpp"
+#include "test.hpp"
+
+static const cv::Size image_size (1280, 720);
+
+
+
+/** An object moving with constant velocity, visible on frames [first, last).
+ */
+struct Object {
+    int class_id;
+    float x;
+    float y;
+    float dx;
+    float dy;
+    int first = 0;
+    int last = 1000;
+
+    bool visible(int frame) const
+    {
+        return frame >= first && frame < last;
+    }
+
+    mr::Detection detection(int frame) const
+    {
+        mr::Detection d;
+        d.class_id = class_id;
+        d.confidence = 0.9f;
+        d.x_start = x + dx * frame;
+        d.y_start = y + dy * frame;
+        d.x_end = d.x_start + 64;
+        d.y_end = d.y_start + 64;
+        return d;
+    }
+};
+
+
+
+/** Return the detections of the visible objects on frame, with detection i
+ * belonging to objects[indices[i]].
+ */
+static std::vector<mr::Detection> detections(const std::vector<Object>& objects,
+                                             int                        frame,
+                                             std::vector<size_t>&       indices)
+{
+    std::vector<mr::Detection> d;
+    indices.clear();
+    for (size_t i = 0; i < objects.size(); i++) {
+        if (objects[i].visible(frame)) {
+            d.push_back(objects[i].detection(frame));
+            indices.push_back(i);
+        }
+    }
+    return d;
+}
+
+
+
+/** Return the index of the object whose box on frame is closest to that of
+ * d.
+ */
+static size_t closest_object(const std::vector<Object>& objects, int frame, const mr::Detection& d)
+{
+    size_t closest = 0;
+    float closest_distance = INFINITY;
+    for (size_t i = 0; i < objects.size(); i++) {
+        const mr::Detection o = objects[i].detection(frame);
+        const float distance = std::hypot(o.x_start - d.x_start, o.y_start - d.y_start);
+        if (distance < closest_distance) {
+            closest = i;
+            closest_distance = distance;
+        }
+    }
+    return closest;
+}
+
+
+
+/** Track objects for num_frames frames, running update() on every stride-th
+ * frame and predict() on the others. Return the track ID of each object on
+ * each frame, -1 if it had no detection.
+ */
+static std::vector<std::vector<int>> track(const std::vector<Object>& objects,
+                                           int                        num_frames,
+                                           int                        stride)
+{
+    mr::IoUTracker tracker;
+    std::vector<std::vector<int>> ids (num_frames, std::vector<int>(objects.size(), -1));
+    std::vector<size_t> indices;
+    for (int f = 0; f < num_frames; f++) {
+        if (f % stride == 0) {
+            const std::vector<mr::Detection> d = tracker.update(detections(objects, f, indices), image_size);
+            MR_CHECK(d.size() == indices.size());
+            for (size_t i = 0; i < d.size() && i < indices.size(); i++) {
+                ids[f][indices[i]] = d[i].track_id;
+            }
+        } else {
+            for (const auto& d : tracker.predict()) {
+                ids[f][closest_object(objects, f, d)] = d.track_id;
+            }
+        }
+    }
+    return ids;
+}
+
+
+
+/** Objects moving in a grid keep their track ID on every frame, whether
+ * detected or predicted.
+ */
+static void test_stable_ids()
+{
+    std::vector<Object> objects;
+    for (int i = 0; i < 12; i++) {
+        objects.push_back({1 + i % 3, 16.0f + 96 * (i % 6), 16.0f + 96 * (i / 6), 3.0f, 2.0f});
+    }
+    for (const int stride : {1, 2, 5}) {
+        const std::vector<std::vector<int>> ids = track(objects, 40, stride);
+        for (size_t i = 0; i < objects.size(); i++) {
+            MR_CHECK(ids[0][i] == static_cast<int>(i));
+            for (size_t f = 1; f < ids.size(); f++) {
+                MR_CHECK(ids[f][i] == ids[0][i]);
+            }
+        }
+        // The same input produces the same IDs.
+        MR_CHECK(track(objects, 40, stride) == ids);
+    }
+}
+
+
+
+/** Two objects of the same class crossing paths keep their track IDs
+ * instead of swapping them.
+ */
+static void test_crossing()
+{
+    const std::vector<Object> objects = {
+        {1, 100.0f, 100.0f, 8.0f, 0.0f},
+        {1, 500.0f, 140.0f, -8.0f, 0.0f},
+    };
+    for (const int stride : {1, 2}) {
+        const std::vector<std::vector<int>> ids = track(objects, 50, stride);
+        for (size_t f = 0; f < ids.size(); f++) {
+            MR_CHECK(ids[f][0] == 0);
+            MR_CHECK(ids[f][1] == 1);
+        }
+    }
+}
+
+
+
+/** Tracks are removed after max_missed_keyframes missed keyframes, new
+ * objects and objects of another class get new IDs and IDs aren't reused.
+ */
+static void test_creation_and_removal()
+{
+    mr::TrackerConfig config;
+    config.max_missed_keyframes = 1;
+    mr::IoUTracker tracker (config);
+    const Object a {1, 100.0f, 100.0f, 0.0f, 0.0f};
+    const Object b {2, 400.0f, 100.0f, 0.0f, 0.0f};
+    std::vector<mr::Detection> d = tracker.update({a.detection(0), b.detection(0)}, image_size);
+    MR_CHECK(d.size() == 2 && d[0].track_id == 0 && d[1].track_id == 1);
+    MR_CHECK(tracker.lastUpdate().created == 2);
+
+    // b is missed once and kept, but not predicted.
+    d = tracker.update({a.detection(1)}, image_size);
+    MR_CHECK(d.size() == 1 && d[0].track_id == 0);
+    MR_CHECK(tracker.lastUpdate().matched == 1 && tracker.lastUpdate().missed == 1);
+    MR_CHECK(tracker.numTracks() == 2);
+    MR_CHECK(tracker.predict().size() == 1);
+
+    // b is missed twice and removed.
+    d = tracker.update({a.detection(3)}, image_size);
+    MR_CHECK(tracker.numTracks() == 1);
+
+    // An object of another class at the position of a and the reappearing b
+    // get new IDs.
+    mr::Detection other_class = a.detection(4);
+    other_class.class_id = 3;
+    d = tracker.update({a.detection(4), other_class, b.detection(4)}, image_size);
+    MR_CHECK(d.size() == 3);
+    MR_CHECK(d[0].track_id == 0);
+    MR_CHECK(d[1].track_id == 2);
+    MR_CHECK(d[2].track_id == 3);
+    MR_CHECK(tracker.lastUpdate().matched == 1 && tracker.lastUpdate().created == 2);
+
+    // IDs keep increasing after a reset.
+    tracker.reset();
+    MR_CHECK(tracker.numTracks() == 0);
+    d = tracker.update({a.detection(5)}, image_size);
+    MR_CHECK(d.size() == 1 && d[0].track_id == 4);
+}
+
+
+
+int main()
+{
+    test_stable_ids();
+    test_crossing();
+    test_creation_and_removal();
+    return mr_test::result();
+}